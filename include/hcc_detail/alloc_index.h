@@ -0,0 +1,115 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANNTY OF ANY KIND, EXPRESS OR
+IMPLIED, INNCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANNY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER INN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR INN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+//#pragma once
+#ifndef ALLOC_INDEX_H
+#define ALLOC_INDEX_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+//-------------------------------------------------------------------------------------------------
+// Pointer information for an allocation, the subset of hc::AmPointerInfo that HIP uses.
+struct AllocInfo {
+    void       *_hostPointer;
+    void       *_devicePointer;
+    size_t      _sizeBytes;
+    bool        _isInDeviceMem;
+    int         _appId;               // device index set by am_memtracker_update, -1 if not set.
+    unsigned    _appAllocationFlags;
+};
+
+
+//-------------------------------------------------------------------------------------------------
+// HIP-side index of the allocations HIP registers in the am_memtracker, so copies and pointer queries can classify a
+// pointer without a tracker query.  Allocations never overlap, so the interval tree is a list of ranges sorted by
+// base address and searched with a binary search.  The list is split into chunks of up to _chunkEntries entries,
+// with a top-level array of each chunk's first base, so a lookup is two binary searches.
+//
+// Readers never take a lock:
+//   - Writers build a new snapshot under the mutex and publish it with an atomic pointer swap.  The snapshot copies
+//     only the top-level array and the chunks the update touches - other chunks are shared with the old snapshot,
+//     so an insert or remove costs O(n / _chunkEntries + _chunkEntries) instead of a copy of every entry.
+//   - Replaced snapshots are kept until no reader is active.  Readers are counted in _readerSlots padded counters,
+//     one picked per thread, so lookups on different threads do not share a cache line.
+//   - Each thread also remembers its last hit, which stays valid until an entry is removed.  Repeated copies
+//     between the same buffers then skip the search and the reader count.
+//
+// The index mirrors the tracker: an entry is added where HIP registers memory with the tracker and removed where
+// HIP frees it.  A miss does not mean the pointer is unknown - callers fall back to am_memtracker_getinfo, which
+// also covers memory allocated outside of HIP.
+class AllocIndex {
+public:
+    AllocIndex();
+    ~AllocIndex();
+
+    // Add the range [base, base+info._sizeBytes).  Stale entries overlapping the range are dropped.
+    void        locked_insert(const void *base, const AllocInfo &info, int deviceIndex);
+    void        locked_remove(const void *base);
+
+    // Remove all entries owned by deviceIndex.  Called from device reset, after am_memtracker_reset.
+    void        locked_removeDevice(int deviceIndex);
+
+    // Lock-free.  Returns false if ptr is not inside an indexed allocation.
+    bool        lookup(const void *ptr, AllocInfo *info) const;
+
+private:
+    struct Entry {
+        const char *_base;
+        AllocInfo   _info;
+        int         _deviceIndex;   // device which owns the allocation, used by device reset.
+    };
+    typedef std::vector<Entry> Chunk;   // sorted by base, never empty.  Immutable once published.
+
+    struct Snapshot {
+        std::vector<const char*>                _firstBase;   // _chunks[i]->front()._base.
+        std::vector<std::shared_ptr<Chunk>>     _chunks;      // shared by the snapshots which contain them.
+    };
+
+    static const size_t _chunkEntries = 64;
+    static const int    _readerSlots = 16;
+
+    struct ReaderSlot {
+        std::atomic<int>    _count;
+        char                _pad[64 - sizeof(std::atomic<int>)];   // one cache line each.
+    };
+
+    static bool         find(const Snapshot &snapshot, const void *ptr, const Entry **entry);
+    static size_t       chunkIndex(const Snapshot &snapshot, const char *p);
+
+    // New snapshot with chunks [first, last) of cur replaced by entries, split into chunks.
+    static Snapshot*    replaceChunks(const Snapshot &cur, size_t first, size_t last, const std::vector<Entry> &entries);
+
+    // Caller must hold _mutex.
+    void                publish(Snapshot *snapshot, bool removed);
+    bool                readersIdle() const;
+
+private:
+    std::mutex                          _mutex;
+    std::vector<Snapshot*>              _retired;      // replaced snapshots which may still be read.
+
+    std::atomic<Snapshot*>              _current;
+    mutable ReaderSlot                  _readers[_readerSlots];
+    std::atomic<uint64_t>               _generation;   // bumped when an entry is removed, invalidates last-hit caches.
+};
+
+#endif
@@ -0,0 +1,94 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANNTY OF ANY KIND, EXPRESS OR
+IMPLIED, INNCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANNY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER INN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR INN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+//#pragma once
+#ifndef COPY_TUNER_H
+#define COPY_TUNER_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <stdio.h>
+
+#include "hip/hcc_detail/staging_buffer.h"
+
+class ihipDevice_t;
+
+
+//-------------------------------------------------------------------------------------------------
+// Table of the fastest algorithm (and staging chunk size) for unpinned H2D and D2H copies, by copy size.
+//
+// The table is built by a calibration pass which times each algorithm across a sweep of copy sizes, then
+// picks the best plan at each size.  The crossover between neighboring sizes is placed at their geometric mean.
+// The result is saved in a per-machine text file keyed by device name and PCI location, so later runs just
+// load it at device init.  Without a saved table, calibration runs on a background thread started at device
+// init, and lookups return a direct copy until it is done.  Its timings share the device with the application's
+// copies, so a table calibrated while the application is busy may be worth recalibrating (HIP_COPY_TUNE=2).
+//
+// The file has one line per table entry:
+//     <device-key> <h2d|d2h> <max-bytes|max> <staged|pininplace|direct> <chunk-bytes>
+// Entries for each direction must be in increasing max-bytes order.  The file can be edited, or
+// HIP_COPY_TUNE_FILE can point at a hand-written table, to override the calibrated choices.
+//
+// Each pin-in-place copy is timed with its pin and unpin.
+//
+// CopyTuner provides thread-safe access via a mutex.  Calibration does not hold the mutex while it times
+// copies, only to publish the finished table.
+struct CopyTuner {
+
+    // recalibrate = ignore any saved table.
+    CopyTuner(ihipDevice_t *device, bool recalibrate, bool dump);
+    ~CopyTuner();
+
+    StagingCopyPlan locked_lookup(bool hostToDevice, size_t sizeBytes);
+
+    void locked_dump(FILE *f);
+
+private:
+    struct Entry {
+        size_t          _maxBytes;
+        StagingCopyPlan _plan;
+    };
+
+    bool    load();
+    void    save();
+    void    calibrateWorker();
+    bool    calibrate(std::vector<Entry> table[2]);
+    bool    sweep(void *devPtr, void *hostPtr, std::vector<Entry> table[2]);
+    double  timeCopy(bool hostToDevice, const StagingCopyPlan &plan, void *devPtr, void *hostPtr, size_t sizeBytes);
+    void    dump(FILE *f);
+
+private:
+    ihipDevice_t           *_device;
+    std::string             _key;
+    std::string             _fileName;
+    bool                    _recalibrate;
+    bool                    _dump;
+
+    std::mutex              _lock;
+    bool                    _ready;     // _table is complete, and no longer changes.
+    std::vector<Entry>      _table[2];  // [0] = H2D, [1] = D2H
+
+    std::thread             _calibrator;  // runs calibrateWorker if there was no saved table.
+    std::atomic<bool>       _stop;        // set by the destructor to end calibration early.
+};
+
+#endif
@@ -21,8 +21,14 @@ THE SOFTWARE.
 #define HIP_HCC_H
 
 #include <hc.hpp>
+#include <grid_launch.h>
+#include <functional>
+#include <atomic>
 #include "hip/hcc_detail/hip_util.h"
 #include "hip/hcc_detail/staging_buffer.h"
+#include "hip/hcc_detail/alloc_index.h"
+#include "hip/hcc_detail/copy_tuner.h"
+#include "hip/hcc_detail/signal_wait.h"
 
 #define HIP_HCC
 
@@ -60,10 +66,27 @@ extern int HIP_ATP_MARKER;
 extern int HIP_ATP;
 extern int HIP_DB;
 extern int HIP_STAGING_SIZE;   /* size of staging buffers, in KB */
-extern int HIP_STAGING_BUFFERS;    // TODO - remove, two buffers should be enough.
+extern int HIP_STAGING_BUFFERS;  /* number of staging buffers in each direction, up to StagingBuffer::_max_buffers */
 extern int HIP_PININPLACE;
-extern int HIP_STREAM_SIGNALS;  /* number of signals to allocate at stream creation */
+extern int HIP_PININPLACE_MAX_PINNED;  /* max host memory (in MB) pinned at once by pin-in-place copies */
+extern int HIP_COPY_TUNE;  /* pick unpinned copy algorithm from a calibrated table: 1=load or calibrate, 2=recalibrate */
+extern int HIP_COPY_TUNE_DUMP;  /* print the copy tuning table when it is loaded or calibrated */
+extern int HIP_STAGING_POOL;  /* max staging buffers per direction, so streams can stage copies concurrently */
+extern int HIP_STAGING_ASYNC;
+extern int HIP_STAGING_MT_THREADS;  /* helper threads for the host side of large staged copies, 0=disable */
+extern int HIP_STAGING_MT_THRESHOLD;  /* min size of staged copy (in KB) that uses the helper threads */
+extern int HIP_STAGING_D2H_RING;  /* 1=refill each D2H staging buffer as soon as it is unloaded, 0=refill after the whole batch */
+extern int HIP_NONTEMPORAL_COPY; /* max HostMemcpyIsa for streaming-store copies, 0=libc memcpy */
+extern int HIP_STREAM_SIGNALS;  /* number of signals moved between a stream's cache and the device signal pool at a time */
+extern int HIP_STREAM_SIGNALS_MAX;  /* max number of in-flight signals per stream */
 extern int HIP_VISIBLE_DEVICES; /* Contains a comma-separated sequence of GPU identifiers */
+extern int HIP_SYNC_NULL_STREAM; /* Use host-side synchronization for legacy NULL stream ordering */
+extern int HIP_MEMPOOL_RELEASE_THRESHOLD; /* MB of freed hipMallocAsync memory to cache per device, -1=unlimited */
+extern int HIP_TRACK_HAZARDS; /* create every stream with hipStreamTrackHazards */
+extern int HIP_CALLBACK_THREADS; /* threads which run hipStreamAddCallback callbacks */
+extern int HIP_WAIT_MODE; /* SignalWaitMode for devices with hipDeviceScheduleAuto */
+extern int HIP_WAIT_SPIN_US; /* spin time of hybrid waits before blocking */
+extern int HIP_STREAM_QUEUES; /* max HSA queues per device for created streams, 0=unlimited */
 
 
 //---
@@ -75,6 +98,8 @@ extern thread_local int tls_defaultDevice;
 extern thread_local hipError_t tls_lastHipError;
 class ihipStream_t;
 class ihipDevice_t;
+struct MemoryPool;
+struct DeferredFreeQueue;
 
 
 // Color defs for debug messages:
@@ -109,6 +134,16 @@ class ihipDevice_t;
 #define FORCE_SAMEDIR_COPY_DEP 1
 
 
+// Max number of in-flight commands tracked by a hipStreamTrackHazards stream.  Past this the stream joins
+// the tracked commands with a barrier, so the overlap scan for each command stays short.
+#define MAX_TRACKED_HAZARDS 64
+
+
+// Max number of launches of one graph exec in flight.  Each needs its own set of copy completion signals,
+// further launches wait on the host for the oldest set.
+#define MAX_GRAPH_SIGNAL_SETS 8
+
+
 // Compile debug trace mode - this prints debug messages to stderr when env var HIP_DB is set.
 // May be set to 0 to remove debug if checks - possible code size and performance difference?
 #define COMPILE_HIP_DB  1
@@ -248,10 +283,13 @@ enum ihipCommand_t {
     ihipCommandCopyD2H,
     ihipCommandCopyD2D,
     ihipCommandKernel,
+    ihipCommandBarrier,  // barrier packet inserted by the runtime, ie to wait on another stream's event.
+    ihipCommandCopyStaged, // copy run by a staging buffer worker thread, ordered only through _last_copy_signal.
+    ihipCommandCallback,   // blocking hipStreamAddCallback, ordered only through _last_copy_signal.
 };
 
 static const char* ihipCommandName[] = {
-    "CopyH2H", "CopyH2D", "CopyD2H", "CopyD2D", "Kernel"
+    "CopyH2H", "CopyH2D", "CopyD2H", "CopyD2D", "Kernel", "Barrier", "CopyStaged", "Callback"
 };
 
 
@@ -261,17 +299,139 @@ typedef uint64_t SIGSEQNUM;
 //---
 // Small wrapper around signals.
 // Designed to be used from stream.
-// TODO-someday refactor this class so it can be stored in a vector<>
-// we already store the index here so we can use for garbage collection.
+// Signals are owned by the device-wide ihipSignalPool_t and loaned to streams.
+//
+// A stream reclaims a signal once it reads 0, but a packet which depends on the command (a barrier, or a copy
+// with the signal in its dependency list) may still be waiting in a queue and read the signal later.  Reusing the
+// signal then makes that packet wait for an unrelated command, which can deadlock.  So every packet that depends on
+// a signal holds it until the packet's own completion signal is reclaimed, and allocSignal skips held signals.
 struct ihipSignal_t {
     hsa_signal_t   _hsa_signal; // hsa signal handle
-    int            _index;      // Index in pool, used for garbage collection.
     SIGSEQNUM      _sig_id;     // unique sequentially increasing ID.
 
+    // Bumped each time a stream allocates the signal, so a holder can tell whether the command it refers to
+    // has been replaced by a later command.
+    std::atomic<uint64_t>   _generation;
+
+    // Packets (and host waiters) which may still read the signal.
+    std::atomic<int>        _holds;
+
+    // Signals and kernel completions this command's packet depends on, held until this signal is reclaimed.
+    // Only accessed by the stream which allocated the signal.
+    std::vector<ihipSignal_t*>          _pinned;
+    std::vector<hc::completion_future>  _pinnedFutures;
+
     ihipSignal_t();
     ~ihipSignal_t();
 
-    void release();
+    // Hold the signal if it still belongs to the command at generation.  Returns false if the signal has been
+    // reused, which means that command has completed.
+    bool hold(uint64_t generation);
+    void unhold() { _holds--; };
+
+    // Non-blocking check for completion of the command at generation.
+    bool completed(uint64_t generation) const;
+
+    // Release the holds taken by this command's packet, once the packet has completed.
+    void unpin();
+};
+
+
+//---
+// Completion of a stream command, referenced from outside the stream's lock - by another stream, a freed memory
+// block or an event.  Either a stream signal with its generation when the reference was taken, or a kernel future.
+// Copies of the future keep HCC from recycling the kernel's signal.
+struct ihipSignalRef_t {
+    ihipSignalRef_t() : _signal(NULL), _generation(0) {};
+    explicit ihipSignalRef_t(ihipSignal_t *signal) : _signal(signal), _generation(signal->_generation.load()) {};
+    explicit ihipSignalRef_t(const hc::completion_future &future) : _signal(NULL), _generation(0), _future(future) {};
+
+    bool completed() const;
+
+    // Host wait.  A stream signal is held during the wait so it cannot be reused.
+    void wait(SignalWaitMode mode) const;
+
+    ihipSignal_t           *_signal;
+    uint64_t                _generation;
+    hc::completion_future   _future;    // if _signal is NULL.
+};
+
+
+//---
+// Device-wide pool of free signals.
+// Each stream keeps a small cache of free signals and moves them to or from this pool in batches
+// of HIP_STREAM_SIGNALS, so the pool mutex is not taken on every signal allocation.
+// The pool only grows when all existing signals are in use by the streams.
+class ihipSignalPool_t {
+public:
+    ihipSignalPool_t() {};
+
+    // Move cnt free signals to the back of cache, creating new signals if the pool runs dry.
+    void locked_acquire(std::vector<ihipSignal_t*> &cache, size_t cnt);
+
+    // Move cnt signals from the back of cache to the pool.  Signals must have completed (value 0).
+    void locked_release(std::vector<ihipSignal_t*> &cache, size_t cnt);
+
+private:
+    std::mutex                  _mutex;
+    std::deque<ihipSignal_t>    _signals;   // Storage for every signal created on this device.
+    std::vector<ihipSignal_t*>  _freeList;  // Signals not currently loaned to a stream.
+};
+
+
+//---
+// HSA queue (HCC accelerator_view) used by one or more streams.
+// Streams on the same queue are protected by different stream locks, so everything that writes packets into the
+// queue (kernel dispatch, barriers, markers) also holds _mutex.  The mutex is recursive since barriers are written
+// while a kernel dispatch holds it.
+struct ihipQueue_t {
+    ihipQueue_t(hc::accelerator_view av, int priority) : _av(av), _priority(priority), _streamCnt(0), _profiling(false) {};
+
+    // Turn on packet timestamps, on first use by an event with timing.  Caller must hold _mutex.
+    void                        enableProfiling();
+
+    hc::accelerator_view        _av;
+    int                         _priority;   // stream priority, from hipStreamPriorityHigh to hipStreamPriorityLow.
+    std::recursive_mutex        _mutex;
+    // Streams using this queue.  Changed under the pool mutex, atomic since ihipStream_t::wait reads it without.
+    std::atomic<int>            _streamCnt;
+    bool                        _profiling;  // protected by _mutex.
+};
+
+
+// Device-wide pool of queues for created streams, so hipStreamCreate does not create an HSA queue each time and
+// the number of hardware queues stays bounded.
+// Queues are created on demand up to maxQueues, and go back to the pool when their last stream is destroyed.
+// Once maxQueues are in use new streams share the queue with the fewest streams.  Queues are in-order, so sharing
+// adds false dependencies between the streams on the queue but keeps each stream's order.
+// The default stream has its own queue, which is never shared.
+//
+// Each stream priority has its own queues, created with the matching HSA queue priority, so a high-priority stream
+// never sits behind a normal-priority stream's work in the same queue.  maxQueues applies to each priority.
+class ihipQueuePool_t {
+public:
+    static const int _numPriorities = hipStreamPriorityLow - hipStreamPriorityHigh + 1;
+
+    ihipQueuePool_t() : _default_queue(NULL), _maxQueues(0) {};
+    ~ihipQueuePool_t() { delete _default_queue; };
+
+    void            init(hc::accelerator &acc, int maxQueues);
+
+    ihipQueue_t *   defaultQueue() { return _default_queue; };
+    ihipQueue_t *   locked_acquire(int priority);
+    void            locked_release(ihipQueue_t *queue);
+
+private:
+    ihipQueue_t *   createQueue(int priority);  // caller must hold _mutex.
+
+private:
+    std::mutex                  _mutex;
+    hc::accelerator             _acc;
+    ihipQueue_t                *_default_queue;
+    size_t                      _maxQueues;  // per priority, 0=unlimited.
+    std::list<ihipQueue_t>      _queues;     // Storage for every pooled queue, stable addresses.
+    size_t                      _queueCnt[_numPriorities];   // Queues created for each priority.
+    std::vector<ihipQueue_t*>   _idle[_numPriorities];       // Queues without streams, for each priority.
 };
 
 
@@ -348,6 +508,27 @@ struct LockedBase {
 };
 
 
+//---
+// Memory range accessed by an in-flight command in a hipStreamTrackHazards stream.
+// A copy records a read range for its source and a write range for its destination.
+// Commands are ordered only behind earlier commands whose ranges overlap with a write on either side.
+struct ihipHazard_t {
+    const char            *_start;
+    const char            *_end;          // one past the last byte.
+    bool                   _write;
+
+    // Completion of the command - either a stream copy signal (checked against _sig_id since signals are
+    // recycled) or the future of an annotated kernel:
+    ihipSignal_t          *_copy_signal;
+    SIGSEQNUM              _sig_id;
+    hc::completion_future  _kernel_future;
+
+    bool overlaps(const char *start, const char *end, bool write) const {
+        return (_write || write) && (start < _end) && (_start < end);
+    }
+};
+
+
 template <typename MUTEX_TYPE> 
 class ihipStreamCriticalBase_t : public LockedBase<MUTEX_TYPE> 
 {
@@ -355,17 +536,12 @@ public:
     ihipStreamCriticalBase_t() :
         _last_command_type(ihipCommandCopyH2H),
         _last_copy_signal(NULL),
-        _signalCursor(0),
         _oldest_live_sig_id(1),
-        _stream_sig_id(0)
+        _stream_sig_id(0),
+        _annotatedKernel(false)
     {
-        _signalPool.resize(HIP_STREAM_SIGNALS > 0 ? HIP_STREAM_SIGNALS : 1);
     };
 
-    ~ihipStreamCriticalBase_t() {
-        _signalPool.clear();
-    }
-
     ihipStreamCriticalBase_t<StreamMutex>  * mlock() { LockedBase<MUTEX_TYPE>::lock(); return this;};
 
 
@@ -376,17 +552,29 @@ public:
     // signal of last copy command sent to the stream.
     // May be NULL, indicating the previous command has completley finished and future commands don't need to create a dependency.
     // Copy can be either H2D or D2H.
+    // If _last_command_type is ihipCommandBarrier, this is the completion signal of the barrier packet.
     ihipSignal_t                *_last_copy_signal;
 
     hc::completion_future       _last_kernel_future;  // Completion future of last kernel command sent to GPU.
 
     // Signal pool:
-    int                         _signalCursor;
-    SIGSEQNUM                   _oldest_live_sig_id; // oldest live seq_id, anything < this can be allocated.
-    std::deque<ihipSignal_t>    _signalPool;   // Pool of signals for use by this stream.
+    // Commands in the stream complete in-order, so signals are reclaimed from the front of _inflightSignals
+    // and the sig_ids in _inflightSignals are always contiguous.
+    SIGSEQNUM                   _oldest_live_sig_id; // oldest live seq_id, anything < this has completed.
+    std::deque<ihipSignal_t*>   _inflightSignals;    // Signals attached to commands in this stream, oldest first.
+    std::vector<ihipSignal_t*>  _signalCache;        // Free signals, refilled from the device signal pool.
+    std::vector<ihipSignal_t*>  _heldSignals;        // Free signals still held by a packet, see ihipSignal_t.
 
 
     SIGSEQNUM                   _stream_sig_id;      // Monotonically increasing unique signal id.
+
+    // hipStreamTrackHazards:
+    // _last_command_type/_last_copy_signal/_last_kernel_future describe the last command that everything
+    // later depends on (the "fence").  Tracked copies and annotated kernels issued after the fence are
+    // kept in _hazards instead, and only wait for the fence plus the entries they overlap.
+    std::vector<ihipHazard_t>   _hazards;
+    std::vector<ihipHazard_t>   _kernelRanges;       // hipStreamAnnotateKernelRange ranges for the next kernel.
+    bool                        _annotatedKernel;    // kernel between lockopen/lockclose is tracked in _hazards.
 };
 
 
@@ -394,13 +582,86 @@ typedef ihipStreamCriticalBase_t<StreamMutex> ihipStreamCritical_t;
 typedef LockedAccessor<ihipStreamCritical_t> LockedAccessor_StreamCrit_t;
 
 
+//---
+// Stream capture and graphs.
+// Commands sent to a capturing stream are recorded as graph nodes instead of running.  Each node lists the
+// earlier nodes it depends on - capture produces a chain in stream order.
+enum ihipGraphNodeType_t {
+    ihipGraphNodeKernel,
+    ihipGraphNodeCopy,
+    ihipGraphNodeMemset,
+};
+
+struct ihipGraphNode_t {
+    ihipGraphNodeType_t                     _type;
+    std::vector<size_t>                     _deps;        // indices of earlier nodes.
+
+    // Kernel: launch params and a closure which calls the grid_launch kernel with the captured arguments.
+    grid_launch_parm                        _lp;
+    std::function<void(grid_launch_parm&)>  _kernel;
+
+    // Copy and memset:
+    void                                   *_dst;
+    const void                             *_src;
+    size_t                                  _sizeBytes;
+    unsigned                                _kind;        // hipMemcpyKind
+    int                                     _value;
+
+    // Resolved by instantiate:
+    ihipCommand_t                           _commandType;
+    hsa_agent_t                             _srcAgent;
+    hsa_agent_t                             _dstAgent;
+    size_t                                  _copySlot;    // index of the copy's completion signal in a signal set.
+};
+
+
+struct ihipGraph_t {
+    ihipGraph_t(unsigned device_index) : _device_index(device_index) {};
+
+    void addNode(ihipGraphNode_t &node);
+
+    unsigned                        _device_index;
+    std::vector<ihipGraphNode_t>    _nodes;
+};
+
+
+// Instantiated graph.  Copy agents and node dependencies are resolved once, and each launch only writes packets.
+// Copies complete on signals owned by the exec - a set of them per launch in flight.
+// An exec may be launched repeatedly, but not from two threads at once.
+struct ihipGraphExec_t {
+    ihipGraphExec_t(const ihipGraph_t &graph);
+    ~ihipGraphExec_t();
+
+    // Copy completion signals of one launch.  The set is reused once the launch's sink barrier has completed,
+    // which follows every packet that reads the signals.
+    struct SignalSet {
+        std::vector<hsa_signal_t>   _signals;
+        ihipSignalRef_t             _sink;
+    };
+
+    SignalSet &nextSignalSet();
+
+    unsigned                                _device_index;
+    std::vector<ihipGraphNode_t>            _nodes;
+    std::vector<size_t>                     _sinks;       // nodes no other node depends on.
+    size_t                                  _copyCnt;
+
+    std::vector<SignalSet>                  _signalSets;
+    size_t                                  _nextSignalSet;
+
+    // Scratch for launch, kept to avoid allocating on every replay:
+    std::vector<hc::completion_future>      _kernelFutures;
+    std::vector<hsa_signal_t>               _depSignals;
+};
+
+
 
 // Internal stream structure.
 class ihipStream_t {
 public:
 typedef uint64_t SeqNum_t ;
 
-    ihipStream_t(unsigned device_index, hc::accelerator_view av, unsigned int flags);
+    ihipStream_t(unsigned device_index, ihipQueue_t *queue, unsigned int flags);
     ~ihipStream_t();
 
     // kind is hipMemcpyKind
@@ -415,43 +676,77 @@ typedef uint64_t SeqNum_t ;
     void                 lockclose_postKernelCommand(hc::completion_future &kernel_future);
 
     int                  preCopyCommand(LockedAccessor_StreamCrit_t &crit, ihipSignal_t *lastCopy, hsa_signal_t *waitSignal, ihipCommand_t copyType);
+    int                  preTrackedCopyCommand(LockedAccessor_StreamCrit_t &crit, ihipSignal_t *copySignal, void *dst, const void *src, size_t sizeBytes,
+                                               std::vector<hsa_signal_t> &waitSignals);
+
+    void                 locked_annotateKernelRange(const void *ptr, size_t sizeBytes, unsigned access);
+    void                 locked_addCallback(hipStream_t userStream, hipStreamCallback_t callback, void *userData, unsigned flags);
+
+    void                 locked_launchGraph(ihipGraphExec_t *exec);
+    void                 locked_recordEvent(ihipEvent_t *event);
 
-    void                 locked_reclaimSignals(SIGSEQNUM sigNum);
+    void                 locked_reclaimSignals();
     void                 locked_wait(bool assertQueueEmpty=false);
-    SIGSEQNUM            locked_lastCopySeqId() {LockedAccessor_StreamCrit_t crit(_criticalData); return lastCopySeqId(crit); };
+    void                 locked_waitSignals(const std::vector<ihipSignalRef_t> &deps);
+    void                 locked_waitEvent(ihipEvent_t *event);
+    bool                 locked_lastCompletionSignal(ihipSignalRef_t *ref);
 
     // Use this if we already have the stream critical data mutex:
     void                 wait(LockedAccessor_StreamCrit_t &crit, bool assertQueueEmpty=false);
 
+    // Returns and clears the first error of a failed staged async copy, see _asyncError.  Call after a wait.
+    hipError_t           takeAsyncError() { return static_cast<hipError_t>(_asyncError.exchange(hipSuccess)); };
+
 
 
     // Non-threadsafe accessors - must be protected by high-level stream lock with accessor passed to function.
     SIGSEQNUM            lastCopySeqId (LockedAccessor_StreamCrit_t &crit) { return crit->_last_copy_signal ? crit->_last_copy_signal->_sig_id : 0; };
+    bool                 lastCompletionSignal(LockedAccessor_StreamCrit_t &crit, ihipSignalRef_t *ref);
     ihipSignal_t *       allocSignal (LockedAccessor_StreamCrit_t &crit);
+    void                 reclaimSignals(LockedAccessor_StreamCrit_t &crit);
+    void                 joinHazards(LockedAccessor_StreamCrit_t &crit);
 
 
     //-- Non-racy accessors:
     // These functions access fields set at initialization time and are non-racy (so do not acquire mutex)
     ihipDevice_t *              getDevice() const;
+    SignalWaitMode              waitMode() const;
+    int                         priority() const { return _queue->_priority; };
+    bool                        highPriority() const { return _queue->_priority < hipStreamPriorityNormal; };
+    size_t                      signalBatch() const;
+
+    // The unsigned return is hipMemcpyKind
+    unsigned                    resolveMemcpyDirection(bool srcInDeviceMem, bool dstInDeviceMem);
+    void                        setCopyAgents(unsigned kind, ihipCommand_t *commandType, hsa_agent_t *srcAgent, hsa_agent_t *dstAgent);
 
 
 public:
     //---
     //Public member vars - these are set at initialization and never change:
     SeqNum_t                    _id;   // monotonic sequence ID
-    hc::accelerator_view        _av;
+    ihipQueue_t                *_queue; // from the device queue pool, may be shared with other streams.
+    hc::accelerator_view        _av;    // _queue->_av
     unsigned                    _flags;
+    bool                        _trackHazards;  // hipStreamTrackHazards or HIP_TRACK_HAZARDS.
+
+    // Graph recording commands between hipStreamBeginCapture and hipStreamEndCapture, or NULL.
+    // Only accessed by the capturing thread.
+    ihipGraph_t                *_capture;
+
+    // Set by a staging buffer worker when an async staged copy of this stream fails, since the copy has no
+    // API call to return the error to.  The next stream or device synchronize returns it.
+    std::atomic<int>            _asyncError;
 
 private: // Critical Data.  THis MUST be accessed through LockedAccessor_StreamCrit_t
     ihipStreamCritical_t        _criticalData;
 
 private:
-    void                        enqueueBarrier(hsa_queue_t* queue, ihipSignal_t *depSignal);
+    void                        enqueueBarrier(hsa_queue_t* queue, int depSignalCnt, const hsa_signal_t *depSignals, hsa_signal_t completionSignal);
     void                        waitCopy(LockedAccessor_StreamCrit_t &crit, ihipSignal_t *signal);
-
-    // The unsigned return is hipMemcpyKind
-    unsigned resolveMemcpyDirection(bool srcInDeviceMem, bool dstInDeviceMem);
-    void setCopyAgents(unsigned kind, ihipCommand_t *commandType, hsa_agent_t *srcAgent, hsa_agent_t *dstAgent);
+    bool                        liveHazardSignal(LockedAccessor_StreamCrit_t &crit, ihipHazard_t &hazard, ihipSignalRef_t *ref);
+    bool                        fenceSignal(LockedAccessor_StreamCrit_t &crit, ihipSignalRef_t *ref);
+    void                        waitSignals(LockedAccessor_StreamCrit_t &crit, const std::vector<ihipSignalRef_t> &deps);
+    void                        pruneHazards(LockedAccessor_StreamCrit_t &crit);
 
     unsigned                    _device_index;       // index into the g_device array 
 
@@ -480,19 +775,50 @@ enum hipEventStatus_t {
 
 
 // internal hip event structure.
+// Recording the event into a stream enqueues a barrier packet that waits for the stream's earlier kernels and copies,
+// with _signal as its completion signal.  So the event has completed once _signal reaches 0.
 struct ihipEvent_t {
     hipEventStatus_t       _state;
 
-    hipStream_t           _stream;  // Stream where the event is recorded, or NULL if all streams.
+    hipStream_t           _stream;  // Stream where the event is recorded, the device's default stream for the NULL stream.
+    ihipDevice_t         *_device;  // Device of _stream, for reading the timestamp after the stream is destroyed.
     unsigned              _flags;
 
-    hc::completion_future _marker;
-    uint64_t              _timestamp;  // store timestamp, may be set on host or by marker.
+    ihipSignalRef_t       _signal;     // completion of the last record, a signal of the recording stream.
+    uint64_t              _timestamp;  // set from the barrier packet, 0 if the timestamp is not available.
+
+    // SDMA copy that the event barrier waits for, or empty.  The event takes the copy's end time instead of the
+    // barrier's.
+    ihipSignalRef_t       _copy;
 
-    SIGSEQNUM             _copy_seq_id;
+    // A timed event holds _signal and _copy until the timestamp has been read, see ihipStream_t::locked_recordEvent.
+    bool                  _held;
+
+    // Protects the fields above against a concurrent record, release or Recording->Recorded transition (ihipSetTs),
+    // so exactly one thread unholds the signals.  Taken after the stream's critical data lock.
+    std::mutex            _mutex;
+
+    ihipEvent_t() : _held(false) {};
 } ;
 
 
+//---
+// Slab of event objects, so hipEventCreate and hipEventDestroy do not allocate.
+// Signals come from the recording stream, so an in-flight record of a destroyed event needs nothing from the pool.
+class ihipEventPool_t {
+public:
+    ihipEventPool_t() {};
+
+    ihipEvent_t *   locked_acquire();
+    void            locked_release(ihipEvent_t *event);
+
+private:
+    std::mutex                  _mutex;
+    std::deque<ihipEvent_t>     _events;     // Storage for every event, stable addresses.
+    std::vector<ihipEvent_t*>   _freeList;   // Destroyed events.
+};
+
+
 
 
 
@@ -573,8 +899,17 @@ public: // Functions:
     void locked_addStream(ihipStream_t *s);
     void locked_removeStream(ihipStream_t *s);
     void locked_reset();
-    void locked_waitAllStreams();
-    void locked_syncDefaultStream(bool waitOnSelf);
+    hipError_t locked_waitAllStreams();
+    hipError_t locked_syncDefaultStream(bool waitOnSelf);
+    void locked_waitBlockingStreams(ihipStream_t *waiter);
+    void locked_blockingStreamSignals(ihipStream_t *waiter, std::vector<ihipSignalRef_t> &deps);
+    void locked_lastCompletionSignals(std::vector<ihipSignalRef_t> &deps);
+
+    // Algorithm for a copy between unpinned host memory and this device.
+    StagingCopyPlan copyPlan(bool hostToDevice, size_t sizeBytes);
+
+    // Host wait mode selected by the hipDeviceSchedule* flags.
+    SignalWaitMode waitMode() const;
 
     ihipDeviceCritical_t  &criticalData() { return _criticalData; }; // TODO, move private.  Fix P2P.
 
@@ -584,6 +919,7 @@ public: // Data, set at initialization:
     hipDeviceProp_t         _props;        // saved device properties.
     hc::accelerator         _acc;
     hsa_agent_t             _hsa_agent;    // hsa agent handle
+    uint64_t                _timestamp_frequency;  // Hz of the system timestamps recorded by events, 0=unknown.
 
     // The NULL stream is used if no other stream is specified.
     // NULL has special synchronization properties with other streams.
@@ -592,13 +928,23 @@ public: // Data, set at initialization:
 
     unsigned                _compute_units;
 
-    StagingBuffer           *_staging_buffer[2]; // one buffer for each direction.
+    StagingBufferPool       *_staging_pool[2];   // staging buffers for each direction: [0]=H2D, [1]=D2H.
+    HostCopyPool            *_copy_pool;         // helper threads shared by both staging buffers, may be NULL.
+    PinnedRangeCache        *_pin_cache;         // host ranges pinned by HIP_PININPLACE copies, may be NULL.
+    CopyTuner               *_copy_tuner;        // calibrated copy algorithm table for HIP_COPY_TUNE, may be NULL.
+
+    MemoryPool              *_mem_pool;          // caching allocator for hipMallocAsync / hipFreeAsync.
+    DeferredFreeQueue       *_deferred_free;     // hipFree memory waiting for in-flight commands to retire.
 
 
     unsigned                _device_flags;
 
+    ihipSignalPool_t        _signal_pool;  // free signals shared by all streams on this device.
+    ihipQueuePool_t         _queue_pool;   // HSA queues for the streams on this device.
+
 private:
     hipError_t getProperties(hipDeviceProp_t* prop);
+    int getNumaNode();
 
 private:  // Critical data, protected with locked access:
     // Members of _protected data MUST be accessed through the LockedAccessor.
@@ -616,12 +962,15 @@ extern bool g_visible_device; // Set the flag when HIP_VISIBLE_DEVICES is set
 extern unsigned g_deviceCnt;
 extern std::vector<int> g_hip_visible_devices; /* vector of integers that contains the visible device IDs */
 extern hsa_agent_t g_cpu_agent ;   // the CPU agent.
+extern ihipEventPool_t g_eventPool;
+extern AllocIndex g_allocIndex;
 //=================================================================================================
 void ihipInit();
 const char *ihipErrorString(hipError_t);
 ihipDevice_t *ihipGetTlsDefaultDevice();
 ihipDevice_t *ihipGetDevice(int);
 void ihipSetTs(hipEvent_t e);
+void ihipEventUnhold(ihipEvent_t *eh);  // caller must hold eh->_mutex.
 
 template<typename T>
 hc::completion_future ihipMemcpyKernel(hipStream_t, T*, const T*, size_t);
@@ -629,7 +978,11 @@ hc::completion_future ihipMemcpyKernel(hipStream_t, T*, const T*, size_t);
 template<typename T>
 hc::completion_future ihipMemsetKernel(hipStream_t, T*, T, size_t);
 
+hc::completion_future ihipMemset(hipStream_t stream, void* dst, int value, size_t sizeBytes);
+
 hipStream_t ihipSyncAndResolveStream(hipStream_t);
+hipError_t ihipDeviceMalloc(ihipDevice_t *device, void **ptr, size_t sizeBytes);
+bool ihipGetAllocInfo(const void *ptr, AllocInfo *info);
 template <typename T>
 
 hc::completion_future
@@ -47,6 +47,7 @@ THE SOFTWARE.
 #ifdef __HCC__
 #if __cplusplus
 #include <hc.hpp>
+#include <functional>
 #endif
 #include <grid_launch.h>
 extern int HIP_TRACE_API;
@@ -495,6 +496,32 @@ __device__ float __dsqrt_rz(double x);
 #ifdef __HCC_CPP__
 hipStream_t ihipPreLaunchKernel(hipStream_t stream, hc::accelerator_view **av);
 void ihipPostLaunchKernel(hipStream_t stream, hc::completion_future &cf);
+void ihipCaptureKernel(hipStream_t stream, const grid_launch_parm &lp, const std::function<void(grid_launch_parm&)> &kernel);
+
+
+/**
+ * One kernel launch of a hipLaunchKernelBatch.  Set it up with hipKernelLaunchInit.
+ */
+struct hipKernelLaunch_t {
+    grid_launch_parm                        _lp;
+    std::function<void(grid_launch_parm&)>  _kernel;
+};
+
+
+/**
+ * @brief Launch @p count kernels into @p stream with one call.
+ *
+ * @param[in] stream stream for all of the kernels.
+ * @param[in] launches array of launch descriptors, set up with hipKernelLaunchInit.
+ * @param[in] count number of descriptors.
+ * @return #hipSuccess, #hipErrorInvalidValue
+ *
+ * The kernels run in array order, as if launched one by one with hipLaunchKernel.  The stream is locked and its
+ * dependencies resolved once for the whole batch, and only the completion of the last kernel is tracked.
+ * Descriptors capture the kernel arguments by value and may be reused for later batches.
+ * With #hipStreamTrackHazards, ranges from hipStreamAnnotateKernelRange apply to the whole batch.
+ */
+hipError_t hipLaunchKernelBatch(hipStream_t stream, const hipKernelLaunch_t *launches, int count);
 
 // TODO - move to common header file.
 #define KNRM  "\x1B[0m"
@@ -518,8 +545,26 @@ do {\
         fprintf(stderr, KGRN "<<hip-api: hipLaunchKernel '%s' gridDim:(%d,%d,%d) groupDim:(%d,%d,%d) groupMem:+%d stream=%p\n" KNRM, \
                 #_kernelName, lp.gridDim.x, lp.gridDim.y, lp.gridDim.z, lp.groupDim.x, lp.groupDim.y, lp.groupDim.z, lp.groupMemBytes, (void*)(_stream));\
     }\
-  _kernelName (lp, __VA_ARGS__);\
-  ihipPostLaunchKernel(trueStream, cf);\
+  if (__builtin_expect(trueStream != NULL, 1)) {\
+    _kernelName (lp, __VA_ARGS__);\
+    ihipPostLaunchKernel(trueStream, cf);\
+  } else {\
+    /* _stream is capturing - only then wrap the launch in a closure and record it for hipGraphLaunch:*/\
+    ihipCaptureKernel(_stream, lp, [=] (grid_launch_parm &_lp) { _kernelName (_lp, __VA_ARGS__); });\
+  }\
+} while(0)
+
+// Set up hipKernelLaunch_t _desc to launch _kernelName with the same arguments as hipLaunchKernel (minus the stream).
+#define hipKernelLaunchInit(_desc, _kernelName, _numBlocks3D, _blockDim3D, _groupMemBytes, ...) \
+do {\
+  (_desc)._lp.gridDim.x = _numBlocks3D.x; \
+  (_desc)._lp.gridDim.y = _numBlocks3D.y; \
+  (_desc)._lp.gridDim.z = _numBlocks3D.z; \
+  (_desc)._lp.groupDim.x = _blockDim3D.x; \
+  (_desc)._lp.groupDim.y = _blockDim3D.y; \
+  (_desc)._lp.groupDim.z = _blockDim3D.z; \
+  (_desc)._lp.groupMemBytes = _groupMemBytes;\
+  (_desc)._kernel = [=] (grid_launch_parm &_lp) { _kernelName (_lp, __VA_ARGS__); };\
 } while(0)
 
 #else
@@ -542,10 +587,27 @@ do {\
         fprintf(stderr, "==hip-api: launch '%s' gridDim:[%d.%d.%d] groupDim:[%d.%d.%d] groupMem:+%d stream=%p\n", \
                 #_kernelName, lp.gridDim.z, lp.gridDim.y, lp.gridDim.x, lp.groupDim.z, lp.groupDim.y, lp.groupDim.x, lp.groupMemBytes, (void*)(_stream));\
     }\
-  _kernelName (lp, __VA_ARGS__);\
-  ihipPostLaunchKernel(trueStream, cf);\
+  if (__builtin_expect(trueStream != NULL, 1)) {\
+    _kernelName (lp, __VA_ARGS__);\
+    ihipPostLaunchKernel(trueStream, cf);\
+  } else {\
+    /* _stream is capturing - only then wrap the launch in a closure and record it for hipGraphLaunch:*/\
+    ihipCaptureKernel(_stream, lp, [=] (grid_launch_parm &_lp) { _kernelName (_lp, __VA_ARGS__); });\
+  }\
 } while(0)
 /*end hipLaunchKernel */
+
+#define hipKernelLaunchInit(_desc, _kernelName, _numBlocks3D, _blockDim3D, _groupMemBytes, ...) \
+do {\
+  (_desc)._lp.gridDim.x = _numBlocks3D.x * _blockDim3D.x;/*Convert from #blocks to #threads*/ \
+  (_desc)._lp.gridDim.y = _numBlocks3D.y * _blockDim3D.y;/*Convert from #blocks to #threads*/ \
+  (_desc)._lp.gridDim.z = _numBlocks3D.z * _blockDim3D.z;/*Convert from #blocks to #threads*/ \
+  (_desc)._lp.groupDim.x = _blockDim3D.x; \
+  (_desc)._lp.groupDim.y = _blockDim3D.y; \
+  (_desc)._lp.groupDim.z = _blockDim3D.z; \
+  (_desc)._lp.groupMemBytes = _groupMemBytes;\
+  (_desc)._kernel = [=] (grid_launch_parm &_lp) { _kernelName (_lp, __VA_ARGS__); };\
+} while(0)
 #endif
 
 #elif defined (__HCC_C__)
@@ -44,10 +44,14 @@ extern "C" {
 #endif
 
 typedef struct ihipStream_t *hipStream_t;
+typedef struct ihipGraph_t *hipGraph_t;
+typedef struct ihipGraphExec_t *hipGraphExec_t;
 typedef struct hipEvent_t {
     struct ihipEvent_t *_handle;
 } hipEvent_t;
 
+typedef void (*hipStreamCallback_t)(hipStream_t stream, hipError_t status, void *userData);
+
 
 /**
  * @addtogroup GlobalDefs More
@@ -56,13 +60,27 @@ typedef struct hipEvent_t {
 //! Flags that can be used with hipStreamCreateWithFlags
 #define hipStreamDefault            0x00 ///< Default stream creation flags. These are used with hipStreamCreate().
 #define hipStreamNonBlocking        0x01 ///< Stream does not implicitly synchronize with null stream
+#define hipStreamTrackHazards       0x02 ///< HIP extension: async copies only wait for earlier commands in the stream that access overlapping memory.  See #hipStreamAnnotateKernelRange.
+
+//! Stream priorities that can be used with hipStreamCreateWithPriority.  Lower numbers are higher priorities.
+#define hipStreamPriorityHigh       (-1) ///< Stream runs on a high-priority hardware queue, and its copies are served first.
+#define hipStreamPriorityNormal     0    ///< Default priority, used by hipStreamCreate and hipStreamCreateWithFlags.
+#define hipStreamPriorityLow        1    ///< Stream runs on a low-priority hardware queue, for background work.
+
+//! Flags that can be used with hipStreamAnnotateKernelRange
+#define hipKernelRangeRead          0x1  ///< Kernel reads the range.
+#define hipKernelRangeWrite         0x2  ///< Kernel writes the range.
+
+//! Flags that can be used with hipStreamAddCallback
+#define hipStreamCallbackDefault    0x0  ///< Callback runs when the stream reaches it, later commands in the stream do not wait for it.
+#define hipStreamCallbackBlocking   0x1  ///< Later commands in the stream wait until the callback has returned.
 
 
 //! Flags that can be used with hipEventCreateWithFlags:
 #define hipEventDefault             0x0  ///< Default flags
 #define hipEventBlockingSync        0x1  ///< Waiting will yield CPU.  Power-friendly and usage-friendly but may increase latency.
-#define hipEventDisableTiming       0x2  ///< Disable event's capability to record timing information.  May improve performance.
-#define hipEventInterprocess        0x4  ///< Event can support IPC.  @warning - not supported in HIP.
+#define hipEventDisableTiming       0x2  ///< Disable event's capability to record timing information.  Skips the timestamp work, so the event is a lightweight sync point.
+#define hipEventInterprocess        0x4  ///< Event can support IPC.  Must be combined with #hipEventDisableTiming.  @warning - HIP has no IPC handle API, so the event is local to the process.
 
 
 //! Flags that can be used with hipHostMalloc
@@ -78,10 +96,12 @@ typedef struct hipEvent_t {
 #define hipHostRegisterIoMemory     0x4  ///< Not supported.
 
 
-#define hipDeviceScheduleAuto       0x0
-#define hipDeviceScheduleSpin       0x1
-#define hipDeviceScheduleYield      0x2
-#define hipDeviceBlockingSync       0x4
+#define hipDeviceScheduleAuto       0x0  ///< Wait with HIP_WAIT_MODE, by default spin briefly and then block.
+#define hipDeviceScheduleSpin       0x1  ///< Spin while waiting for the device.  Lowest latency, but uses a full core.
+#define hipDeviceScheduleYield      0x2  ///< Poll the device, yielding the CPU between polls.
+#define hipDeviceScheduleBlockingSync 0x4  ///< Block the host thread while waiting for the device.
+#define hipDeviceBlockingSync       hipDeviceScheduleBlockingSync
+#define hipDeviceScheduleMask       0x7
 #define hipDeviceMapHost            0x8
 #define hipDeviceLmemResizeToMax    0x16
 
@@ -322,7 +342,12 @@ hipError_t hipDeviceSetSharedMemConfig ( hipSharedMemConfig config );
 /**
  * @brief Set Device flags
  *
- * Note: Only hipDeviceScheduleAuto and hipDeviceMapHost are supported
+ * The hipDeviceSchedule* flags select how host threads wait for the current device, ie in hipDeviceSynchronize,
+ * hipStreamSynchronize and hipEventSynchronize.  They always replace the previous schedule flags, so passing
+ * none (hipDeviceScheduleAuto) restores the default wait.  Other flags are added.
+ * Events created with #hipEventBlockingSync always block.
+ *
+ * Note: Only the hipDeviceSchedule* flags and hipDeviceMapHost are supported
  *
 */
 hipError_t hipSetDeviceFlags ( unsigned flags);
@@ -400,10 +425,6 @@ const char *hipGetErrorString(hipError_t hip_error);
  *-------------------------------------------------------------------------------------------------
  *  @defgroup Stream Stream Management
  *  @{
- *
- *  The following Stream APIs are not (yet) supported in HIP:
- *  - cudaStreamCreateWithPriority
- *  - cudaStreamGetPriority
  */
 
 /**
@@ -417,13 +438,45 @@ const char *hipGetErrorString(hipError_t hip_error);
  * created stream in subsequent hipStream* commands.  The stream is allocated on the heap and will remain allocated 
  *
  * even if the handle goes out-of-scope.  To release the memory used by the stream, applicaiton must call hipStreamDestroy.
- * Flags controls behavior of the stream.  See #hipStreamDefault, #hipStreamNonBlocking.
+ * Flags controls behavior of the stream.  See #hipStreamDefault, #hipStreamNonBlocking, #hipStreamTrackHazards.
  * @error hipStream_t are under development - with current HIP use the NULL stream.
  */
 
 hipError_t hipStreamCreateWithFlags(hipStream_t *stream, unsigned int flags);
 
 
+/**
+ * @brief Create an asynchronous stream with the specified priority.
+ *
+ * @param[in, out] stream Pointer to new stream
+ * @param[in ] flags to control stream creation, see #hipStreamCreateWithFlags.
+ * @param[in ] priority of the stream.  Lower numbers are higher priorities.
+ * @return #hipSuccess, #hipErrorInvalidValue
+ *
+ * Priorities outside the range returned by #hipDeviceGetStreamPriorityRange are clamped to the range.
+ * Kernels and copies in a high-priority stream run on hardware queues created with a higher HSA queue priority, so
+ * the GPU schedules them ahead of work in lower-priority streams.  Staged host copies from a high-priority stream
+ * are also served before pending copies from lower-priority streams.
+ *
+ * @see hipStreamCreateWithFlags, hipStreamGetPriority, hipDeviceGetStreamPriorityRange
+ */
+hipError_t hipStreamCreateWithPriority(hipStream_t *stream, unsigned int flags, int priority);
+
+
+/**
+ * @brief Return the range of stream priorities supported by the current device.
+ *
+ * @param[out] leastPriority numerically largest (lowest) priority, may be NULL.
+ * @param[out] greatestPriority numerically smallest (highest) priority, may be NULL.
+ * @return #hipSuccess
+ *
+ * Returns #hipStreamPriorityLow and #hipStreamPriorityHigh.  #hipStreamPriorityNormal is the default.
+ *
+ * @see hipStreamCreateWithPriority
+ */
+hipError_t hipDeviceGetStreamPriorityRange(int *leastPriority, int *greatestPriority);
+
+
 
 /**
  * @brief Create an asynchronous stream.
@@ -506,12 +559,151 @@ hipError_t hipStreamDestroy(hipStream_t stream);
 hipError_t hipStreamGetFlags(hipStream_t stream, unsigned int *flags);
 
 
+/**
+ * @brief Return the priority of this stream.
+ *
+ * @param[in] stream
+ * @param[in,out] priority
+ * @return #hipSuccess, #hipErrorInvalidValue, #hipErrorInvalidResourceHandle
+ *
+ * Return the priority of @p stream in *@p priority.  Streams created without a priority have #hipStreamPriorityNormal.
+ *
+ * @see hipStreamCreateWithPriority
+ */
+hipError_t hipStreamGetPriority(hipStream_t stream, int *priority);
+
+
+/**
+ * @brief Declare a memory range accessed by the next kernel launched into @p stream.
+ *
+ * @param[in] stream stream created with #hipStreamTrackHazards.
+ * @param[in] ptr start of the range.
+ * @param[in] sizeBytes size of the range.
+ * @param[in] access #hipKernelRangeRead, #hipKernelRangeWrite, or both.
+ * @return #hipSuccess, #hipErrorInvalidValue
+ *
+ * By default a kernel in a #hipStreamTrackHazards stream waits for every earlier command in the stream, and later
+ * copies wait for the kernel.  Once ranges are declared for a kernel, it only waits for in-flight copies which write
+ * a declared range or read a range the kernel writes, and later copies only wait for it on overlap.
+ * The kernel must not access memory outside of the declared ranges.
+ * Multiple ranges may be declared before the launch.  This is a no-op for streams without #hipStreamTrackHazards.
+ *
+ * @see hipStreamCreateWithFlags
+ */
+hipError_t hipStreamAnnotateKernelRange(hipStream_t stream, const void *ptr, size_t sizeBytes, unsigned int access);
+
+
+/**
+ * @brief Call a host function once all earlier commands in @p stream have completed.
+ *
+ * @param[in] stream stream to add the callback to.
+ * @param[in] callback function to call, with @p stream, the status of the stream and @p userData.
+ * @param[in] userData passed to @p callback.
+ * @param[in] flags #hipStreamCallbackDefault or #hipStreamCallbackBlocking.
+ * @return #hipSuccess, #hipErrorInvalidValue, #hipErrorRuntimeOther
+ *
+ * The host thread does not block.  Callbacks run on a small pool of runtime threads (see HIP_CALLBACK_THREADS), so a
+ * callback must not make HIP calls which wait for @p stream.
+ * With #hipStreamCallbackBlocking, later commands in the stream, stream synchronization and events recorded after
+ * the callback wait until the callback has returned, and callbacks in the stream run one at a time in order.
+ * Otherwise the stream continues as soon as it reaches the callback, and callbacks may run concurrently.
+ * Callbacks can not be added to a capturing stream.
+ *
+ * @see hipStreamSynchronize
+ */
+hipError_t hipStreamAddCallback(hipStream_t stream, hipStreamCallback_t callback, void *userData, unsigned int flags);
+
+
 // end doxygen Stream
 /**
  * @}
  */
 
 
+/**
+ *-------------------------------------------------------------------------------------------------
+ *-------------------------------------------------------------------------------------------------
+ *  @defgroup Graph Stream Capture and Graphs
+ *  @{
+ *
+ *  A sequence of hipLaunchKernel, hipMemcpyAsync and hipMemsetAsync commands can be captured from a stream into a
+ *  graph, instantiated once, and then replayed with hipGraphLaunch at a fraction of the cost of issuing the
+ *  commands one by one.
+ */
+
+/**
+ * @brief Start recording commands sent to @p stream into a new graph.
+ *
+ * @param[in] stream stream to capture.  The NULL stream can not be captured.
+ * @return #hipSuccess, #hipErrorInvalidValue
+ *
+ * Until hipStreamEndCapture, hipLaunchKernel, hipMemcpyAsync and hipMemsetAsync on @p stream are recorded and do not run.
+ * Captured copies must use device memory or pinned host memory.  Arguments are captured by value, so pointed-to
+ * memory is read when the graph is launched.  Other commands must not be sent to @p stream while it is capturing.
+ *
+ * @see hipStreamEndCapture, hipGraphInstantiate
+ */
+hipError_t hipStreamBeginCapture(hipStream_t stream);
+
+
+/**
+ * @brief Stop capturing @p stream and return the recorded graph.
+ *
+ * @param[in] stream stream passed to hipStreamBeginCapture.
+ * @param[out] graph recorded graph.  Release with hipGraphDestroy.
+ * @return #hipSuccess, #hipErrorInvalidValue
+ */
+hipError_t hipStreamEndCapture(hipStream_t stream, hipGraph_t *graph);
+
+
+/**
+ * @brief Create an executable graph.
+ *
+ * @param[out] graphExec executable graph.  Release with hipGraphExecDestroy.
+ * @param[in] graph graph from hipStreamEndCapture.  May be destroyed after this call.
+ * @return #hipSuccess, #hipErrorInvalidValue, #hipErrorInvalidMemcpyDirection
+ *
+ * Copy directions and engines, and the dependencies between nodes, are resolved here rather than on every launch.
+ * Returns #hipErrorInvalidValue if a captured copy uses unpinned host memory.
+ */
+hipError_t hipGraphInstantiate(hipGraphExec_t *graphExec, hipGraph_t graph);
+
+
+/**
+ * @brief Replay an executable graph in @p stream.
+ *
+ * @param[in] graphExec executable graph.
+ * @param[in] stream stream on the same device as the captured stream.  Must not be capturing.
+ * @return #hipSuccess, #hipErrorInvalidValue
+ *
+ * The graph runs after previous commands in @p stream, and later commands run after the graph.
+ * The same @p graphExec may be launched again before previous launches complete, but not from two threads at once.
+ */
+hipError_t hipGraphLaunch(hipGraphExec_t graphExec, hipStream_t stream);
+
+
+/**
+ * @brief Destroy an executable graph.  Launches still in flight must complete first.
+ *
+ * @return #hipSuccess, #hipErrorInvalidValue
+ */
+hipError_t hipGraphExecDestroy(hipGraphExec_t graphExec);
+
+
+/**
+ * @brief Destroy a graph.
+ *
+ * @return #hipSuccess, #hipErrorInvalidValue
+ */
+hipError_t hipGraphDestroy(hipGraph_t graph);
+
+
+// end doxygen Graph
+/**
+ * @}
+ */
+
+
 
 
 /**
@@ -527,9 +719,12 @@ hipError_t hipStreamGetFlags(hipStream_t stream, unsigned int *flags);
  * @param[in,out] event Returns the newly created event.
  * @param[in] flags     Flags to control event behavior.  #hipEventDefault, #hipEventBlockingSync, #hipEventDisableTiming, #hipEventInterprocess
  *
- * @warning On HCC platform, #hipEventInterprocess is not supported.
+ * @warning On HCC platform, #hipEventInterprocess is accepted but the event can not be shared with another process.
+ *
+ * Events with #hipEventDisableTiming do not turn on packet timestamps for the stream and do not read a timestamp
+ * when they complete.  #hipEventElapsedTime returns #hipErrorInvalidResourceHandle for them.
  *
- * @returns #cudaSuccess
+ * @returns #hipSuccess, #hipErrorInvalidValue
  */
 hipError_t hipEventCreateWithFlags(hipEvent_t* event, unsigned flags);
 
@@ -559,6 +754,9 @@ hipError_t hipEventCreate(hipEvent_t* event);
  * the specified stream, after all previous
  * commands in that stream have completed executing.
  *
+ * Events which are recorded in the NULL stream also wait for all previous commands in the blocking streams
+ * (streams created without #hipStreamNonBlocking).  The host does not wait in either case.
+ *
  * If hipEventRecord has been previously called aon event, then this call will overwrite any existing state in event.
  *
  * If this function is called on a an event that is currently being recorded, results are undefined - either
@@ -593,7 +791,8 @@ hipError_t hipEventDestroy(hipEvent_t event);
  *
  *  If hipEventRecord has not been called on @p event, this function returns immediately.
  *
- *  TODO-hcc - This function needs to support hipEventBlockingSync parameter.
+ *  Events created with #hipEventBlockingSync block the host thread while waiting, other events wait as selected by
+ *  hipSetDeviceFlags.
  *
  *  @param[in] event Event on which to wait.
  *  @return #hipSuccess, #hipErrorInvalidResourceHandle,
@@ -613,15 +812,19 @@ hipError_t hipEventSynchronize(hipEvent_t event);
  * Computes the elapsed time between two events. Time is computed in ms, with
  * a resolution of approximately 1 us.
  *
- * Events which are recorded in a NULL stream will block until all commands
- * on all other streams complete execution, and then record the timestamp.
+ * Events which are recorded in a NULL stream record their timestamp once all
+ * earlier commands in the NULL stream and in all blocking streams have completed.
  *
  * Events which are recorded in a non-NULL stream will record their timestamp
  * when they reach the head of the specified stream, after all previous
  * commands in that stream have completed executing.  Thus the time that
  * the event recorded may be significantly after the host calls hipEventRecord.
  *
- * If hipEventRecord has not been called on either event, then #hipErrorInvalidResourceHandle is returned.
+ * An event recorded right after a hipMemcpyAsync that runs on the DMA engine (pinned host or device memory) takes
+ * the end time of the copy itself, so events around such a copy measure the transfer.
+ *
+ * If hipEventRecord has not been called on either event, or either event was created with #hipEventDisableTiming,
+ * then #hipErrorInvalidResourceHandle is returned.
  * If hipEventRecord has been called on both events, but the timestamp has not yet been recorded on one or
  * both events (that is, hipEventQuery would return #hipErrorNotReady on at least one of the events), then
  * #hipErrorNotReady is returned.
@@ -763,7 +966,9 @@ hipError_t hipHostUnregister(void* hostPtr) ;
 
 /**
  *  @brief Free memory allocated by the hcc hip memory allocation API.
- *  This API performs an implicit hipDeviceSynchronize() call.
+ *  The memory is released once all commands enqueued to the device before the call have completed,
+ *  but the host does not wait for them.
+ *  Memory from #hipMallocAsync returns to the pool instead, and is reused once the same commands have completed.
  *
  *  @param[in] ptr Pointer to memory to be freed
  *  @return #hipSuccess, #hipErrorMemoryFree
@@ -772,6 +977,83 @@ hipError_t hipFree(void* ptr);
 
 
 
+/**
+ *  @brief Allocate device memory from the stream-ordered memory pool of the stream's device.
+ *
+ *  Freed blocks are cached by the pool and reused by later allocations, without any device-wide synchronization.
+ *  A block freed with #hipFreeAsync can be reused immediately by the same stream, and by other streams
+ *  once the commands enqueued in the freeing stream before the free have completed.
+ *
+ *  The returned memory is accessible to commands enqueued to @p stream after the allocation.  Other streams must
+ *  synchronize with @p stream (for example with an event) before using it.
+ *
+ *  @param[out] ptr Pointer to the allocated memory
+ *  @param[in]  size Requested memory size
+ *  @param[in]  stream Stream which orders the allocation.  NULL uses the default stream.
+ *  @return #hipSuccess, #hipErrorMemoryAllocation, #hipErrorInvalidValue
+ */
+hipError_t hipMallocAsync(void** ptr, size_t size, hipStream_t stream);
+
+
+/**
+ *  @brief Free memory allocated with #hipMallocAsync, ordered after all commands previously enqueued to @p stream.
+ *
+ *  This call does not block the host.  The memory returns to the pool cache and is released to the device
+ *  only when the cache exceeds the release threshold, or when trimmed with #hipDeviceMemPoolTrimTo.
+ *
+ *  @param[in] ptr Pointer to memory to be freed
+ *  @param[in] stream Stream which orders the free
+ *  @return #hipSuccess, #hipErrorInvalidDevicePointer
+ */
+hipError_t hipFreeAsync(void* ptr, hipStream_t stream);
+
+
+/**
+ *  @brief Release unused cached memory in the current device's memory pool back to the device.
+ *
+ *  Only blocks whose freeing commands have completed are released.
+ *
+ *  @param[in] minBytesToKeep Stop releasing once the pool caches this many bytes or less.
+ *  @return #hipSuccess, #hipErrorInvalidDevice
+ */
+hipError_t hipDeviceMemPoolTrimTo(size_t minBytesToKeep);
+
+
+/**
+ *  @brief Set the number of bytes of freed memory the current device's memory pool may cache.
+ *
+ *  Default is set by HIP_MEMPOOL_RELEASE_THRESHOLD (unlimited if not set).
+ *
+ *  @param[in] releaseThreshold Max bytes cached.  Cached memory above the threshold is released once it is idle.
+ *  @return #hipSuccess, #hipErrorInvalidDevice
+ */
+hipError_t hipDeviceMemPoolSetReleaseThreshold(size_t releaseThreshold);
+
+
+/**
+ *  @brief Query memory usage of the current device's memory pool.
+ *
+ *  Any of the output pointers may be NULL.
+ *
+ *  @param[out] reservedBytes Bytes allocated from the device by the pool (in use + cached)
+ *  @param[out] usedBytes Bytes currently allocated by the application
+ *  @param[out] reservedHighWater High-water mark of reservedBytes
+ *  @param[out] usedHighWater High-water mark of usedBytes
+ *  @return #hipSuccess, #hipErrorInvalidDevice
+ *
+ *  @see hipDeviceMemPoolResetHighWater
+ */
+hipError_t hipDeviceMemPoolGetUsage(size_t *reservedBytes, size_t *usedBytes, size_t *reservedHighWater, size_t *usedHighWater);
+
+
+/**
+ *  @brief Reset the high-water marks of the current device's memory pool to the current usage.
+ *
+ *  @return #hipSuccess, #hipErrorInvalidDevice
+ */
+hipError_t hipDeviceMemPoolResetHighWater();
+
+
 /**
  *  @brief Free memory allocated by the hcc hip host memory allocation API
  *
@@ -827,7 +1109,9 @@ hipError_t hipMemcpyToSymbol(const char* symbolName, const void *src, size_t siz
 /**
  *  @brief Copy data from src to dst asynchronously.
  *
- *  @warning If host or dest are not pinned, the memory copy will be performed synchronously.  For best performance, use hipHostMalloc to
+ *  @warning If host memory is not pinned, the copy is staged through pinned buffers by a runtime worker thread.  The call
+ *  returns immediately, so the host memory must not be modified or freed until the copy completes (ie hipStreamSynchronize).
+ *  Set HIP_STAGING_ASYNC=0 to perform these copies synchronously.  For best performance, use hipHostMalloc to
  *  allocate host memory that is transferred asynchronously.
  *
  *  @param[out] dst Data being copy to
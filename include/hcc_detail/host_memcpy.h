@@ -0,0 +1,55 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANNTY OF ANY KIND, EXPRESS OR
+IMPLIED, INNCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANNY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER INN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR INN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+//#pragma once
+#ifndef HOST_MEMCPY_H
+#define HOST_MEMCPY_H
+
+#include <cstddef>
+
+//-------------------------------------------------------------------------------------------------
+// Host memcpy with non-temporal (streaming) stores.
+// Used for copies whose destination the CPU will not read again - pinned staging buffers and
+// write-combined host memory.  Streaming stores bypass the cache, so the copy does not evict the
+// application's working set from the LLC, and write-combined memory is written in full lines.
+//
+// The implementation is selected with CPUID when HostMemcpyInit is called.  Until then the copy uses libc memcpy.
+// This file has no HSA or HIP dependencies so it can be built into the standalone host benchmark.
+
+enum HostMemcpyIsa {
+    HostMemcpyIsaLibc   = 0,  // plain memcpy
+    HostMemcpyIsaSse2   = 1,
+    HostMemcpyIsaAvx2   = 2,
+    HostMemcpyIsaAvx512 = 3,
+};
+
+typedef void (*HostMemcpyFn)(void* dst, const void* src, size_t sizeBytes);
+
+// Select the best implementation supported by this CPU, up to maxIsa.  Returns the selected ISA.
+HostMemcpyIsa HostMemcpyInit(int maxIsa);
+
+// Copy with streaming stores.  Includes a store fence so the data is visible to other agents on return.
+void HostMemcpyNonTemporal(void* dst, const void* src, size_t sizeBytes);
+
+// Return the implementation for the specified ISA, or NULL if not supported by this CPU.
+HostMemcpyFn HostMemcpyGetImpl(HostMemcpyIsa isa);
+
+const char* HostMemcpyIsaName(HostMemcpyIsa isa);
+
+#endif
@@ -0,0 +1,161 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANNTY OF ANY KIND, EXPRESS OR
+IMPLIED, INNCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANNY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER INN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR INN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+//#pragma once
+#ifndef MEMORY_POOL_H
+#define MEMORY_POOL_H
+
+#include <map>
+#include <list>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "hsa.h"
+#include "hip/hip_runtime_api.h"
+#include "hip/hcc_detail/hip_hcc.h"
+
+
+//-------------------------------------------------------------------------------------------------
+// Stream-ordered caching allocator for device memory, used to implement hipMallocAsync and hipFreeAsync.
+// Requests are rounded up to a size class (four classes per power-of-two, so at most 25% waste) and freed
+// blocks are kept in a cache instead of being returned to the runtime with am_free.
+//
+// A freed block remembers the stream it was freed on and the completion of the last command in that stream at
+// the time of the free:
+//   - The same stream can reuse the block immediately, since later commands are ordered after the free.
+//   - Other streams can reuse the block once the command completes.  The stream recycles its signals, so the
+//     block keeps a generation-checked reference, and a signal which has been reused counts as completed.
+// So neither allocation nor free requires a device-wide wait.
+//
+// Blocks are allocated with am_alloc and registered in the am_memtracker, so they behave exactly like hipMalloc
+// memory for copies and pointer queries.
+// The release threshold bounds the bytes held in the cache.  Blocks above the threshold are returned to the device
+// once their completion signals retire.
+//
+// MemoryPool provides thread-safe access via a mutex.  The mutex is never held across am_alloc / am_free, and
+// the device lock must not be acquired while holding it.
+struct MemoryPool {
+
+    MemoryPool(ihipDevice_t *device, size_t releaseThreshold);
+    ~MemoryPool();
+
+    hipError_t  locked_alloc(void **ptr, size_t sizeBytes, ihipStream_t *stream);
+
+    // Returns false if ptr was not allocated from this pool.
+    // stream may be NULL, which means all commands which may access the block have already completed.
+    bool        locked_free(void *ptr, ihipStream_t *stream);
+
+    // True if ptr is a live block of this pool.
+    bool        locked_isLive(void *ptr);
+
+    // Release cached blocks which are no longer in use until the cache holds at most minBytesToKeep.
+    void        locked_trimTo(size_t minBytesToKeep);
+    void        locked_setReleaseThreshold(size_t releaseThreshold);
+
+    void        locked_getUsage(size_t *reservedBytes, size_t *usedBytes, size_t *reservedHighWater, size_t *usedHighWater);
+    void        locked_resetHighWater();
+
+    // Forget all blocks.  Called from device reset, where am_memtracker_reset releases the memory.
+    void        locked_reset();
+
+private:
+    struct Block {
+        void           *_ptr;
+        size_t          _size;        // rounded size class.
+        ihipStream_t   *_stream;      // stream which last freed the block, NULL if not associated with any stream.
+        ihipSignalRef_t _ready;       // block is reusable by other streams once this completes.  Empty if ready.
+    };
+
+    static size_t   roundSize(size_t sizeBytes);
+    static bool     isReady(const Block &block);
+    void            collectCached(size_t maxCachedBytes, std::vector<void*> &toFree);
+    void            freeBlocks(const std::vector<void*> &toFree);
+
+private:
+    ihipDevice_t                        *_device;
+
+    std::mutex                          _mutex;
+    std::map<size_t, std::list<Block>>  _cached;    // freed blocks, keyed by size class.  Oldest free at front.
+    std::unordered_map<void*, Block>    _live;      // blocks currently allocated by the application.
+
+    size_t                              _releaseThreshold;
+    size_t                              _reservedBytes;      // bytes allocated from the device (live + cached).
+    size_t                              _usedBytes;          // bytes in live blocks.
+    size_t                              _reservedHighWater;
+    size_t                              _usedHighWater;
+};
+
+
+//-------------------------------------------------------------------------------------------------
+// Deferred hipFree.
+// Instead of draining every stream on the device, hipFree records the completion of the last command in each
+// stream and queues the pointer here.  Memory is released once all of the recorded commands complete - any
+// command which could still access the memory was enqueued before the free and so is covered by one of them.
+// The references are generation-checked, so a stream signal which has been reused counts as completed.
+//
+// A background thread, started by the first hipFree, waits for the oldest entry and releases entries as they retire.
+// Callers which need the memory back immediately (ie an allocation failed) can call locked_reclaim(true) to wait for
+// all pending frees.
+//
+// DeferredFreeQueue provides thread-safe access via a mutex.  Memory is released outside the mutex, but
+// locked_reclaim(true) also waits for releases in progress on other threads.
+struct DeferredFreeQueue {
+
+    DeferredFreeQueue(ihipDevice_t *device);
+    ~DeferredFreeQueue();
+
+    // Returns false if ptr is already waiting to be released.
+    bool        locked_enqueue(void *ptr, const std::vector<ihipSignalRef_t> &deps);
+
+    // Release all entries whose signals have retired.  If wait, block until every pending entry is released.
+    void        locked_reclaim(bool wait);
+
+    size_t      locked_pendingCount();
+
+private:
+    struct Entry {
+        void                        *_ptr;
+        std::vector<ihipSignalRef_t> _deps;     // live commands, completed ones are removed as they are observed.
+    };
+
+    static bool isRetired(Entry &entry);
+    static void waitDep(const ihipSignalRef_t &dep, uint64_t timeoutHint);
+    void        reclaim(std::unique_lock<std::mutex> &lock, bool wait);
+    void        release(void *ptr);
+    void        reclaimThread();
+
+private:
+    ihipDevice_t                *_device;
+
+    std::mutex                  _mutex;
+    std::condition_variable     _cv;
+    std::condition_variable     _releasedCv;    // signaled when _releasing drops to 0.
+    std::deque<Entry>           _pending;       // oldest free at front.
+    std::unordered_set<void*>   _pendingPtrs;   // used to reject double-free of a pending pointer.
+    size_t                      _releasing;     // entries taken off _pending whose memory is still being released.
+    bool                        _stop;
+    std::thread                 _thread;        // not started until the first entry is queued.
+};
+
+#endif
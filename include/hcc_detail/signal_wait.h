@@ -0,0 +1,50 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANNTY OF ANY KIND, EXPRESS OR
+IMPLIED, INNCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANNY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER INN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR INN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+//#pragma once
+#ifndef SIGNAL_WAIT_H
+#define SIGNAL_WAIT_H
+
+#include "hsa.h"
+
+//-------------------------------------------------------------------------------------------------
+// Host waits for HSA signals.
+// Spinning gives the lowest wake-up latency but burns a core for the whole wait, which adds up when many host
+// threads wait on long-running work.  Blocking sleeps in the HSA runtime until the signal changes, at the cost of
+// an interrupt and a context switch on wake-up.  Hybrid spins briefly so short waits keep the low latency, then blocks.
+//
+// The default mode and the hybrid spin time are set with SignalWaitInit.  Until then the default is hybrid.
+
+enum SignalWaitMode {
+    SignalWaitDefault = -1,  // the mode set with SignalWaitInit.
+    SignalWaitHybrid  = 0,   // spin for the spin time, then block.
+    SignalWaitSpin    = 1,   // poll the signal.
+    SignalWaitYield   = 2,   // poll the signal, yielding the CPU between polls.
+    SignalWaitBlocked = 3,   // sleep until the signal changes.
+};
+
+// Set the mode used for SignalWaitDefault and the spin time (in microseconds) of hybrid waits.
+void SignalWaitInit(SignalWaitMode defaultMode, unsigned spinUs);
+
+// Wait until signal is less than 1, ie the command it tracks has completed.
+void SignalWait(hsa_signal_t signal, SignalWaitMode mode);
+
+const char* SignalWaitModeName(SignalWaitMode mode);
+
+#endif
@@ -21,9 +21,120 @@ THE SOFTWARE.
 #ifndef STAGING_BUFFER_H
 #define STAGING_BUFFER_H
 
+#include <atomic>
+#include <deque>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
 #include "hsa.h"
 
 
+//-------------------------------------------------------------------------------------------------
+// Pool of host threads used to split a large memcpy across several cores.
+// A single core cannot saturate host memory bandwidth, so the staging buffers use this pool to pack and
+// unpack chunks of large transfers.  Threads may be bound to the CPUs of the NUMA node closest to the GPU.
+// The calling thread copies one slice itself, and Memcpy returns when all slices are done.
+//
+// One Memcpy uses the helper threads at a time - a concurrent caller copies on its own thread instead.
+struct HostCopyPool {
+
+    // numThreads = number of helper threads, in addition to the caller.
+    // numaNode = node to bind the helper threads to, or -1 for no binding.
+    HostCopyPool(int numThreads, int numaNode);
+    ~HostCopyPool();
+
+    // nonTemporal = use HostMemcpyNonTemporal for each slice.
+    void Memcpy(void* dst, const void* src, size_t sizeBytes, bool nonTemporal);
+
+private:
+    void Worker(int threadIndex);
+    void CopySlice(int sliceIndex);
+
+private:
+    static const size_t  _min_slice = 16*1024;  // don't split into slices smaller than this.
+
+    std::vector<std::thread>    _threads;
+
+    std::mutex                  _memcpy_lock;   // one Memcpy at a time.
+
+    // Current job, protected by _job_lock:
+    std::mutex                  _job_lock;
+    std::condition_variable     _work_cv;
+    std::condition_variable     _done_cv;
+    char                       *_dst;
+    const char                 *_src;
+    size_t                      _sizeBytes;
+    size_t                      _sliceBytes;
+    bool                        _nonTemporal;
+    int                         _numSlices;
+    uint64_t                    _generation;    // incremented for each job.
+    int                         _pending;       // helper slices not yet done.
+    bool                        _stop;
+};
+
+
+//-------------------------------------------------------------------------------------------------
+// Host ranges pinned with hsa_amd_memory_lock by in-flight pin-in-place copies.
+// Ranges are pinned on page boundaries.  Acquire returns an agent-accessible pointer for the host
+// range, sharing a pinned range that covers it with the copies already using it, and Release drops the
+// reference.  The range is unpinned when the last copy using it releases it.
+//
+// Ranges are not kept pinned between copies: nothing tells the runtime when the app frees host memory, and
+// a range pinned across a free and a reuse of the VA would still map the old pages.
+//
+// Thread-safe - shared by both staging buffers on a device.
+struct PinnedRangeCache {
+
+    // maxPinnedBytes = limit on host bytes pinned at once.
+    PinnedRangeCache(hsa_agent_t hsaAgent, size_t maxPinnedBytes);
+    ~PinnedRangeCache();
+
+    // Returns NULL if the range can't be pinned within the limit - caller should use a staged copy instead.
+    void* Acquire(const void* hostPtr, size_t sizeBytes);
+    void  Release(const void* hostPtr);
+
+private:
+    struct Range {
+        uintptr_t       _end;
+        char           *_agentPtr;  // agent-accessible address for the start of the range.
+        int             _refCount;
+    };
+    typedef std::map<uintptr_t, Range> RangeMap;  // key is page-aligned start of range.
+
+    RangeMap::iterator findContaining(uintptr_t start, uintptr_t end);
+    void unpin(RangeMap::iterator iter);
+
+private:
+    hsa_agent_t             _hsa_agent;
+    size_t                  _maxPinnedBytes;
+    size_t                  _pageSize;
+
+    std::mutex              _lock;
+    RangeMap                _ranges;
+    size_t                  _pinnedBytes;
+};
+
+
+//-------------------------------------------------------------------------------------------------
+// Algorithm for a copy between unpinned host memory and the device.
+enum StagingCopyAlgorithm {
+    StagingCopyStaged       = 0,  // CPU copy through the pinned staging buffers, overlapped with DMA.
+    StagingCopyPinInPlace   = 1,  // pin the host memory and DMA directly.
+    StagingCopyDirect       = 2,  // hc::am_copy, does not use the StagingBuffer.
+};
+
+struct StagingCopyPlan {
+    StagingCopyAlgorithm    _algorithm;
+    size_t                  _chunkBytes;  // chunk size for StagingCopyStaged, 0=size of staging buffer.
+
+    StagingCopyPlan(StagingCopyAlgorithm algorithm=StagingCopyStaged, size_t chunkBytes=0) :
+        _algorithm(algorithm), _chunkBytes(chunkBytes) {};
+};
+
+
 //-------------------------------------------------------------------------------------------------
 // An optimized "staging buffer" used to implement Host-To-Device and Device-To-Host copies.
 // Some GPUs may not be able to directly access host memory, and in these cases we need to 
@@ -33,32 +144,143 @@ THE SOFTWARE.
 // to limit the size of the buffer and also to provide better performance by overlapping the CPU copies 
 // with the DMA copies.
 //
-// PinInPlace is another algorithm which pins the host memory "in-place", and copies it with the DMA
-// engine.  This routine is under development.
+// PinInPlace is another algorithm which pins the host memory "in-place" with the PinnedRangeCache, and
+// copies it with a single DMA.  If the range can't be pinned, PinInPlace falls back to the staged copy.
+//
+// Transfers of at least copyPoolThreshold bytes use the optional HostCopyPool for the host-side memcpy.
+//
+// EnqueueCopy hands the staged copy to a worker thread owned by the buffer, so the caller does not wait
+// for the copy.  The worker runs the copies in the order they were enqueued and sets the caller's
+// completion signal to 0 when each copy is done.  High-priority copies whose dependency has already completed
+// are queued ahead of the pending normal-priority copies, behind the last high-priority copy so copies from one
+// stream keep their order.
+// A failed copy still sets its completion signal, and stores its error code in the caller's error flag.
 //
 // Staging buffer provides thread-safe access via a mutex.
 struct StagingBuffer {
 
-    static const int _max_buffers = 4;
+    static const int _max_buffers = 32;
 
-    StagingBuffer(hsa_agent_t hsaAgent, hsa_region_t systemRegion, size_t bufferSize, int numBuffers) ;
+    // d2hRing=false drains every staging buffer before refilling any in CopyDeviceToHost, the pipeline before the ring.
+    // Kept to measure the ring against.
+    StagingBuffer(hsa_agent_t hsaAgent, hsa_agent_t cpuAgent, hsa_region_t systemRegion, size_t bufferSize, int numBuffers,
+                  HostCopyPool *copyPool=NULL, size_t copyPoolThreshold=0, PinnedRangeCache *pinCache=NULL, bool d2hRing=true) ;
     ~StagingBuffer();
 
-    void CopyHostToDevice(void* dst, const void* src, size_t sizeBytes, hsa_signal_t *waitFor);
+    // chunkBytes = size of each staged chunk, up to the buffer size.  0=buffer size.
+    void CopyHostToDevice(void* dst, const void* src, size_t sizeBytes, hsa_signal_t *waitFor, size_t chunkBytes=0);
     void CopyHostToDevicePinInPlace(void* dst, const void* src, size_t sizeBytes, hsa_signal_t *waitFor);
 
-    void CopyDeviceToHost   (void* dst, const void* src, size_t sizeBytes, hsa_signal_t *waitFor);
+    void CopyDeviceToHost   (void* dst, const void* src, size_t sizeBytes, hsa_signal_t *waitFor, size_t chunkBytes=0);
     void CopyDeviceToHostPinInPlace(void* dst, const void* src, size_t sizeBytes, hsa_signal_t *waitFor);
 
+    // Run one of the above, selected by plan.
+    void Copy(bool hostToDevice, void* dst, const void* src, size_t sizeBytes, hsa_signal_t *waitFor, const StagingCopyPlan &plan);
+
+    // Asynchronous version of Copy.
+    // waitFor may have a 0 handle indicating no dependency.  completion must be set to 1 by the caller.
+    // error is set to the error code if the copy fails, may be NULL.
+    void EnqueueCopy(bool hostToDevice, void* dst, const void* src, size_t sizeBytes, hsa_signal_t waitFor, hsa_signal_t completion,
+                     const StagingCopyPlan &plan, bool highPriority=false, std::atomic<int> *error=NULL);
+
+    size_t BufferSize() const { return _bufferSize; };
+
+private:
+    struct CopyJob {
+        bool            _hostToDevice;
+        StagingCopyPlan _plan;
+        void           *_dst;
+        const void     *_src;
+        size_t          _sizeBytes;
+        hsa_signal_t    _waitFor;
+        hsa_signal_t    _completion;
+        bool            _highPriority;
+        std::atomic<int> *_error;       // may be NULL.
+    };
+
+    void CopyWorker();
+
+    void StagingMemcpy(void* dst, const void* src, size_t sizeBytes, bool useCopyPool, bool nonTemporal);
+
 
 private:
     hsa_agent_t     _hsa_agent;
+    hsa_agent_t     _cpu_agent;   // host side of each DMA, so H2D and D2H run on separate per-direction engines.
     size_t          _bufferSize;  // Size of the buffers.
     int             _numBuffers;
 
+    HostCopyPool    *_copyPool;             // may be NULL.  Not owned.
+    size_t           _copyPoolThreshold;
+
+    PinnedRangeCache *_pinCache;            // may be NULL.  Not owned.
+    bool             _d2hRing;
+
     char            *_pinnedStagingBuffer[_max_buffers];
     hsa_signal_t     _completion_signal[_max_buffers];
     std::mutex       _copy_lock;    // provide thread-safe access 
+
+    // Queue of async copies for the worker thread, protected by _job_lock:
+    std::mutex              _job_lock;
+    std::condition_variable _job_cv;
+    std::deque<CopyJob>     _jobs;
+    bool                    _stop_worker;
+    std::thread             _worker;       // started on first EnqueueCopy.
+};
+
+
+//-------------------------------------------------------------------------------------------------
+// Pool of StagingBuffers for one copy direction, so independent streams and threads can stage copies
+// concurrently instead of serializing on a single buffer's mutex.
+//
+// Synchronous copies lease an idle buffer with Acquire and return it with Release.  Buffers are created on
+// demand up to maxBuffers - once all are leased, Acquire waits for one to be released.  Released buffers go
+// to waiting high-priority callers before normal-priority ones.
+//
+// Asynchronous copies use StreamBuffer, which always returns the same buffer for a stream so the copies
+// of one stream run in order on that buffer's worker thread.  Streams share the maxBuffers workers (stream id
+// modulo maxBuffers), and each worker runs its queue in order: a copy waiting for its dependency also holds
+// up the copies queued behind it from other streams on the same buffer.  Raise HIP_STAGING_POOL to spread
+// streams over more workers.
+//
+// Worker buffers are never leased by Acquire: a synchronous copy can depend on a queued async copy, and would
+// deadlock holding the buffer lock the worker needs to run it.  So the pinned memory is bounded by
+// 2 * maxBuffers * numBuffers * bufferSize per direction.
+//
+// StagingBufferPool provides thread-safe access via a mutex.
+struct StagingBufferPool {
+
+    StagingBufferPool(hsa_agent_t hsaAgent, hsa_agent_t cpuAgent, hsa_region_t systemRegion, size_t bufferSize, int numBuffers, int maxBuffers,
+                      HostCopyPool *copyPool=NULL, size_t copyPoolThreshold=0, PinnedRangeCache *pinCache=NULL, bool d2hRing=true);
+    ~StagingBufferPool();
+
+    StagingBuffer* Acquire(bool highPriority=false);
+    void           Release(StagingBuffer* buffer);
+
+    StagingBuffer* StreamBuffer(uint64_t streamId);
+
+    size_t BufferSize() const { return _bufferSize; };
+
+private:
+    StagingBuffer* newBuffer();  // caller must hold _lock.
+
+private:
+    hsa_agent_t             _hsa_agent;
+    hsa_agent_t             _cpu_agent;
+    hsa_region_t            _systemRegion;
+    size_t                  _bufferSize;
+    int                     _numBuffers;
+    int                     _maxBuffers;
+    HostCopyPool           *_copyPool;
+    size_t                  _copyPoolThreshold;
+    PinnedRangeCache       *_pinCache;
+    bool                    _d2hRing;
+
+    std::mutex                  _lock;
+    std::condition_variable     _released_cv;
+    int                         _highWaiters;  // high-priority callers waiting in Acquire.
+    std::vector<StagingBuffer*> _buffers;        // buffers for Acquire, in creation order.
+    std::vector<StagingBuffer*> _idle;           // buffers not leased by Acquire.
+    std::vector<StagingBuffer*> _streamBuffers;  // worker buffers for StreamBuffer, index is stream id % maxBuffers.
 };
 
 #endif
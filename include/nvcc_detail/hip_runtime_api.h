@@ -378,6 +378,24 @@ inline static hipError_t hipStreamCreateWithFlags(hipStream_t *stream, unsigned
 }
 
 
+inline static hipError_t hipStreamCreateWithPriority(hipStream_t *stream, unsigned int flags, int priority)
+{
+    return hipCUDAErrorTohipError(cudaStreamCreateWithPriority(stream, flags, priority));
+}
+
+
+inline static hipError_t hipStreamGetPriority(hipStream_t stream, int *priority)
+{
+    return hipCUDAErrorTohipError(cudaStreamGetPriority(stream, priority));
+}
+
+
+inline static hipError_t hipDeviceGetStreamPriorityRange(int *leastPriority, int *greatestPriority)
+{
+    return hipCUDAErrorTohipError(cudaDeviceGetStreamPriorityRange(leastPriority, greatestPriority));
+}
+
+
 inline static hipError_t hipStreamCreate(hipStream_t *stream)
 {
     return hipCUDAErrorTohipError(cudaStreamCreate(stream));
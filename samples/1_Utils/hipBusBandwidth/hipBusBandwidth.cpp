@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
@@ -20,6 +22,7 @@ int           p_onesize = 0;
 bool          p_h2d   = true;
 bool          p_d2h   = true;
 bool          p_bidir = true;
+bool          p_d2hcompare = false;
 
 
 
@@ -494,6 +497,21 @@ void RunBenchmark_Bidir(ResultDatabase &resultDB)
             const int thisSize = p_onesize ? p_onesize : sizes[sizeIndex];
             const int nbytes = sizeToBytes(thisSize);
 
+            // Time each direction alone first, so the overlapped run can be compared against the serial sum:
+            float tH2D = 0;
+            hipEventRecord(start, 0);
+            hipMemcpyAsync(deviceMem[0], hostMem[0],   nbytes, hipMemcpyHostToDevice, stream[0]);
+            hipEventRecord(stop, 0);
+            hipEventSynchronize(stop);
+            hipEventElapsedTime(&tH2D, start, stop);
+
+            float tD2H = 0;
+            hipEventRecord(start, 0);
+            hipMemcpyAsync(hostMem[1],   deviceMem[1], nbytes, hipMemcpyDeviceToHost, stream[1]);
+            hipEventRecord(stop, 0);
+            hipEventSynchronize(stop);
+            hipEventElapsedTime(&tD2H, start, stop);
+
             hipEventRecord(start, 0);
             hipMemcpyAsync(deviceMem[0], hostMem[0],   nbytes, hipMemcpyHostToDevice, stream[0]);
             hipMemcpyAsync(hostMem[1],   deviceMem[1], nbytes, hipMemcpyDeviceToHost, stream[1]);
@@ -506,14 +524,19 @@ void RunBenchmark_Bidir(ResultDatabase &resultDB)
             if (p_verbose)
             {
                 std::cerr << "size " << sizeToString(thisSize) << " took " << t <<
-                        " ms\n";
+                        " ms (h2d alone " << tH2D << " ms, d2h alone " << tD2H << " ms)\n";
             }
 
             double speed = (double(sizeToBytes(thisSize)) / (1000*1000)) / t;
+            // Both directions move nbytes, a full-duplex link approaches 2x the one-way bandwidth:
+            double aggregateSpeed = (2.0 * double(sizeToBytes(thisSize)) / (1000*1000)) / t;
+            double speedup = (tH2D + tD2H) / t;
             char sizeStr[256];
             sprintf(sizeStr, "%9s", sizeToString(thisSize).c_str());
             resultDB.AddResult(std::string("Bidir_Bandwidth") + (p_pinned ? "_Pinned" : "_Unpinned"), sizeStr, "GB/sec", speed);
             resultDB.AddResult(std::string("Bidir_Time") + (p_pinned ? "_Pinned" : "_Unpinned"), sizeStr, "ms", t);
+            resultDB.AddResult(std::string("Bidir_Aggregate_Bandwidth") + (p_pinned ? "_Pinned" : "_Unpinned"), sizeStr, "GB/sec", aggregateSpeed);
+            resultDB.AddResult(std::string("Bidir_Speedup") + (p_pinned ? "_Pinned" : "_Unpinned"), sizeStr, "x", speedup);
         }
     }
 
@@ -553,11 +576,22 @@ int parseInt(const char *str, int *output)
 }
 
 
+void printStagingConfig() {
+    // Unpinned copies are staged through the runtime's pinned buffers, record the config so runs can be compared:
+    const char *stagingBuffers = getenv("HIP_STAGING_BUFFERS");
+    const char *stagingSize    = getenv("HIP_STAGING_SIZE");
+    printf ("Staging: HIP_STAGING_BUFFERS=%s HIP_STAGING_SIZE=%s\n", stagingBuffers ? stagingBuffers : "default", stagingSize ? stagingSize : "default");
+}
+
 void printConfig() {
     hipDeviceProp_t props;
     hipGetDeviceProperties(&props, p_device);
 
     printf ("Device:%s Mem=%.1fGB #CUs=%d Freq=%.0fMhz  Pinned=%s\n", props.name, props.totalGlobalMem/1024.0/1024.0/1024.0, props.multiProcessorCount, props.clockRate/1000.0, p_pinned ? "YES" : "NO");
+
+    if (!p_pinned) {
+        printStagingConfig();
+    }
 }
 
 void help() {
@@ -565,7 +599,9 @@ void help() {
     printf ("  --iterations, -i         : Number of copy iterations to run.\n");
     printf ("  --beatsperiterations, -b : Number of beats (back-to-back copies of same size) per iteration to run.\n");
     printf ("  --device, -d             : Device ID to use (0..numDevices).\n");
-    printf ("  --unpinned               : Use unpinned host memory.\n");
+    printf ("  --unpinned               : Use unpinned host memory.  Use with --d2h to measure the pageable D2H staging pipeline.\n");
+    printf ("  --d2hcompare             : Run the unpinned device-to-host test with the batch (HIP_STAGING_D2H_RING=0) and ring\n");
+    printf ("                             staging pipelines, and report both.\n");
     printf ("  --d2h                    : Run only device-to-host test.\n");
     printf ("  --h2d                    : Run only host-to-device test.\n");
     printf ("  --bidir                  : Run only bidir copy test.\n");
@@ -612,6 +648,13 @@ int parseStandardArguments(int argc, char *argv[])
             p_d2h   = true;
             p_bidir = false;
 
+        } else if (!strcmp(arg, "--d2hcompare")) {
+            p_pinned = false;
+            p_h2d   = false;
+            p_d2h   = false;
+            p_bidir = false;
+            p_d2hcompare = true;
+
         } else if (!strcmp(arg, "--bidir")) {
             p_h2d   = false;
             p_d2h   = false;
@@ -637,11 +680,114 @@ int parseStandardArguments(int argc, char *argv[])
 };
 
 
+// ****************************************************************************
+// Run the unpinned D2H test with HIP_STAGING_D2H_RING=ring and add its bandwidth results to resultDB, under
+// D2H_Bandwidth_Unpinned_Ring or _Batch.
+// HIP reads its environment once at init, so each pipeline runs in a child process forked before this process
+// makes any HIP call.  The child sends its results back through a pipe, one line per size: "<atts>|<GB/s> <GB/s>..."
+bool RunBenchmark_D2HPipeline(ResultDatabase &resultDB, bool ring)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return false;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        return false;
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+        setenv("HIP_STAGING_D2H_RING", ring ? "1" : "0", 1);
+
+        ResultDatabase childDB;
+        RunBenchmark_D2H(childDB);
+
+        FILE *f = fdopen(fds[1], "w");
+        const std::vector<ResultDatabase::Result> &results = childDB.GetResults();
+        for (int i=0; i<results.size(); i++) {
+            if (results[i].test == "D2H_Bandwidth_Unpinned") {
+                fprintf (f, "%s|", results[i].atts.c_str());
+                for (int j=0; j<results[i].value.size(); j++) {
+                    fprintf (f, " %.17g", results[i].value[j]);
+                }
+                fprintf (f, "\n");
+            }
+        }
+        fclose(f);
+        exit(EXIT_SUCCESS);
+    }
+
+    close(fds[1]);
+    FILE *f = fdopen(fds[0], "r");
+    char line[4096];
+    while (fgets(line, sizeof(line), f)) {
+        char *sep = strchr(line, '|');
+        if (!sep) {
+            continue;
+        }
+        *sep = 0;
+
+        std::vector<double> values;
+        char *p = sep + 1;
+        char *next;
+        for (double v = strtod(p, &next); next != p; v = strtod(p, &next)) {
+            values.push_back(v);
+            p = next;
+        }
+        resultDB.AddResults(std::string("D2H_Bandwidth_Unpinned") + (ring ? "_Ring" : "_Batch"), line, "GB/sec", values);
+    }
+    fclose(f);
+
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && (WEXITSTATUS(status) == EXIT_SUCCESS);
+}
+
+
+// ****************************************************************************
+// Pageable D2H with the batch pipeline (before the ring) and the ring pipeline, in the same run.
+void RunBenchmark_D2HCompare()
+{
+    printStagingConfig();
+
+    ResultDatabase resultDB;
+    if (!RunBenchmark_D2HPipeline(resultDB, false) || !RunBenchmark_D2HPipeline(resultDB, true)) {
+        failed("d2hcompare child process failed");
+    }
+
+    resultDB.DumpSummary(std::cout);
+    if (p_detailed) {
+        resultDB.DumpDetailed(std::cout);
+    }
+
+    std::vector<ResultDatabase::Result> batch = resultDB.GetResultsForTest("D2H_Bandwidth_Unpinned_Batch");
+    std::vector<ResultDatabase::Result> ring  = resultDB.GetResultsForTest("D2H_Bandwidth_Unpinned_Ring");
+    printf ("\n%-12s %14s %14s %10s\n", "size", "batch GB/sec", "ring GB/sec", "ring/batch");
+    for (int i=0; i<batch.size(); i++) {
+        for (int j=0; j<ring.size(); j++) {
+            if (ring[j].atts == batch[i].atts) {
+                double b = batch[i].GetMean();
+                double r = ring[j].GetMean();
+                printf ("%-12s %14.3f %14.3f %10.2f\n", batch[i].atts.c_str(), b, r, (b > 0) ? r / b : 0.0);
+            }
+        }
+    }
+}
+
 
 int main(int argc, char *argv[])
 {
     parseStandardArguments(argc, argv);
 
+    if (p_d2hcompare) {
+        // No HIP calls before the children fork:
+        RunBenchmark_D2HCompare();
+        return 0;
+    }
+
     printConfig();
 
     if (p_h2d) {
@@ -20,6 +20,7 @@ THE SOFTWARE.
 #include"hip_runtime.h"
 #include<iostream>
 #include<time.h>
+#include<vector>
 #include"ResultDatabase.h"
 
 #define check(msg, status) \
@@ -31,6 +32,8 @@ if(status != hipSuccess){ \
 #define LEN 1024*1024
 #define SIZE LEN * sizeof(float)
 #define ITER 10000
+#define GRAPH_BATCH 100
+#define MAX_LAUNCH_BATCH 256
 
 __global__ void One(hipLaunchParm lp, float* Ad){
 }
@@ -61,7 +64,7 @@ int main(){
 	hipEventCreate(&start);
 	hipEventCreate(&stop);
 
-	ResultDatabase resultDB[8];
+	ResultDatabase resultDB[10];
 
 	hipEventRecord(start);
 	hipLaunchKernel(HIP_KERNEL_NAME(One), dim3(LEN/512), dim3(512), 0, 0, Ad);
@@ -145,4 +148,61 @@ int main(){
 	resultDB[7].DumpSummary(std::cout);
 //	std::cout<<"Stream Dispatch No Wait: \t\t"<<mS*1000/ITER<<" uS"<<std::endl;
 	hipDeviceSynchronize();
+
+	// Graph replay: capture GRAPH_BATCH launches once, then replay them.  Times are per kernel.
+	hipGraph_t graph;
+	hipGraphExec_t graphExec;
+	err = hipStreamBeginCapture(stream);
+	check("Beginning stream capture", err);
+	for(int i=0;i<GRAPH_BATCH;i++){
+		hipLaunchKernel(HIP_KERNEL_NAME(One), dim3(LEN/512), dim3(512), 0, stream, Ad);
+	}
+	err = hipStreamEndCapture(stream, &graph);
+	check("Ending stream capture", err);
+	err = hipGraphInstantiate(&graphExec, graph);
+	check("Instantiating graph", err);
+
+	hipEventRecord(start);
+	for(int i=0;i<ITER/GRAPH_BATCH;i++){
+		hipGraphLaunch(graphExec, stream);
+	}
+	hipDeviceSynchronize();
+	hipEventRecord(stop);
+	hipEventElapsedTime(&mS, start, stop);
+	resultDB[8].AddResult(std::string("Stream Graph Replay dispatch wait"), "", "uS", mS*1000/ITER); 
+	resultDB[8].DumpSummary(std::cout);
+	hipDeviceSynchronize();
+
+	hipEventRecord(start);
+	for(int i=0;i<ITER/GRAPH_BATCH;i++){
+		hipGraphLaunch(graphExec, stream);
+	}
+	hipEventRecord(stop);
+	hipEventElapsedTime(&mS, start, stop);
+	resultDB[9].AddResult(std::string("Stream Graph Replay No Wait"), "", "uS", mS*1000/ITER); 
+	resultDB[9].DumpSummary(std::cout);
+	hipDeviceSynchronize();
+
+	hipGraphExecDestroy(graphExec);
+	hipGraphDestroy(graph);
+
+	// Batched launch: one hipLaunchKernelBatch call per batch.  Times are per kernel.
+	ResultDatabase batchDB;
+	std::vector<hipKernelLaunch_t> launches(MAX_LAUNCH_BATCH);
+	for(int i=0;i<MAX_LAUNCH_BATCH;i++){
+		hipKernelLaunchInit(launches[i], HIP_KERNEL_NAME(One), dim3(LEN/512), dim3(512), 0, Ad);
+	}
+	for(int batch=1;batch<=MAX_LAUNCH_BATCH;batch*=2){
+		int calls = ITER/batch;
+		hipEventRecord(start);
+		for(int i=0;i<calls;i++){
+			hipLaunchKernelBatch(stream, launches.data(), batch);
+		}
+		hipDeviceSynchronize();
+		hipEventRecord(stop);
+		hipEventElapsedTime(&mS, start, stop);
+		batchDB.AddResult(std::string("Stream Batch Launch dispatch wait"), std::to_string(batch), "uS", mS*1000/(calls*batch));
+	}
+	batchDB.DumpSummary(std::cout);
+	hipDeviceSynchronize();
 }
@@ -0,0 +1,173 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANNTY OF ANY KIND, EXPRESS OR
+IMPLIED, INNCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANNY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER INN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR INN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Host-only benchmark for the HIP runtime's streaming-store memcpy (src/host_memcpy.cpp).
+// Compares libc memcpy against each non-temporal implementation supported by this CPU.
+// Reports copy bandwidth, plus the time to re-read a cache-resident working set after each copy -
+// this shows how much of the LLC the copy evicted.
+// Runs without a GPU, so it can be used on build machines.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+
+#include "hcc_detail/host_memcpy.h"
+
+int p_iterations = 20;
+size_t p_maxSize = 256*1024*1024;
+size_t p_workingSet = 2*1024*1024;   // data the "application" keeps hot in the cache.
+bool p_verify = true;
+
+
+void help()
+{
+    printf ("Usage: hostMemcpyBench [OPTIONS]\n");
+    printf ("  --iterations, -i <N>  : Number of copies per size (default %d)\n", p_iterations);
+    printf ("  --maxsize <MB>        : Largest copy size, in MB (default %zu)\n", p_maxSize/(1024*1024));
+    printf ("  --workingset <KB>     : Size of working set re-read after each copy, in KB (default %zu)\n", p_workingSet/1024);
+    printf ("  --noverify            : Skip checking the copy results\n");
+}
+
+
+void parseArgs(int argc, char *argv[])
+{
+    for (int i=1; i<argc; i++) {
+        const char *arg = argv[i];
+        if (!strcmp(arg, "--iterations") || !strcmp(arg, "-i")) {
+            if (++i >= argc || (p_iterations = atoi(argv[i])) <= 0) {
+                fprintf(stderr, "error: bad --iterations\n");
+                exit(EXIT_FAILURE);
+            }
+        } else if (!strcmp(arg, "--maxsize")) {
+            if (++i >= argc || atoi(argv[i]) <= 0) {
+                fprintf(stderr, "error: bad --maxsize\n");
+                exit(EXIT_FAILURE);
+            }
+            p_maxSize = (size_t)atoi(argv[i]) * 1024*1024;
+        } else if (!strcmp(arg, "--workingset")) {
+            if (++i >= argc || atoi(argv[i]) <= 0) {
+                fprintf(stderr, "error: bad --workingset\n");
+                exit(EXIT_FAILURE);
+            }
+            p_workingSet = (size_t)atoi(argv[i]) * 1024;
+        } else if (!strcmp(arg, "--noverify")) {
+            p_verify = false;
+        } else if (!strcmp(arg, "--help") || !strcmp(arg, "-h")) {
+            help();
+            exit(EXIT_SUCCESS);
+        } else {
+            fprintf(stderr, "error: unknown argument '%s'\n", arg);
+            help();
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+
+double elapsedUs(std::chrono::high_resolution_clock::time_point start)
+{
+    auto stop = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::micro>(stop - start).count();
+}
+
+
+// Sum the working set, returns time in us.
+double touchWorkingSet(const uint64_t *ws, size_t count, uint64_t *sum)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    uint64_t s = 0;
+    for (size_t i=0; i<count; i+=8) { // one access per cache line.
+        s += ws[i];
+    }
+    *sum += s;
+    return elapsedUs(start);
+}
+
+
+int main(int argc, char *argv[])
+{
+    parseArgs(argc, argv);
+
+    HostMemcpyIsa best = HostMemcpyInit(HostMemcpyIsaAvx512);
+    printf ("best streaming memcpy: %s\n", HostMemcpyIsaName(best));
+
+    // Offset the pointers so the head/tail handling is exercised:
+    char *src = (char*)malloc(p_maxSize + 64);
+    char *dst = (char*)malloc(p_maxSize + 64);
+    char *srcp = src + 3;
+    char *dstp = dst + 5;
+    for (size_t i=0; i<p_maxSize; i++) {
+        srcp[i] = (char)(i * 7 + 1);
+    }
+    memset(dst, 0, p_maxSize + 64);
+
+    size_t wsCount = p_workingSet / sizeof(uint64_t);
+    std::vector<uint64_t> workingSet(wsCount, 1);
+    uint64_t sum = 0;
+
+    printf ("%-10s %-8s %12s %16s\n", "size", "isa", "GB/s", "ws-reread(us)");
+
+    int errors = 0;
+    for (size_t sizeBytes=64*1024; sizeBytes<=p_maxSize; sizeBytes*=4) {
+        for (int isa=HostMemcpyIsaLibc; isa<=HostMemcpyIsaAvx512; isa++) {
+            HostMemcpyFn fn = HostMemcpyGetImpl((HostMemcpyIsa)isa);
+            if (fn == NULL) {
+                continue;
+            }
+
+            double copyUs = 0.0;
+            double rereadUs = 0.0;
+            for (int i=0; i<p_iterations; i++) {
+                touchWorkingSet(workingSet.data(), wsCount, &sum); // warm the working set.
+
+                auto start = std::chrono::high_resolution_clock::now();
+                fn(dstp, srcp, sizeBytes);
+                copyUs += elapsedUs(start);
+
+                rereadUs += touchWorkingSet(workingSet.data(), wsCount, &sum);
+            }
+
+            if (p_verify && memcmp(dstp, srcp, sizeBytes)) {
+                fprintf(stderr, "error: %s copy of %zu bytes mismatched\n", HostMemcpyIsaName((HostMemcpyIsa)isa), sizeBytes);
+                errors++;
+            }
+            memset(dstp, 0, sizeBytes);
+
+            double gbps = (double)sizeBytes * p_iterations / (copyUs * 1000.0);
+            printf ("%-10zu %-8s %12.2f %16.2f\n", sizeBytes, HostMemcpyIsaName((HostMemcpyIsa)isa), gbps, rereadUs / p_iterations);
+        }
+    }
+
+    free(src);
+    free(dst);
+
+    if (sum == 0) {
+        printf ("\n"); // keep the working-set reads from being optimized away.
+    }
+
+    if (errors) {
+        printf ("FAILED\n");
+        return EXIT_FAILURE;
+    }
+    printf ("PASSED\n");
+    return EXIT_SUCCESS;
+}
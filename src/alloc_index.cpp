@@ -0,0 +1,314 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANNTY OF ANY KIND, EXPRESS OR
+IMPLIED, INNCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANNY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER INN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR INN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <algorithm>
+
+#include "hip_runtime.h"
+#include "hcc_detail/hip_hcc.h"
+#include "hcc_detail/alloc_index.h"
+#include "hcc_detail/trace_helper.h"
+
+
+//---
+// Last successful lookup on this thread.  Valid while the index generation is unchanged.
+struct AllocIndexLastHit {
+    const AllocIndex   *_index;
+    uint64_t            _generation;
+    const char         *_base;
+    AllocInfo           _info;
+};
+
+static thread_local AllocIndexLastHit tls_allocLastHit = { NULL, 0, NULL, { NULL, NULL, 0, false, -1, 0 } };
+
+// Reader count slot of this thread, assigned round-robin on its first lookup:
+static std::atomic<unsigned> s_allocReaderSlotNext(0);
+static thread_local int tls_allocReaderSlot = -1;
+
+
+//-------------------------------------------------------------------------------------------------
+AllocIndex::AllocIndex() :
+    _current(new Snapshot),
+    _generation(0)
+{
+    for (int i=0; i<_readerSlots; i++) {
+        _readers[i]._count.store(0);
+    }
+}
+
+
+//---
+AllocIndex::~AllocIndex()
+{
+    delete _current.load();
+    for (auto iter=_retired.begin(); iter!=_retired.end(); iter++) {
+        delete *iter;
+    }
+}
+
+
+//---
+// Index of the last chunk whose first base is <= p, or 0 if p is before every chunk.
+size_t AllocIndex::chunkIndex(const Snapshot &snapshot, const char *p)
+{
+    auto iter = std::upper_bound(snapshot._firstBase.begin(), snapshot._firstBase.end(), p);
+    return (iter == snapshot._firstBase.begin()) ? 0 : (iter - snapshot._firstBase.begin() - 1);
+}
+
+
+//---
+bool AllocIndex::find(const Snapshot &snapshot, const void *ptr, const Entry **entry)
+{
+    const char *p = static_cast<const char*> (ptr);
+
+    if (snapshot._chunks.empty()) {
+        return false;
+    }
+    const Chunk &chunk = *snapshot._chunks[chunkIndex(snapshot, p)];
+
+    // First entry with base > p, the candidate is the one before it:
+    auto iter = std::upper_bound(chunk.begin(), chunk.end(), p,
+                                 [] (const char *key, const Entry &e) { return key < e._base; });
+    if (iter == chunk.begin()) {
+        return false;
+    }
+    iter--;
+
+    if (p < iter->_base + iter->_info._sizeBytes) {
+        *entry = &(*iter);
+        return true;
+    }
+    return false;
+}
+
+
+//---
+// The chunks outside [first, last) are shared with cur, only the top-level arrays are copied.
+// Entries are spread evenly over the fewest chunks that hold them, so a full chunk splits into two halves.
+AllocIndex::Snapshot* AllocIndex::replaceChunks(const Snapshot &cur, size_t first, size_t last, const std::vector<Entry> &entries)
+{
+    size_t numChunks = (entries.size() + _chunkEntries - 1) / _chunkEntries;
+
+    Snapshot *snapshot = new Snapshot;
+    size_t total = cur._chunks.size() - (last - first) + numChunks;
+    snapshot->_firstBase.reserve(total);
+    snapshot->_chunks.reserve(total);
+
+    snapshot->_firstBase.insert(snapshot->_firstBase.end(), cur._firstBase.begin(), cur._firstBase.begin() + first);
+    snapshot->_chunks.insert(snapshot->_chunks.end(), cur._chunks.begin(), cur._chunks.begin() + first);
+
+    size_t pos = 0;
+    for (size_t i=0; i<numChunks; i++) {
+        size_t count = (entries.size() - pos) / (numChunks - i);
+        std::shared_ptr<Chunk> chunk = std::make_shared<Chunk>(entries.begin() + pos, entries.begin() + pos + count);
+        snapshot->_firstBase.push_back(chunk->front()._base);
+        snapshot->_chunks.push_back(chunk);
+        pos += count;
+    }
+
+    snapshot->_firstBase.insert(snapshot->_firstBase.end(), cur._firstBase.begin() + last, cur._firstBase.end());
+    snapshot->_chunks.insert(snapshot->_chunks.end(), cur._chunks.begin() + last, cur._chunks.end());
+
+    return snapshot;
+}
+
+
+//---
+bool AllocIndex::readersIdle() const
+{
+    for (int i=0; i<_readerSlots; i++) {
+        if (_readers[i]._count.load() != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+//---
+// A reader which loaded an old snapshot has raised its reader slot before loading it, so once every slot is seen
+// at 0 after the swap no reader can still hold a retired snapshot.  Deleting a snapshot frees only the chunks no
+// newer snapshot shares.
+void AllocIndex::publish(Snapshot *snapshot, bool removed)
+{
+    Snapshot *old = _current.exchange(snapshot);
+    if (removed) {
+        _generation++;
+    }
+
+    _retired.push_back(old);
+    if (readersIdle()) {
+        for (auto iter=_retired.begin(); iter!=_retired.end(); iter++) {
+            delete *iter;
+        }
+        _retired.clear();
+    }
+}
+
+
+//---
+void AllocIndex::locked_insert(const void *base, const AllocInfo &info, int deviceIndex)
+{
+    if ((base == NULL) || (info._sizeBytes == 0)) {
+        return;
+    }
+
+    Entry entry;
+    entry._base = static_cast<const char*> (base);
+    entry._info = info;
+    entry._deviceIndex = deviceIndex;
+
+    const char *end = entry._base + info._sizeBytes;
+
+    std::lock_guard<std::mutex> l(_mutex);
+
+    const Snapshot *cur = _current.load();
+
+    // Entries never overlap, so only the chunks from the one holding base to the one holding end-1 can overlap the
+    // new range, and the new entry goes into one of them:
+    size_t first = 0;
+    size_t last = 0;
+    if (!cur->_chunks.empty()) {
+        first = chunkIndex(*cur, entry._base);
+        last = chunkIndex(*cur, end - 1) + 1;
+    }
+
+    // Merge in order, dropping stale entries that overlap the new range (memory released behind HIP's back):
+    std::vector<Entry> entries;
+    entries.reserve((last - first) * _chunkEntries + 1);
+    bool removed = false;
+    bool inserted = false;
+    for (size_t c=first; c<last; c++) {
+        const Chunk &chunk = *cur->_chunks[c];
+        for (auto iter=chunk.begin(); iter!=chunk.end(); iter++) {
+            if ((iter->_base < end) && (entry._base < iter->_base + iter->_info._sizeBytes)) {
+                tprintf(DB_MEM, "alloc index: drop stale entry %p size=%zu\n", iter->_base, iter->_info._sizeBytes);
+                removed = true;
+                continue;
+            }
+            if (!inserted && (entry._base < iter->_base)) {
+                entries.push_back(entry);
+                inserted = true;
+            }
+            entries.push_back(*iter);
+        }
+    }
+    if (!inserted) {
+        entries.push_back(entry);
+    }
+
+    publish(replaceChunks(*cur, first, last, entries), removed);
+}
+
+
+//---
+void AllocIndex::locked_remove(const void *base)
+{
+    std::lock_guard<std::mutex> l(_mutex);
+
+    const Snapshot *cur = _current.load();
+    if (cur->_chunks.empty()) {
+        return;
+    }
+
+    size_t first = chunkIndex(*cur, static_cast<const char*> (base));
+    const Chunk &chunk = *cur->_chunks[first];
+    auto iter = std::lower_bound(chunk.begin(), chunk.end(), static_cast<const char*> (base),
+                                 [] (const Entry &e, const char *key) { return e._base < key; });
+    if ((iter == chunk.end()) || (iter->_base != base)) {
+        return;
+    }
+
+    // Merge a small remainder into the next chunk, so removes do not leave a trail of tiny chunks:
+    size_t last = first + 1;
+    if ((chunk.size() - 1 < _chunkEntries / 4) && (last < cur->_chunks.size())) {
+        last++;
+    }
+
+    std::vector<Entry> entries;
+    entries.reserve((last - first) * _chunkEntries);
+    entries.insert(entries.end(), chunk.begin(), iter);
+    entries.insert(entries.end(), iter + 1, chunk.end());
+    if (last > first + 1) {
+        const Chunk &next = *cur->_chunks[first + 1];
+        entries.insert(entries.end(), next.begin(), next.end());
+    }
+
+    publish(replaceChunks(*cur, first, last, entries), true);
+}
+
+
+//---
+void AllocIndex::locked_removeDevice(int deviceIndex)
+{
+    std::lock_guard<std::mutex> l(_mutex);
+
+    const Snapshot *cur = _current.load();
+    std::vector<Entry> entries;
+    for (auto chunkIter=cur->_chunks.begin(); chunkIter!=cur->_chunks.end(); chunkIter++) {
+        for (auto iter=(*chunkIter)->begin(); iter!=(*chunkIter)->end(); iter++) {
+            if (iter->_deviceIndex != deviceIndex) {
+                entries.push_back(*iter);
+            }
+        }
+    }
+
+    publish(replaceChunks(*cur, 0, cur->_chunks.size(), entries), true);
+}
+
+
+//---
+bool AllocIndex::lookup(const void *ptr, AllocInfo *info) const
+{
+    const char *p = static_cast<const char*> (ptr);
+
+    // Read the generation before the snapshot, so a hit cached below is never newer than the removes it has seen.
+    uint64_t generation = _generation.load(std::memory_order_acquire);
+
+    AllocIndexLastHit &lastHit = tls_allocLastHit;
+    if ((lastHit._index == this) && (lastHit._generation == generation) &&
+        (p >= lastHit._base) && (p < lastHit._base + lastHit._info._sizeBytes)) {
+        *info = lastHit._info;
+        return true;
+    }
+
+    if (tls_allocReaderSlot < 0) {
+        tls_allocReaderSlot = s_allocReaderSlotNext++ % _readerSlots;
+    }
+    std::atomic<int> &readers = _readers[tls_allocReaderSlot]._count;
+
+    bool found = false;
+    readers++;
+    {
+        const Entry *entry;
+        if (find(*_current.load(), ptr, &entry)) {
+            found = true;
+            lastHit._base = entry->_base;
+            lastHit._info = entry->_info;
+        }
+    }
+    readers--;
+
+    if (found) {
+        lastHit._index = this;
+        lastHit._generation = generation;
+        *info = lastHit._info;
+    }
+
+    return found;
+}
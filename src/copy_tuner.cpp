@@ -0,0 +1,444 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANNTY OF ANY KIND, EXPRESS OR
+IMPLIED, INNCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANNY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER INN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR INN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <stdint.h>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+#include <hc_am.hpp>
+
+#include "hsa_ext_amd.h"
+
+#include "hip_runtime.h"
+#include "hcc_detail/hip_hcc.h"
+#include "hcc_detail/copy_tuner.h"
+#include "hcc_detail/trace_helper.h"
+
+
+// Copy sizes timed by the calibration pass:
+static const size_t s_minTuneSize = 4*1024;
+static const size_t s_maxTuneSize = 64*1024*1024;
+
+// Smallest staging chunk size tried:
+static const size_t s_minChunkSize = 16*1024;
+
+
+static const char* algorithmName(StagingCopyAlgorithm algorithm)
+{
+    switch (algorithm) {
+    case StagingCopyStaged:     return "staged";
+    case StagingCopyPinInPlace: return "pininplace";
+    case StagingCopyDirect:     return "direct";
+    default:                    return "unknown";
+    };
+}
+
+
+static bool samePlan(const StagingCopyPlan &a, const StagingCopyPlan &b)
+{
+    return (a._algorithm == b._algorithm) &&
+           ((a._algorithm != StagingCopyStaged) || (a._chunkBytes == b._chunkBytes));
+}
+
+
+//-------------------------------------------------------------------------------------------------
+CopyTuner::CopyTuner(ihipDevice_t *device, bool recalibrate, bool dump) :
+    _device(device),
+    _recalibrate(recalibrate),
+    _dump(dump),
+    _ready(false),
+    _stop(false)
+{
+    // Key is device name + PCI location, with spaces removed so the file is easy to parse:
+    char key[300];
+    snprintf(key, sizeof(key), "%s@%02x:%02x", device->_props.name, device->_props.pciBusID, device->_props.pciDeviceID);
+    for (char *c=key; *c; c++) {
+        if ((*c == ' ') || (*c == '\t')) {
+            *c = '_';
+        }
+    }
+    _key = key;
+
+    const char *fileName = getenv("HIP_COPY_TUNE_FILE");
+    const char *home = getenv("HOME");
+    if (fileName) {
+        _fileName = fileName;
+    } else if (home) {
+        _fileName = std::string(home) + "/.hip_copy_tune";
+    }
+
+    // Loading is cheap, but calibration times copies for seconds - keep it off the application's copies:
+    if (!_recalibrate && load()) {
+        _ready = true;
+        if (_dump) {
+            this->dump(stderr);  // the dump argument hides the member function.
+        }
+    } else {
+        _calibrator = std::thread(&CopyTuner::calibrateWorker, this);
+    }
+}
+
+
+//---
+CopyTuner::~CopyTuner()
+{
+    _stop = true;
+    if (_calibrator.joinable()) {
+        _calibrator.join();
+    }
+}
+
+
+//---
+// Direct copy until the table is ready.
+StagingCopyPlan CopyTuner::locked_lookup(bool hostToDevice, size_t sizeBytes)
+{
+    std::lock_guard<std::mutex> l (_lock);
+
+    if (!_ready) {
+        return StagingCopyPlan(StagingCopyDirect);
+    }
+
+    const std::vector<Entry> &table = _table[hostToDevice ? 0 : 1];
+    for (auto iter=table.begin(); iter!=table.end(); iter++) {
+        if (sizeBytes <= iter->_maxBytes) {
+            return iter->_plan;
+        }
+    }
+
+    return table.back()._plan;
+}
+
+
+//---
+void CopyTuner::locked_dump(FILE *f)
+{
+    std::lock_guard<std::mutex> l (_lock);
+
+    if (_ready) {
+        dump(f);
+    } else {
+        fprintf (f, "copy tuning table for %s: calibrating\n", _key.c_str());
+    }
+}
+
+
+//---
+// Body of the _calibrator thread.  On failure the tuner keeps returning direct copies.
+void CopyTuner::calibrateWorker()
+{
+    std::vector<Entry> table[2];
+    try {
+        if (!calibrate(table)) {
+            return; // stopped by the destructor.
+        }
+    } catch (...) {
+        tprintf (DB_COPY1, "copy tuner: calibration of %s failed, using direct copies\n", _key.c_str());
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> l (_lock);
+        for (int dir=0; dir<2; dir++) {
+            _table[dir].swap(table[dir]);
+        }
+        _ready = true;
+    }
+
+    // _table no longer changes, so can be read without the lock:
+    save();
+    if (_dump) {
+        dump(stderr);
+    }
+}
+
+
+//---
+void CopyTuner::dump(FILE *f)
+{
+    fprintf (f, "copy tuning table for %s:\n", _key.c_str());
+    for (int dir=0; dir<2; dir++) {
+        for (auto iter=_table[dir].begin(); iter!=_table[dir].end(); iter++) {
+            if (iter->_maxBytes == SIZE_MAX) {
+                fprintf (f, "  %s  size <= max        : %-10s", dir ? "D2H" : "H2D", algorithmName(iter->_plan._algorithm));
+            } else {
+                fprintf (f, "  %s  size <= %-12zu: %-10s", dir ? "D2H" : "H2D", iter->_maxBytes, algorithmName(iter->_plan._algorithm));
+            }
+            if (iter->_plan._algorithm == StagingCopyStaged) {
+                fprintf (f, " chunk=%zu", iter->_plan._chunkBytes);
+            }
+            fprintf (f, "\n");
+        }
+    }
+}
+
+
+//---
+// Read the entries for this device from the table file.  Returns false if the file has no complete table for this device.
+bool CopyTuner::load()
+{
+    if (_fileName.empty()) {
+        return false;
+    }
+
+    std::ifstream file(_fileName);
+    if (!file) {
+        return false;
+    }
+
+    std::vector<Entry> table[2];
+
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream ss(line);
+        std::string key, dir, maxBytes, algorithm;
+        size_t chunkBytes;
+        if (!(ss >> key >> dir >> maxBytes >> algorithm >> chunkBytes) || (key != _key)) {
+            continue;
+        }
+
+        Entry e;
+        e._maxBytes = (maxBytes == "max") ? SIZE_MAX : strtoull(maxBytes.c_str(), NULL, 0);
+        e._plan._chunkBytes = chunkBytes;
+        if (algorithm == "staged") {
+            e._plan._algorithm = StagingCopyStaged;
+        } else if (algorithm == "pininplace") {
+            e._plan._algorithm = StagingCopyPinInPlace;
+        } else if (algorithm == "direct") {
+            e._plan._algorithm = StagingCopyDirect;
+        } else {
+            tprintf (DB_COPY1, "copy tuner: ignoring bad line '%s' in %s\n", line.c_str(), _fileName.c_str());
+            continue;
+        }
+
+        if (dir == "h2d") {
+            table[0].push_back(e);
+        } else if (dir == "d2h") {
+            table[1].push_back(e);
+        }
+    }
+
+    if (table[0].empty() || table[1].empty()) {
+        return false;
+    }
+
+    for (int dir=0; dir<2; dir++) {
+        _table[dir] = table[dir];
+    }
+    tprintf (DB_COPY1, "copy tuner: loaded table for %s from %s\n", _key.c_str(), _fileName.c_str());
+
+    return true;
+}
+
+
+//---
+// Replace the entries for this device in the table file, keeping entries for other devices.
+void CopyTuner::save()
+{
+    if (_fileName.empty()) {
+        return;
+    }
+
+    std::vector<std::string> otherLines;
+    {
+        std::ifstream file(_fileName);
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.compare(0, _key.size() + 1, _key + " ") != 0) {
+                otherLines.push_back(line);
+            }
+        }
+    }
+
+    // Write to a temp file and rename, so other processes never read a partial table:
+    char tmpName[32];
+    snprintf(tmpName, sizeof(tmpName), ".tmp%d", getpid());
+    std::string tmpFileName = _fileName + tmpName;
+    {
+        std::ofstream file(tmpFileName);
+        if (!file) {
+            tprintf (DB_COPY1, "copy tuner: can't write %s\n", tmpFileName.c_str());
+            return;
+        }
+        for (auto iter=otherLines.begin(); iter!=otherLines.end(); iter++) {
+            file << *iter << "\n";
+        }
+        for (int dir=0; dir<2; dir++) {
+            for (auto iter=_table[dir].begin(); iter!=_table[dir].end(); iter++) {
+                file << _key << (dir ? " d2h " : " h2d ");
+                if (iter->_maxBytes == SIZE_MAX) {
+                    file << "max";
+                } else {
+                    file << iter->_maxBytes;
+                }
+                file << " " << algorithmName(iter->_plan._algorithm) << " " << iter->_plan._chunkBytes << "\n";
+            }
+        }
+    }
+
+    if (rename(tmpFileName.c_str(), _fileName.c_str()) != 0) {
+        unlink(tmpFileName.c_str());
+    }
+}
+
+
+//---
+// Returns average time in us for one copy.
+double CopyTuner::timeCopy(bool hostToDevice, const StagingCopyPlan &plan, void *devPtr, void *hostPtr, size_t sizeBytes)
+{
+    StagingBufferPool *stagingPool = _device->_staging_pool[hostToDevice ? 0 : 1];
+    StagingBuffer *stagingBuffer = stagingPool->Acquire();
+    void *dst = hostToDevice ? devPtr : hostPtr;
+    const void *src = hostToDevice ? hostPtr : devPtr;
+
+    int iterations = s_maxTuneSize / sizeBytes;
+    iterations = (iterations < 3) ? 3 : ((iterations > 100) ? 100 : iterations);
+
+    auto start = std::chrono::steady_clock::now();
+    try {
+        for (int i=-1; i<iterations; i++) {
+            if (i == 0) {
+                start = std::chrono::steady_clock::now(); // first copy is warm-up.
+            }
+            if (plan._algorithm == StagingCopyDirect) {
+                hc::am_copy(dst, src, sizeBytes);
+            } else {
+                stagingBuffer->Copy(hostToDevice, dst, src, sizeBytes, NULL, plan);
+            }
+        }
+    } catch (...) {
+        stagingPool->Release(stagingBuffer);
+        throw;
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    stagingPool->Release(stagingBuffer);
+
+    return std::chrono::duration<double, std::micro>(stop - start).count() / iterations;
+}
+
+
+//---
+// Allocate the calibration buffers and build the table with sweep.  Returns false if stopped.
+bool CopyTuner::calibrate(std::vector<Entry> table[2])
+{
+    tprintf (DB_COPY1, "copy tuner: calibrating %s\n", _key.c_str());
+
+    void *devPtr = hc::am_alloc(s_maxTuneSize, _device->_acc, 0);
+    void *hostPtr = malloc(s_maxTuneSize);
+
+    // Freed on every path, either allocation may have failed:
+    auto freeBuffers = [&] () {
+        if (hostPtr) {
+            free(hostPtr);
+        }
+        if (devPtr) {
+            hc::am_free(devPtr);
+        }
+    };
+
+    bool done;
+    try {
+        if ((devPtr == NULL) || (hostPtr == NULL)) {
+            throw ihipException(hipErrorMemoryAllocation);
+        }
+        memset(hostPtr, 0, s_maxTuneSize);
+
+        done = sweep(devPtr, hostPtr, table);
+    } catch (...) {
+        freeBuffers();
+        throw;
+    }
+    freeBuffers();
+
+    return done;
+}
+
+
+//---
+// Time each algorithm at each size into table.  Returns false if stopped.
+bool CopyTuner::sweep(void *devPtr, void *hostPtr, std::vector<Entry> table[2])
+{
+    // Candidate plans:
+    std::vector<StagingCopyPlan> plans;
+    plans.push_back(StagingCopyPlan(StagingCopyDirect));
+    if (_device->_pin_cache) {
+        plans.push_back(StagingCopyPlan(StagingCopyPinInPlace));
+    }
+    if (HIP_STAGING_BUFFERS) {
+        size_t bufferSize = _device->_staging_pool[0]->BufferSize();
+        for (size_t chunk=bufferSize; chunk>=s_minChunkSize; chunk/=2) {
+            plans.push_back(StagingCopyPlan(StagingCopyStaged, chunk));
+        }
+    }
+
+    for (int dir=0; dir<2; dir++) {
+        bool hostToDevice = (dir == 0);
+
+        std::vector<size_t> sizes;
+        std::vector<StagingCopyPlan> best;
+        for (size_t sizeBytes=s_minTuneSize; sizeBytes<=s_maxTuneSize; sizeBytes*=4) {
+            if (_stop) {
+                return false;
+            }
+            double bestUs = 0.0;
+            StagingCopyPlan bestPlan;
+            size_t lastStagedChunk = 0;
+            for (auto iter=plans.begin(); iter!=plans.end(); iter++) {
+                // Chunks larger than the copy all run the same way - time only the first:
+                if (iter->_algorithm == StagingCopyStaged) {
+                    size_t effectiveChunk = std::min(iter->_chunkBytes, sizeBytes);
+                    if (effectiveChunk == lastStagedChunk) {
+                        continue;
+                    }
+                    lastStagedChunk = effectiveChunk;
+                }
+
+                double us = timeCopy(hostToDevice, *iter, devPtr, hostPtr, sizeBytes);
+                tprintf (DB_COPY1, "copy tuner: %s size=%zu %s chunk=%zu : %.1f us\n", hostToDevice ? "H2D" : "D2H",
+                         sizeBytes, algorithmName(iter->_algorithm), iter->_chunkBytes, us);
+                if ((bestUs == 0.0) || (us < bestUs)) {
+                    bestUs = us;
+                    bestPlan = *iter;
+                }
+            }
+            sizes.push_back(sizeBytes);
+            best.push_back(bestPlan);
+        }
+
+        // Merge neighboring sizes with the same plan, with the crossover at the geometric mean:
+        table[dir].clear();
+        for (size_t i=0; i<sizes.size(); i++) {
+            if ((i+1 < sizes.size()) && samePlan(best[i], best[i+1])) {
+                continue;
+            }
+            Entry e;
+            e._maxBytes = (i+1 < sizes.size()) ? (size_t)sqrt((double)sizes[i] * (double)sizes[i+1]) : SIZE_MAX;
+            e._plan = best[i];
+            table[dir].push_back(e);
+        }
+    }
+
+    return true;
+}
@@ -150,9 +150,9 @@ hipError_t hipDeviceSynchronize(void)
 {
     HIP_INIT_API();
 
-    ihipGetTlsDefaultDevice()->locked_waitAllStreams(); // ignores non-blocking streams, this waits for all activity to finish.
+    hipError_t e = ihipGetTlsDefaultDevice()->locked_waitAllStreams(); // ignores non-blocking streams, this waits for all activity to finish.
 
-    return ihipLogStatus(hipSuccess);
+    return ihipLogStatus(e);
 }
 
 
@@ -291,7 +291,8 @@ hipError_t hipSetDeviceFlags( unsigned int flags)
 
     ihipDevice_t * hipDevice = ihipGetDevice(tls_defaultDevice);
     if(hipDevice){
-       hipDevice->_device_flags = hipDevice->_device_flags | flags;
+       // Schedule flags select one wait mode, so always replace the old one - hipDeviceScheduleAuto is 0:
+       hipDevice->_device_flags = (hipDevice->_device_flags & ~hipDeviceScheduleMask) | flags;
        e = hipSuccess;
     }else{
        e = hipErrorInvalidDevice;
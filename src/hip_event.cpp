@@ -20,6 +20,7 @@ THE SOFTWARE.
 #include "hip_runtime.h"
 #include "hcc_detail/hip_hcc.h"
 #include "hcc_detail/trace_helper.h"
+#include "hsa_ext_amd.h"
 
 //-------------------------------------------------------------------------------------------------
 //-------------------------------------------------------------------------------------------------
@@ -27,19 +28,36 @@ THE SOFTWARE.
 //---
 
 
+static std::once_flag s_copyProfilingInit;
+
+
 hipError_t ihipEventCreate(hipEvent_t* event, unsigned flags)
 {
     hipError_t e = hipSuccess;
 
-    // TODO - support hipEventDefault, hipEventBlockingSync, hipEventDisableTiming
-    if (flags == 0) {
-        ihipEvent_t *eh = event->_handle = new ihipEvent_t();
+    // There is no IPC handle API, so an interprocess event is a local event.  CUDA requires it to disable timing.
+    const unsigned supportedFlags = hipEventDefault | hipEventBlockingSync | hipEventDisableTiming | hipEventInterprocess;
+    bool validFlags = ((flags & ~supportedFlags) == 0) &&
+                      (!(flags & hipEventInterprocess) || (flags & hipEventDisableTiming));
+
+    if (validFlags) {
+        ihipEvent_t *eh = event->_handle = g_eventPool.locked_acquire();
 
         eh->_state  = hipEventStatusCreated;
         eh->_stream = NULL;
+        eh->_device = NULL;
         eh->_flags  = flags;
         eh->_timestamp  = 0;
-        eh->_copy_seq_id  = 0;
+        eh->_signal = ihipSignalRef_t();
+
+        if (!(flags & hipEventDisableTiming)) {
+            // Timestamps on hsa_amd_memory_async_copy signals, so events can report the end of a copy.
+            // This is process-wide and adds work to every copy, so wait for the first event with timing.
+            std::call_once(s_copyProfilingInit, [] () {
+                hsa_status_t hsa_status = hsa_amd_profiling_async_copy_enable(true);
+                tprintf (DB_COPY1, "enable async copy profiling, status=%x\n", hsa_status);
+            });
+        }
     } else {
         e = hipErrorInvalidValue;
     }
@@ -48,7 +66,7 @@ hipError_t ihipEventCreate(hipEvent_t* event, unsigned flags)
 }
 
 /**
- * @warning : flags must be 0.
+ * @return #hipSuccess, #hipErrorInvalidValue
  */
 hipError_t hipEventCreateWithFlags(hipEvent_t* event, unsigned flags)
 {
@@ -73,29 +91,20 @@ hipError_t hipEventRecord(hipEvent_t event, hipStream_t stream)
 
     ihipEvent_t *eh = event._handle;
     if (eh && eh->_state != hipEventStatusUnitialized)   {
-        eh->_stream = stream;
-
+        // The record sets the event's state, stream and device under the event lock.
         if (stream == NULL) {
-            // If stream == NULL, wait on all queues.
-            // Behavior matches "use standard default semantics".
-            // TODO-HCC fix this - conservative or use device timestamps?
-            // TODO-HCC can we use barrier or event marker to implement better solution?
+            // The NULL stream event waits for all blocking streams, which is "use standard default semantics".
+            // The default stream joins the last command of every other blocking stream with a barrier, like any
+            // other NULL-stream command, so the host does not wait and the timestamp comes from the GPU.
             ihipDevice_t *device = ihipGetTlsDefaultDevice();
-            device->locked_syncDefaultStream(true);
+            device->locked_waitBlockingStreams(device->_default_stream);
 
-            eh->_timestamp = hc::get_system_ticks();
-            eh->_state = hipEventStatusRecorded;
-            return ihipLogStatus(hipSuccess);
+            device->_default_stream->locked_recordEvent(eh);
         } else {
-            eh->_state  = hipEventStatusRecording;
-            // Clear timestamps
-            eh->_timestamp = 0;
-            eh->_marker = stream->_av.create_marker();
-            
-            eh->_copy_seq_id = stream->locked_lastCopySeqId();
-
-            return ihipLogStatus(hipSuccess);
+            stream->locked_recordEvent(eh);
         }
+
+        return ihipLogStatus(hipSuccess);
     } else {
         return ihipLogStatus(hipErrorInvalidResourceHandle);
     }
@@ -107,12 +116,14 @@ hipError_t hipEventDestroy(hipEvent_t event)
 {
     std::call_once(hip_initialized, ihipInit);
 
-    event._handle->_state  = hipEventStatusUnitialized;
+    if ((event._handle == NULL) || (event._handle->_state == hipEventStatusUnitialized)) {
+        return ihipLogStatus(hipErrorInvalidResourceHandle);
+    }
 
-    delete event._handle;
+    // Back to the slab - an in-flight record keeps running on its stream signal, and waiters hold it themselves.
+    g_eventPool.locked_release(event._handle);
     event._handle = NULL;
 
-    // TODO - examine return additional error codes
     return ihipLogStatus(hipSuccess);
 }
 
@@ -130,17 +141,20 @@ hipError_t hipEventSynchronize(hipEvent_t event)
         } else if (eh->_state == hipEventStatusCreated ) {
             // Created but not actually recorded on any device:
             return ihipLogStatus(hipSuccess);
-        } else if (eh->_stream == NULL) {
-            ihipDevice_t *device = ihipGetTlsDefaultDevice();
-            device->locked_syncDefaultStream(true);
-            return ihipLogStatus(hipSuccess);
         } else {
-#if __hcc_workweek__ >= 16033
-            eh->_marker.wait((eh->_flags & hipEventBlockingSync) ? hc::hcWaitModeBlocked : hc::hcWaitModeActive);
-#else
-            eh->_marker.wait();
-#endif
-            eh->_stream->locked_reclaimSignals(eh->_copy_seq_id);
+            // The recording stream may be destroyed by now, so only the device is used.  The record's signal stays
+            // valid for the wait, see ihipSignalRef_t:
+            ihipSignalRef_t signal;
+            SignalWaitMode waitMode;
+            {
+                std::lock_guard<std::mutex> el(eh->_mutex);
+                signal   = eh->_signal;
+                waitMode = (eh->_flags & hipEventBlockingSync) ? SignalWaitBlocked : eh->_device->waitMode();
+            }
+
+            // The event barrier waits for the copies as well as the kernels before the record:
+            signal.wait(waitMode);
+            ihipSetTs(event);
 
             return ihipLogStatus(hipSuccess);
         }
@@ -158,21 +172,25 @@ hipError_t hipEventElapsedTime(float *ms, hipEvent_t start, hipEvent_t stop)
     ihipEvent_t *start_eh = start._handle;
     ihipEvent_t *stop_eh = stop._handle;
 
-    ihipSetTs(start);
-    ihipSetTs(stop);
-
     hipError_t status = hipSuccess;
     *ms = 0.0f;
 
     if (start_eh && stop_eh) {
-        if ((start_eh->_state == hipEventStatusRecorded) && (stop_eh->_state == hipEventStatusRecorded)) {
+        ihipSetTs(start);
+        ihipSetTs(stop);
+
+        if ((start_eh->_flags & hipEventDisableTiming) || (stop_eh->_flags & hipEventDisableTiming)) {
+            status = hipErrorInvalidResourceHandle;
+        } else if ((start_eh->_state == hipEventStatusRecorded) && (stop_eh->_state == hipEventStatusRecorded) &&
+                   ((start_eh->_timestamp == 0) || (stop_eh->_timestamp == 0))) {
+            // Profiling was not available on the queue, so there is no timing information:
+            status = hipErrorInvalidResourceHandle;
+        } else if ((start_eh->_state == hipEventStatusRecorded) && (stop_eh->_state == hipEventStatusRecorded)) {
             // Common case, we have good information for both events.
 
             int64_t tickDiff = (stop_eh->_timestamp - start_eh->_timestamp);
 
-            // TODO-move this to a variable saved with each agent.
-            uint64_t freqHz;
-            hsa_system_get_info(HSA_SYSTEM_INFO_TIMESTAMP_FREQUENCY, &freqHz);
+            uint64_t freqHz = start_eh->_device->_timestamp_frequency;
             if (freqHz) {
                 *ms = ((double)(tickDiff) /  (double)(freqHz)) * 1000.0f;
                 status = hipSuccess;
@@ -189,6 +207,8 @@ hipError_t hipEventElapsedTime(float *ms, hipEvent_t start, hipEvent_t stop)
                    (stop_eh->_state  == hipEventStatusUnitialized)) {
             status = hipErrorInvalidResourceHandle;
         }
+    } else {
+        status = hipErrorInvalidResourceHandle;
     }
 
     return ihipLogStatus(status);
@@ -202,8 +222,12 @@ hipError_t hipEventQuery(hipEvent_t event)
 
     ihipEvent_t *eh = event._handle;
 
-    // TODO-stream - need to read state of signal here:  The event may have become ready after recording..
-    // TODO-HCC - use get_hsa_signal here.
+    if ((eh == NULL) || (eh->_state == hipEventStatusUnitialized)) {
+        return ihipLogStatus(hipErrorInvalidResourceHandle);
+    }
+
+    // Non-blocking load of the event signal:
+    ihipSetTs(event);
 
     if (eh->_state == hipEventStatusRecording) {
         return ihipLogStatus(hipErrorNotReady);
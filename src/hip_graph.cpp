@@ -0,0 +1,266 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANNTY OF ANY KIND, EXPRESS OR
+IMPLIED, INNCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANNY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER INN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR INN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <hc_am.hpp>
+
+#include "hip_runtime.h"
+#include "hcc_detail/hip_hcc.h"
+#include "hcc_detail/trace_helper.h"
+
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+// Stream capture and graphs
+//
+
+//---
+// Append a node to the graph.  Captured commands run in stream order, so the node depends on the previous one.
+void ihipGraph_t::addNode(ihipGraphNode_t &node)
+{
+    if (!_nodes.empty()) {
+        node._deps.push_back(_nodes.size() - 1);
+    }
+    _nodes.push_back(node);
+}
+
+
+//---
+// Resolve copy directions and agents once, so launches do not need the pointer lookups.
+ihipGraphExec_t::ihipGraphExec_t(const ihipGraph_t &graph) :
+    _device_index(graph._device_index),
+    _nodes(graph._nodes),
+    _copyCnt(0),
+    _nextSignalSet(0),
+    _kernelFutures(graph._nodes.size())
+{
+    ihipDevice_t *device = ihipGetDevice(_device_index);
+
+    std::vector<bool> hasSuccessor(_nodes.size(), false);
+    for (size_t i=0; i<_nodes.size(); i++) {
+        ihipGraphNode_t &node = _nodes[i];
+
+        for (auto d = node._deps.begin(); d != node._deps.end(); d++) {
+            hasSuccessor[*d] = true;
+        }
+
+        if (node._type == ihipGraphNodeCopy) {
+            AllocInfo dstPtrInfo;
+            AllocInfo srcPtrInfo;
+            bool dstTracked = ihipGetAllocInfo(node._dst, &dstPtrInfo);
+            bool srcTracked = ihipGetAllocInfo(node._src, &srcPtrInfo);
+
+            // Launches copy with one DMA, which needs both pointers in the GPU address space:
+            if (!dstTracked || !srcTracked) {
+                throw ihipException(hipErrorInvalidValue);
+            }
+
+            if (node._kind == hipMemcpyDefault) {
+                node._kind = device->_default_stream->resolveMemcpyDirection(srcPtrInfo._isInDeviceMem, dstPtrInfo._isInDeviceMem);
+            }
+            device->_default_stream->setCopyAgents(node._kind, &node._commandType, &node._srcAgent, &node._dstAgent);
+
+            node._copySlot = _copyCnt++;
+        }
+    }
+
+    for (size_t i=0; i<_nodes.size(); i++) {
+        if (!hasSuccessor[i]) {
+            _sinks.push_back(i);
+        }
+    }
+}
+
+
+//---
+// Barriers of a launch still in flight may read the copy signals, so wait for its sink barrier before destroying them.
+ihipGraphExec_t::~ihipGraphExec_t()
+{
+    for (auto set = _signalSets.begin(); set != _signalSets.end(); set++) {
+        set->_sink.wait(g_devices[_device_index].waitMode());
+        for (auto s = set->_signals.begin(); s != set->_signals.end(); s++) {
+            hsa_signal_destroy(*s);
+        }
+    }
+}
+
+
+//---
+// Return a set of copy completion signals that is not used by a launch still in flight.
+// The copies of a launch may complete before barriers which read their signals have been processed, so a set is
+// only idle once the launch's sink barrier has completed.
+// Sets are created on demand, up to MAX_GRAPH_SIGNAL_SETS, then the oldest set is waited for.
+ihipGraphExec_t::SignalSet &ihipGraphExec_t::nextSignalSet()
+{
+    for (size_t n=0; n<_signalSets.size(); n++) {
+        size_t index = (_nextSignalSet + n) % _signalSets.size();
+        SignalSet &set = _signalSets[index];
+
+        if (set._sink.completed()) {
+            _nextSignalSet = index + 1;
+            return set;
+        }
+    }
+
+    if (_signalSets.size() < MAX_GRAPH_SIGNAL_SETS) {
+        _signalSets.push_back(SignalSet());
+        SignalSet &set = _signalSets.back();
+        set._signals.resize(_copyCnt);
+        for (auto s = set._signals.begin(); s != set._signals.end(); s++) {
+            if (hsa_signal_create(0/*value*/, 0, NULL, &(*s)) != HSA_STATUS_SUCCESS) {
+                throw ihipException(hipErrorMemoryAllocation);
+            }
+        }
+        _nextSignalSet = _signalSets.size();
+        return set;
+    }
+
+    size_t index = _nextSignalSet % _signalSets.size();
+    SignalSet &set = _signalSets[index];
+    tprintf(DB_SYNC, "graph %p has %zu launches in flight, wait for the oldest\n", this, _signalSets.size());
+    set._sink.wait(g_devices[_device_index].waitMode());
+    _nextSignalSet = index + 1;
+    return set;
+}
+
+
+//---
+/**
+ * @return #hipSuccess, #hipErrorInvalidValue
+ */
+hipError_t hipStreamBeginCapture(hipStream_t stream)
+{
+    HIP_INIT_API(stream);
+
+    if ((stream == NULL) || stream->_capture) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    stream->_capture = new ihipGraph_t(stream->getDevice()->_device_index);
+
+    return ihipLogStatus(hipSuccess);
+}
+
+
+//---
+/**
+ * @return #hipSuccess, #hipErrorInvalidValue
+ */
+hipError_t hipStreamEndCapture(hipStream_t stream, hipGraph_t *graph)
+{
+    HIP_INIT_API(stream, graph);
+
+    if ((stream == NULL) || (graph == NULL) || (stream->_capture == NULL)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    *graph = stream->_capture;
+    stream->_capture = NULL;
+
+    return ihipLogStatus(hipSuccess);
+}
+
+
+//---
+/**
+ * @return #hipSuccess, #hipErrorInvalidValue, #hipErrorInvalidMemcpyDirection
+ */
+hipError_t hipGraphInstantiate(hipGraphExec_t *graphExec, hipGraph_t graph)
+{
+    HIP_INIT_API(graphExec, graph);
+
+    if ((graphExec == NULL) || (graph == NULL)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    hipError_t e = hipSuccess;
+    try {
+        *graphExec = new ihipGraphExec_t(*graph);
+    }
+    catch (ihipException ex) {
+        e = ex._code;
+    }
+
+    return ihipLogStatus(e);
+}
+
+
+//---
+/**
+ * @return #hipSuccess, #hipErrorInvalidValue
+ */
+hipError_t hipGraphLaunch(hipGraphExec_t graphExec, hipStream_t stream)
+{
+    HIP_INIT_API(graphExec, stream);
+
+    if ((graphExec == NULL) || (stream && stream->_capture)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    hipError_t e = hipSuccess;
+
+    stream = ihipSyncAndResolveStream(stream);
+    if (stream->getDevice()->_device_index != graphExec->_device_index) {
+        e = hipErrorInvalidValue;
+    } else {
+        try {
+            stream->locked_launchGraph(graphExec);
+        }
+        catch (ihipException ex) {
+            e = ex._code;
+        }
+    }
+
+    return ihipLogStatus(e);
+}
+
+
+//---
+/**
+ * @return #hipSuccess, #hipErrorInvalidValue
+ */
+hipError_t hipGraphExecDestroy(hipGraphExec_t graphExec)
+{
+    HIP_INIT_API(graphExec);
+
+    if (graphExec == NULL) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    delete graphExec;
+
+    return ihipLogStatus(hipSuccess);
+}
+
+
+//---
+/**
+ * @return #hipSuccess, #hipErrorInvalidValue
+ */
+hipError_t hipGraphDestroy(hipGraph_t graph)
+{
+    HIP_INIT_API(graph);
+
+    if (graph == NULL) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    delete graph;
+
+    return ihipLogStatus(hipSuccess);
+}
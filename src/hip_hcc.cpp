@@ -32,15 +32,20 @@ THE SOFTWARE.
 #include <list>
 #include <sys/types.h>
 #include <unistd.h>
+#include <glob.h>
 #include <deque>
 #include <vector>
 #include <algorithm>
+#include <thread>
+#include <condition_variable>
 
 #include <hc.hpp>
 #include <hc_am.hpp>
 
 #include "hip_runtime.h"
 #include "hcc_detail/hip_hcc.h"
+#include "hcc_detail/memory_pool.h"
+#include "hcc_detail/host_memcpy.h"
 #include "hsa_ext_amd.h"
 
 // HIP includes:
@@ -62,10 +67,27 @@ int HIP_TRACE_API= 0;
 int HIP_ATP_MARKER= 0;
 int HIP_DB= 0;
 int HIP_STAGING_SIZE = 64;   /* size of staging buffers, in KB */
-int HIP_STAGING_BUFFERS = 2;    // TODO - remove, two buffers should be enough.
+int HIP_STAGING_BUFFERS = 4;  /* number of staging buffers in each direction, up to StagingBuffer::_max_buffers */
 int HIP_PININPLACE = 0;
-int HIP_STREAM_SIGNALS = 2;  /* number of signals to allocate at stream creation */
+int HIP_PININPLACE_MAX_PINNED = 1024;  /* max host memory (in MB) pinned at once by pin-in-place copies */
+int HIP_COPY_TUNE = 0;  /* pick unpinned copy algorithm from a calibrated table: 1=load or calibrate, 2=recalibrate */
+int HIP_COPY_TUNE_DUMP = 0;  /* print the copy tuning table when it is loaded or calibrated */
+int HIP_STAGING_POOL = 4;  /* max staging buffers per direction, so streams can stage copies concurrently */
+int HIP_STAGING_ASYNC = 1;   /* hipMemcpyAsync with pageable memory runs staged copies on a worker thread */
+int HIP_STAGING_MT_THREADS = 0;  /* helper threads for the host side of large staged copies, 0=disable */
+int HIP_STAGING_MT_THRESHOLD = 4096;  /* min size of staged copy (in KB) that uses the helper threads */
+int HIP_STAGING_D2H_RING = 1;  /* 1=refill each D2H staging buffer as soon as it is unloaded, 0=refill after the whole batch */
+int HIP_NONTEMPORAL_COPY = 3; /* max HostMemcpyIsa for streaming-store copies, 0=libc memcpy */
+int HIP_STREAM_SIGNALS = 32;  /* number of signals moved between a stream's cache and the device signal pool at a time */
+int HIP_STREAM_SIGNALS_MAX = 4096;  /* max number of in-flight signals per stream */
 int HIP_VISIBLE_DEVICES = 0; /* Contains a comma-separated sequence of GPU identifiers */
+int HIP_SYNC_NULL_STREAM = 0; /* Use host-side synchronization for legacy NULL stream ordering */
+int HIP_MEMPOOL_RELEASE_THRESHOLD = -1; /* MB of freed hipMallocAsync memory to cache per device, -1=unlimited */
+int HIP_TRACK_HAZARDS = 0; /* create every stream with hipStreamTrackHazards */
+int HIP_CALLBACK_THREADS = 2; /* threads which run hipStreamAddCallback callbacks */
+int HIP_WAIT_MODE = 0; /* SignalWaitMode for devices with hipDeviceScheduleAuto */
+int HIP_WAIT_SPIN_US = 50; /* spin time of hybrid waits before blocking */
+int HIP_STREAM_QUEUES = 16; /* max HSA queues per device for created streams, 0=unlimited */
 
 
 //---
@@ -89,6 +111,8 @@ bool g_visible_device = false;
 unsigned g_deviceCnt;
 std::vector<int> g_hip_visible_devices;
 hsa_agent_t g_cpu_agent;
+ihipEventPool_t g_eventPool;
+AllocIndex g_allocIndex;
 
 
 
@@ -102,7 +126,7 @@ hsa_agent_t g_cpu_agent;
 //=================================================================================================
 //
 //---
-ihipSignal_t::ihipSignal_t() :  _sig_id(0)
+ihipSignal_t::ihipSignal_t() :  _sig_id(0), _generation(0), _holds(0)
 {
     if (hsa_signal_create(0/*value*/, 0, NULL, &_hsa_signal) != HSA_STATUS_SUCCESS) {
         throw ihipException(hipErrorOutOfResources);
@@ -120,15 +144,305 @@ ihipSignal_t::~ihipSignal_t()
 };
 
 
+//---
+// allocSignal bumps _generation before it checks _holds, and hold raises _holds before it checks _generation.
+// So either allocSignal sees the hold and skips the signal, or hold sees the new generation and fails.
+bool ihipSignal_t::hold(uint64_t generation)
+{
+    _holds++;
+    if (_generation.load() != generation) {
+        _holds--;
+        return false;
+    }
+    return true;
+}
+
+
+//---
+bool ihipSignal_t::completed(uint64_t generation) const
+{
+    // A value of 0 is final for this generation.  A non-zero value may belong to a later command, which is only
+    // allocated after this one completed:
+    return (hsa_signal_load_acquire(_hsa_signal) == 0) || (_generation.load() != generation);
+}
+
+
+//---
+void ihipSignal_t::unpin()
+{
+    for (auto iter=_pinned.begin(); iter!=_pinned.end(); iter++) {
+        (*iter)->unhold();
+    }
+    _pinned.clear();
+    _pinnedFutures.clear();
+}
+
+
+
+//=================================================================================================
+// ihipSignalRef_t:
+//=================================================================================================
+//---
+bool ihipSignalRef_t::completed() const
+{
+    if (_signal) {
+        return _signal->completed(_generation);
+    }
+
+    hsa_signal_t *kernelSignal = static_cast<hsa_signal_t*> (_future.get_native_handle());
+    return (kernelSignal == NULL) || (hsa_signal_load_acquire(*kernelSignal) == 0);
+}
+
+
+//---
+void ihipSignalRef_t::wait(SignalWaitMode mode) const
+{
+    if (_signal) {
+        if (_signal->hold(_generation)) {
+            SignalWait(_signal->_hsa_signal, mode);
+            _signal->unhold();
+        }
+    } else {
+        hsa_signal_t *kernelSignal = static_cast<hsa_signal_t*> (_future.get_native_handle());
+        if (kernelSignal) {
+            SignalWait(*kernelSignal, mode);
+        }
+    }
+}
+
+
+//---
+// Add dep to the dependencies of a packet which completes on completion, a signal allocated by the enqueuing
+// stream.  dep is held until completion is reclaimed, so it is not reused while the packet may still read it.
+// Returns false if dep has been reused already, which means it completed and the packet need not wait for it.
+static bool ihipAddDep(ihipSignal_t *completion, const ihipSignalRef_t &dep, std::vector<hsa_signal_t> &depSignals)
+{
+    hsa_signal_t signal;
+    if (dep._signal) {
+        if (!dep._signal->hold(dep._generation)) {
+            return false;
+        }
+        completion->_pinned.push_back(dep._signal);
+        signal = dep._signal->_hsa_signal;
+    } else {
+        hsa_signal_t *kernelSignal = static_cast<hsa_signal_t*> (dep._future.get_native_handle());
+        if (kernelSignal == NULL) {
+            return false;
+        }
+        completion->_pinnedFutures.push_back(dep._future);
+        signal = *kernelSignal;
+    }
+
+    for (auto s = depSignals.begin(); s != depSignals.end(); s++) {
+        if (s->handle == signal.handle) {
+            return true;
+        }
+    }
+    depSignals.push_back(signal);
+
+    return true;
+}
+
+
+//---
+// Create new signals if the free list is too small, so the pool grows on demand.
+void ihipSignalPool_t::locked_acquire(std::vector<ihipSignal_t*> &cache, size_t cnt)
+{
+    std::lock_guard<std::mutex> l(_mutex);
+
+    while (_freeList.size() < cnt) {
+        _signals.emplace_back();
+        _freeList.push_back(&_signals.back());
+    }
+
+    if (_signals.size() > 10000) {
+        fprintf (stderr, "warning: signal pool size=%zu, may indicate runaway number of inflight commands\n", _signals.size());
+    }
+
+    cache.insert(cache.end(), _freeList.end() - cnt, _freeList.end());
+    _freeList.resize(_freeList.size() - cnt);
+
+    tprintf (DB_SIGNAL, "signal pool: acquire %zu signals (%zu free / %zu total)\n", cnt, _freeList.size(), _signals.size());
+}
+
+
+//---
+void ihipSignalPool_t::locked_release(std::vector<ihipSignal_t*> &cache, size_t cnt)
+{
+    std::lock_guard<std::mutex> l(_mutex);
+
+    cnt = std::min(cnt, cache.size());
+    _freeList.insert(_freeList.end(), cache.end() - cnt, cache.end());
+    cache.resize(cache.size() - cnt);
+
+    tprintf (DB_SIGNAL, "signal pool: release %zu signals (%zu free / %zu total)\n", cnt, _freeList.size(), _signals.size());
+}
+
+
+
+//=================================================================================================
+// ihipQueue_t:
+//=================================================================================================
+//---
+// Event barriers read their end timestamp from the packet processor, which only records it with profiling on.
+// Profiling adds work to every packet in the queue, so it stays off until an event with timing is recorded.
+void ihipQueue_t::enableProfiling()
+{
+    if (!_profiling) {
+        hsa_status_t hsa_status = hsa_amd_profiling_set_profiler_enabled((hsa_queue_t*)_av.get_hsa_queue(), 1);
+        if (hsa_status != HSA_STATUS_SUCCESS) {
+            tprintf (DB_SYNC, "queue %p: could not enable profiling, status=%x\n", this, hsa_status);
+        }
+        _profiling = true;  // do not retry on every record.
+    }
+}
+
+
+
+//=================================================================================================
+// ihipQueuePool_t:
+//=================================================================================================
+//---
+void ihipQueuePool_t::init(hc::accelerator &acc, int maxQueues)
+{
+    _acc = acc;
+    _maxQueues = (maxQueues > 0) ? maxQueues : 0;
+    _default_queue = new ihipQueue_t(acc.get_default_view(), hipStreamPriorityNormal);
+    for (int i=0; i<_numPriorities; i++) {
+        _queueCnt[i] = 0;
+    }
+}
+
+
+//---
+ihipQueue_t *ihipQueuePool_t::createQueue(int priority)
+{
+    //Note this is an execute_in_order queue, so all kernels submitted will atuomatically wait for prev to complete:
+    _queues.emplace_back(_acc.create_view(), priority);
+    ihipQueue_t *queue = &_queues.back();
+    _queueCnt[priority - hipStreamPriorityHigh]++;
+
+    if (priority != hipStreamPriorityNormal) {
+        hsa_amd_queue_priority_t hsaPriority = (priority < hipStreamPriorityNormal) ? HSA_AMD_QUEUE_PRIORITY_HIGH : HSA_AMD_QUEUE_PRIORITY_LOW;
+        hsa_status_t hsa_status = hsa_amd_queue_set_priority((hsa_queue_t*)queue->_av.get_hsa_queue(), hsaPriority);
+        if (hsa_status != HSA_STATUS_SUCCESS) {
+            // Still a dedicated queue, so the stream does not wait behind other priorities - just not favored by the GPU.
+            tprintf (DB_SYNC, "queue pool: could not set priority %d on queue %p, status=%x\n", priority, queue, hsa_status);
+        }
+    }
+
+    return queue;
+}
+
+
+//---
+ihipQueue_t *ihipQueuePool_t::locked_acquire(int priority)
+{
+    std::lock_guard<std::mutex> l(_mutex);
+
+    int p = priority - hipStreamPriorityHigh;
+
+    ihipQueue_t *queue = NULL;
+    if (!_idle[p].empty()) {
+        queue = _idle[p].back();
+        _idle[p].pop_back();
+    } else if ((_maxQueues == 0) || (_queueCnt[p] < _maxQueues)) {
+        queue = createQueue(priority);
+    } else {
+        for (auto iter=_queues.begin(); iter!=_queues.end(); iter++) {
+            if ((iter->_priority == priority) && (!queue || (iter->_streamCnt < queue->_streamCnt))) {
+                queue = &(*iter);
+            }
+        }
+    }
+    queue->_streamCnt++;
+
+    tprintf (DB_SYNC, "queue pool: acquire queue %p priority %d (%d streams, %zu queues, %zu idle)\n",
+             queue, priority, queue->_streamCnt.load(), _queueCnt[p], _idle[p].size());
+
+    return queue;
+}
+
+
+//---
+void ihipQueuePool_t::locked_release(ihipQueue_t *queue)
+{
+    if (queue == _default_queue) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> l(_mutex);
+
+    if (--queue->_streamCnt == 0) {
+        _idle[queue->_priority - hipStreamPriorityHigh].push_back(queue);
+    }
+}
+
+
+
+//=================================================================================================
+// ihipEventPool_t:
+//=================================================================================================
+//---
+ihipEvent_t *ihipEventPool_t::locked_acquire()
+{
+    std::lock_guard<std::mutex> l(_mutex);
+
+    ihipEvent_t *eh;
+    if (!_freeList.empty()) {
+        eh = _freeList.back();
+        _freeList.pop_back();
+    } else {
+        _events.emplace_back();
+        eh = &_events.back();
+    }
+
+    tprintf (DB_SIGNAL, "event pool: acquire event %p (%zu free / %zu total)\n", eh, _freeList.size(), _events.size());
+
+    return eh;
+}
+
+
+//---
+void ihipEventPool_t::locked_release(ihipEvent_t *eh)
+{
+    std::lock_guard<std::mutex> l(_mutex);
+    std::lock_guard<std::mutex> el(eh->_mutex);
+
+    ihipEventUnhold(eh);
+    eh->_state = hipEventStatusUnitialized;
+    _freeList.push_back(eh);
+}
+
+
+//---
+// Release the signals a timed event holds for its timestamps.  Caller must hold eh->_mutex.
+void ihipEventUnhold(ihipEvent_t *eh)
+{
+    if (eh->_held) {
+        eh->_signal._signal->unhold();
+        if (eh->_copy._signal) {
+            eh->_copy._signal->unhold();
+        }
+        eh->_held = false;
+    }
+    eh->_copy = ihipSignalRef_t();
+}
+
+
 
 //=================================================================================================
 // ihipStream_t:
 //=================================================================================================
 //---
-ihipStream_t::ihipStream_t(unsigned device_index, hc::accelerator_view av, unsigned int flags) :
+ihipStream_t::ihipStream_t(unsigned device_index, ihipQueue_t *queue, unsigned int flags) :
     _id(0), // will be set by add function.
-    _av(av),
+    _queue(queue),
+    _av(queue->_av),
     _flags(flags),
+    _trackHazards((flags & hipStreamTrackHazards) || HIP_TRACK_HAZARDS),
+    _capture(NULL),
+    _asyncError(hipSuccess),
     _device_index(device_index)
 {
     tprintf(DB_SYNC, " streamCreate: stream=%p\n", this);
@@ -136,45 +450,123 @@ ihipStream_t::ihipStream_t(unsigned device_index, hc::accelerator_view av, unsig
 
 
 //---
+// Streams are drained before they are deleted, but wait for stragglers anyway since the
+// signals go back to the device pool and may be handed to another stream.
 ihipStream_t::~ihipStream_t()
 {
+    LockedAccessor_StreamCrit_t crit(_criticalData);
+
+    delete _capture;  // capture was never ended.
+
+    for (auto iter=crit->_inflightSignals.begin(); iter!=crit->_inflightSignals.end(); iter++) {
+        SignalWait((*iter)->_hsa_signal, waitMode());
+        (*iter)->unpin();
+        crit->_signalCache.push_back(*iter);
+    }
+    crit->_inflightSignals.clear();
+
+    // Held signals may still be read by other streams' packets - whichever stream allocates them next checks the hold:
+    crit->_signalCache.insert(crit->_signalCache.end(), crit->_heldSignals.begin(), crit->_heldSignals.end());
+    crit->_heldSignals.clear();
+
+    g_devices[_device_index]._signal_pool.locked_release(crit->_signalCache, crit->_signalCache.size());
+    g_devices[_device_index]._queue_pool.locked_release(_queue);
+}
+
+
+
+//---
+// Number of signals moved between the stream cache and the device pool at once.
+// High-priority streams keep a deeper cache, so they take the device pool mutex half as often.
+size_t ihipStream_t::signalBatch() const
+{
+    size_t batch = HIP_STREAM_SIGNALS > 0 ? HIP_STREAM_SIGNALS : 1;
+    return highPriority() ? 2*batch : batch;
 }
 
 
+//---
+// Return completed signals to the stream's cache.
+// Commands complete in-order so the scan stops at the first signal which is still in-flight - this is
+// O(1) per reclaimed signal and never touches signals that are still live.
+void ihipStream_t::reclaimSignals(LockedAccessor_StreamCrit_t &crit)
+{
+    while (!crit->_inflightSignals.empty()) {
+        ihipSignal_t *signal = crit->_inflightSignals.front();
+        if (hsa_signal_load_acquire(signal->_hsa_signal) != 0) {
+            break;
+        }
+
+        if (signal == crit->_last_copy_signal) {
+            // Last copy has completed, so future commands do not need a dependency on it.
+            crit->_last_copy_signal = NULL;
+        }
+
+        // The packet has been processed, so the signals it depends on can be reused:
+        signal->unpin();
+
+        crit->_inflightSignals.pop_front();
+        crit->_signalCache.push_back(signal);
+    }
+
+    for (auto iter=crit->_heldSignals.begin(); iter!=crit->_heldSignals.end(); ) {
+        if ((*iter)->_holds.load() == 0) {
+            crit->_signalCache.push_back(*iter);
+            iter = crit->_heldSignals.erase(iter);
+        } else {
+            iter++;
+        }
+    }
+
+    crit->_oldest_live_sig_id = crit->_inflightSignals.empty() ?
+                                crit->_stream_sig_id + 1 : crit->_inflightSignals.front()->_sig_id;
+
+    // Keep the stream cache bounded - hand surplus signals back to the device so other streams can use them.
+    size_t batch = signalBatch();
+    if (crit->_signalCache.size() > 2*batch) {
+        g_devices[_device_index]._signal_pool.locked_release(crit->_signalCache, crit->_signalCache.size() - batch);
+    }
+}
+
 
 //---
-void ihipStream_t::locked_reclaimSignals(SIGSEQNUM sigNum)
+void ihipStream_t::locked_reclaimSignals()
 {
     LockedAccessor_StreamCrit_t crit(_criticalData);
 
-    tprintf(DB_SIGNAL, "reclaim signal #%lu\n", sigNum);
-    // Mark all signals older and including this one as available for re-allocation.
-    crit->_oldest_live_sig_id = sigNum+1;
+    reclaimSignals(crit);
 }
 
 
 //---
 void ihipStream_t::waitCopy(LockedAccessor_StreamCrit_t &crit, ihipSignal_t *signal)
 {
-    hsa_signal_wait_acquire(signal->_hsa_signal, HSA_SIGNAL_CONDITION_LT, 1, UINT64_MAX, HSA_WAIT_STATE_ACTIVE);
+    SignalWait(signal->_hsa_signal, waitMode());
 
-    SIGSEQNUM sigNum = signal->_sig_id;
-
-    tprintf(DB_SIGNAL, "waitCopy reclaim signal #%lu\n", sigNum);
-    // Mark all signals older and including this one as available for reclaim
-    if (sigNum > crit->_oldest_live_sig_id) {
-        crit->_oldest_live_sig_id = sigNum+1; // TODO, +1 here seems dangerous.
-    }
+    tprintf(DB_SIGNAL, "waitCopy reclaim signal #%lu\n", signal->_sig_id);
 
+    // This signal and all older signals have completed:
+    reclaimSignals(crit);
 }
 
 //Wait for all kernel and data copy commands in this stream to complete.
 //This signature should be used in routines that already have locked the stream mutex
 void ihipStream_t::wait(LockedAccessor_StreamCrit_t &crit, bool assertQueueEmpty)
 {
+    joinHazards(crit);
+
     if (! assertQueueEmpty) {
         tprintf (DB_SYNC, "stream %p wait for queue-empty..\n", this);
-        _av.wait();
+        // Wait for the last command with the device wait mode, so the queue is already drained when HCC waits:
+        ihipSignalRef_t fence;
+        if (fenceSignal(crit, &fence)) {
+            fence.wait(waitMode());
+        }
+        // A shared queue also holds other streams' commands, the fence already covers this stream:
+        // If another stream joins after the load, its commands came after this wait started anyway.
+        if (_queue->_streamCnt.load() <= 1) {
+            _av.wait();
+        }
     }
     if (crit->_last_copy_signal) {
         tprintf (DB_SYNC, "stream %p wait for lastCopy:#%lu...\n", this, lastCopySeqId(crit) );
@@ -184,6 +576,8 @@ void ihipStream_t::wait(LockedAccessor_StreamCrit_t &crit, bool assertQueueEmpty
     // Reset the stream to "empty" - next command will not set up an inpute dependency on any older signal.
     crit->_last_command_type = ihipCommandCopyH2D;
     crit->_last_copy_signal = NULL;
+
+    reclaimSignals(crit);
 }
 
 
@@ -270,77 +664,351 @@ ihipDevice_t * ihipStream_t::getDevice() const
 };
 
 
+//---
+SignalWaitMode ihipStream_t::waitMode() const
+{
+    return g_devices[_device_index].waitMode();
+}
+
+
 //---
 // Allocate a new signal from the signal pool.
-// Returned signals have value of 0.
+// Returned signals have value of 0, and the caller must set the signal before submitting a command which
+// decrements it.  A signal left at 0 is treated as completed and is reclaimed on the next allocation.
 // Signals are intended for use in this stream and are always reclaimed "in-order".
 ihipSignal_t *ihipStream_t::allocSignal(LockedAccessor_StreamCrit_t &crit)
 {
-    int numToScan = crit->_signalPool.size();
+    reclaimSignals(crit);
+
+    // Bound the number of in-flight signals - throttle the host until the oldest command retires.
+    if ((HIP_STREAM_SIGNALS_MAX > 0) && (crit->_inflightSignals.size() >= (size_t)HIP_STREAM_SIGNALS_MAX)) {
+        tprintf(DB_SIGNAL, "stream %p reached %zu in-flight signals, wait for #%lu\n",
+                this, crit->_inflightSignals.size(), crit->_inflightSignals.front()->_sig_id);
+        waitCopy(crit, crit->_inflightSignals.front());
+    }
+
+    ihipSignal_t *signal;
+    while (1) {
+        if (crit->_signalCache.empty()) {
+            g_devices[_device_index]._signal_pool.locked_acquire(crit->_signalCache, signalBatch());
+        }
+
+        signal = crit->_signalCache.back();
+        crit->_signalCache.pop_back();
+
+        // New generation first, see ihipSignal_t::hold:
+        signal->_generation++;
+        if (signal->_holds.load() == 0) {
+            break;
+        }
+
+        // A queued packet may still read it, set it aside until the hold is released:
+        tprintf(DB_SIGNAL, "signal %lu is held, skip\n", signal->_hsa_signal.handle);
+        crit->_heldSignals.push_back(signal);
+    }
+
+    signal->_sig_id = ++crit->_stream_sig_id;  // allocate it.
+    crit->_inflightSignals.push_back(signal);
+
+    tprintf(DB_SIGNAL, "allocatSignal #%lu (in-flight:%zu oldest_live:%lu)\n",
+            signal->_sig_id, crit->_inflightSignals.size(), crit->_oldest_live_sig_id);
+
+    return signal;
+}
+
+
+//---
+// Insert barrier-AND packet(s) into the queue which wait for all of the depSignals to resolve.
+// Each barrier packet holds up to 5 dependencies, so larger sets are split across back-to-back packets.
+// The barrier bit is set on each packet so later packets in the queue do not start until the dependencies resolve.
+// completionSignal (may be 0) is attached to the last packet only.
+// Must be called with the stream lock held, since this writes directly into the stream's queue.
+void ihipStream_t::enqueueBarrier(hsa_queue_t* queue, int depSignalCnt, const hsa_signal_t *depSignals, hsa_signal_t completionSignal)
+{
+    std::lock_guard<std::recursive_mutex> l(_queue->_mutex);
+
+    const int maxDeps = sizeof(((hsa_barrier_and_packet_t*)0)->dep_signal) / sizeof(hsa_signal_t);
+    const uint32_t queueMask = queue->size - 1;
+
+    int depIndex = 0;
     do {
-        auto thisCursor = crit->_signalCursor;
-        if (++crit->_signalCursor == crit->_signalPool.size()) {
-            crit->_signalCursor = 0;
+        // Obtain the write index for the command queue
+        uint64_t index = hsa_queue_load_write_index_relaxed(queue);
+
+        // Wait for the queue to have room for another packet:
+        while ((index - hsa_queue_load_read_index_relaxed(queue)) >= queue->size) {
+            std::this_thread::yield();
         }
 
-        if (crit->_signalPool[thisCursor]._sig_id < crit->_oldest_live_sig_id) {
-            SIGSEQNUM oldSigId = crit->_signalPool[thisCursor]._sig_id;
-            crit->_signalPool[thisCursor]._index = thisCursor;
-            crit->_signalPool[thisCursor]._sig_id  =  ++crit->_stream_sig_id;  // allocate it.
-            tprintf(DB_SIGNAL, "allocatSignal #%lu at pos:%i (old sigId:%lu < oldest_live:%lu)\n",
-                    crit->_signalPool[thisCursor]._sig_id,
-                    thisCursor, oldSigId, crit->_oldest_live_sig_id);
+        // Define the barrier packet to be at the calculated queue index address
+        hsa_barrier_and_packet_t* barrier = &(((hsa_barrier_and_packet_t*)(queue->base_address))[index&queueMask]);
+        memset(((char*)barrier) + sizeof(barrier->header), 0, sizeof(hsa_barrier_and_packet_t) - sizeof(barrier->header));
+
+        for (int i=0; (i<maxDeps) && (depIndex<depSignalCnt); i++) {
+            barrier->dep_signal[i] = depSignals[depIndex++];
+        }
+
+        bool lastPacket = (depIndex >= depSignalCnt);
+        barrier->completion_signal.handle = lastPacket ? completionSignal.handle : 0;
+
+        // setup header
+        uint16_t header = HSA_PACKET_TYPE_BARRIER_AND << HSA_PACKET_HEADER_TYPE;
+        header |= 1 << HSA_PACKET_HEADER_BARRIER;
+        //header |= HSA_FENCE_SCOPE_SYSTEM << HSA_PACKET_HEADER_ACQUIRE_FENCE_SCOPE;
+        //header |= HSA_FENCE_SCOPE_SYSTEM << HSA_PACKET_HEADER_RELEASE_FENCE_SCOPE;
+        if (lastPacket && completionSignal.handle) {
+            // Make the results of the dependent commands visible to the host when the completion signal fires.
+            header |= HSA_FENCE_SCOPE_SYSTEM << HSA_PACKET_HEADER_RELEASE_FENCE_SCOPE;
+        }
+
+        // Header is written last so the packet processor does not see a partially-constructed packet:
+        __atomic_store_n(&barrier->header, header, __ATOMIC_RELEASE);
+
+        // Increment write index and ring doorbell to dispatch the barrier
+        hsa_queue_store_write_index_relaxed(queue, index+1);
+        hsa_signal_store_relaxed(queue->doorbell_signal, index);
+    } while (depIndex < depSignalCnt);
+}
+
+
+//---
+// Make future commands in this stream wait for the commands referenced by deps, which may belong to other streams.
+// The wait is enqueued on the device with a barrier packet, the host does not block.  The barrier holds the signals
+// of the commands until it has been processed, so their streams can not reuse them for later commands meanwhile.
+void ihipStream_t::locked_waitSignals(const std::vector<ihipSignalRef_t> &deps)
+{
+    if (deps.empty()) {
+        return;
+    }
 
+    LockedAccessor_StreamCrit_t crit(_criticalData);
+
+    // The barrier becomes the new fence, so it must also cover tracked copies on the DMA engines:
+    joinHazards(crit);
 
+    if (HIP_DISABLE_HW_KERNEL_DEP == -1) {
+        tprintf (DB_SYNC, "stream %p wait on %zu signals (IGNORE dependency)\n", this, deps.size());
+    } else if (HIP_DISABLE_HW_KERNEL_DEP > 0) {
+        tprintf (DB_SYNC, "stream %p wait on %zu signals (HOST wait)\n", this, deps.size());
+        for (auto dep = deps.begin(); dep != deps.end(); dep++) {
+            dep->wait(waitMode());
+        }
+    } else {
+        // The barrier orders subsequent kernels since they are in the same queue.
+        // Copies are sent to a different engine, so the barrier also gets a completion signal that
+        // subsequent copies can depend on.  Track this like a copy signal so the dependency logic and
+        // stream wait see it.
+        ihipSignal_t *ihipSignal = allocSignal(crit);
 
-            return &crit->_signalPool[thisCursor];
+        std::vector<hsa_signal_t> depSignals;
+        for (auto dep = deps.begin(); dep != deps.end(); dep++) {
+            if (!dep->completed()) {
+                ihipAddDep(ihipSignal, *dep, depSignals);
+            }
         }
+        if (depSignals.empty()) {
+            // Everything completed already, the unused signal stays at 0 and is reclaimed.
+            return;
+        }
+        hsa_signal_store_relaxed(ihipSignal->_hsa_signal, 1);
 
-    } while (--numToScan) ;
+        hsa_queue_t * q =  (hsa_queue_t*)_av.get_hsa_queue();
+        this->enqueueBarrier(q, depSignals.size(), depSignals.data(), ihipSignal->_hsa_signal);
 
-    assert(numToScan == 0);
+        tprintf (DB_SYNC, "stream %p barrier pkt inserted with wait on %zu signals, completion=#%lu\n", this, depSignals.size(), ihipSignal->_sig_id);
 
-    // Have to grow the pool:
-    crit->_signalCursor = crit->_signalPool.size(); // set to the beginning of the new entries:
-    if (crit->_signalCursor > 10000) {
-        fprintf (stderr, "warning: signal pool size=%d, may indicate runaway number of inflight commands\n", crit->_signalCursor);
+        crit->_last_command_type = ihipCommandBarrier;
+        crit->_last_copy_signal  = ihipSignal;
     }
-    crit->_signalPool.resize(crit->_signalPool.size() * 2);
-    tprintf (DB_SIGNAL, "grow signal pool to %zu entries, cursor=%d\n", crit->_signalPool.size(), crit->_signalCursor);
-    return allocSignal(crit);  // try again,
+}
+
+
+//---
+// Make future commands in this stream wait for the specified event to complete.
+// The event may have been recorded on another stream, or even another device.
+void ihipStream_t::locked_waitEvent(ihipEvent_t *eh)
+{
+    ihipSignalRef_t signal;
+    {
+        std::lock_guard<std::mutex> el(eh->_mutex);
 
-    // Should never reach here.
-    assert(0);
+        // Commands in the same stream are already in-order.
+        if ((eh->_state != hipEventStatusRecording) || (eh->_stream == this)) {
+            return;
+        }
+        signal = eh->_signal;
+        tprintf (DB_SYNC, "stream %p wait event on stream %p\n", this, eh->_stream);
+    }
+
+    // The event barrier covers the kernels and copies before the record.  Each record has a signal of its own, which
+    // the wait barrier holds, so a later record or a reuse of the signal can not change what the barrier waits for.
+    locked_waitSignals(std::vector<ihipSignalRef_t>(1, signal));
 }
 
 
 //---
-void ihipStream_t::enqueueBarrier(hsa_queue_t* queue, ihipSignal_t *depSignal)
+// hipStreamAddCallback:
+// The callback marker is a barrier packet whose completion signal starts at 2.  The stream decrements it to 1 when it
+// reaches the marker, which fires an HSA async handler.  The handler runs on the HSA runtime's shared handler thread,
+// so it only queues the callback for the callback threads.  Once the callback returns the signal is decremented to 0,
+// which releases commands ordered behind a blocking callback and lets the stream reclaim the signal.
+struct ihipCallback_t {
+    hipStream_t             _stream;     // stream as passed by the user, may be NULL.
+    hipStreamCallback_t     _callback;
+    void                   *_userData;
+    hsa_signal_t            _signal;
+};
+
+
+class ihipCallbackPool_t {
+public:
+    ihipCallbackPool_t(int numThreads)
+    {
+        for (int i=0; i<numThreads; i++) {
+            // Callbacks may still be queued at exit, so the threads are never joined.
+            std::thread(&ihipCallbackPool_t::worker, this).detach();
+        }
+    }
+
+    void locked_enqueue(ihipCallback_t *callback)
+    {
+        {
+            std::lock_guard<std::mutex> l(_mutex);
+            _pending.push_back(callback);
+        }
+        _cv.notify_one();
+    }
+
+private:
+    void worker()
+    {
+        std::unique_lock<std::mutex> l(_mutex);
+        while (1) {
+            _cv.wait(l, [this] { return !_pending.empty(); });
+            ihipCallback_t *callback = _pending.front();
+            _pending.pop_front();
+            l.unlock();
+
+            tprintf(DB_SYNC, "stream %p run callback, signal=%lu\n", callback->_stream, callback->_signal.handle);
+            callback->_callback(callback->_stream, hipSuccess, callback->_userData);
+            hsa_signal_subtract_release(callback->_signal, 1);
+            delete callback;
+
+            l.lock();
+        }
+    }
+
+    std::mutex                  _mutex;
+    std::condition_variable     _cv;
+    std::deque<ihipCallback_t*> _pending;
+};
+
+
+// Created on first use and never destroyed, the detached threads reference it until exit.
+static ihipCallbackPool_t *g_callbackPool = NULL;
+static std::once_flag g_callbackPoolInit;
+
+
+static bool ihipCallbackHandler(hsa_signal_value_t value, void *arg)
 {
+    g_callbackPool->locked_enqueue(static_cast<ihipCallback_t*> (arg));
+
+    return false;  // one-shot, the signal is recycled after the callback.
+}
+
+
+//---
+// Call callback on a callback thread once all earlier commands in the stream have completed.
+void ihipStream_t::locked_addCallback(hipStream_t userStream, hipStreamCallback_t callback, void *userData, unsigned flags)
+{
+    std::call_once(g_callbackPoolInit, [] () {
+        g_callbackPool = new ihipCallbackPool_t(HIP_CALLBACK_THREADS > 0 ? HIP_CALLBACK_THREADS : 1);
+    });
+
+    LockedAccessor_StreamCrit_t crit(_criticalData);
+
+    // The marker must follow tracked copies as well:
+    joinHazards(crit);
+
+    // Allocate the marker first - allocSignal may recycle signals of completed commands.
+    ihipSignal_t *ihipSignal = allocSignal(crit);
+    hsa_signal_store_relaxed(ihipSignal->_hsa_signal, 2);
+
+    // Kernels and barriers are ahead of the marker in the queue, a copy fence is not:
+    std::vector<hsa_signal_t> depSignals;
+    if ((crit->_last_command_type != ihipCommandKernel) && (crit->_last_command_type != ihipCommandBarrier) &&
+        crit->_last_copy_signal) {
+        ihipAddDep(ihipSignal, ihipSignalRef_t(crit->_last_copy_signal), depSignals);
+    }
+    int depSignalCnt = depSignals.size();
+
+    hsa_queue_t * q =  (hsa_queue_t*)_av.get_hsa_queue();
+    this->enqueueBarrier(q, depSignalCnt, depSignals.data(), ihipSignal->_hsa_signal);
+
+    ihipCallback_t *ihipCallback = new ihipCallback_t;
+    ihipCallback->_stream   = userStream;
+    ihipCallback->_callback = callback;
+    ihipCallback->_userData = userData;
+    ihipCallback->_signal   = ihipSignal->_hsa_signal;
+
+    hsa_status_t hsa_status = hsa_amd_signal_async_handler(ihipSignal->_hsa_signal, HSA_SIGNAL_CONDITION_LT, 2,
+                                                           ihipCallbackHandler, ihipCallback);
+    if (hsa_status != HSA_STATUS_SUCCESS) {
+        // Let the marker complete without the callback so in-order reclaim does not stall on it:
+        hsa_signal_subtract_relaxed(ihipSignal->_hsa_signal, 1);
+        delete ihipCallback;
+        throw ihipException(hipErrorRuntimeOther);
+    }
+
+    tprintf (DB_SYNC, "stream %p add %s callback, marker waits on %d copies, completion=#%lu\n",
+             this, (flags & hipStreamCallbackBlocking) ? "blocking" : "non-blocking", depSignalCnt, ihipSignal->_sig_id);
+
+    if (flags & hipStreamCallbackBlocking) {
+        // The marker signal only reaches 0 after the callback, so it is the new fence:
+        crit->_last_command_type = ihipCommandCallback;
+        crit->_last_copy_signal  = ihipSignal;
+    }
+}
+
+
+//---
+// Return the completion signal of the last command sent to this stream, if that command is still in-flight.
+// Commands in a stream complete in-order, so this signal resolves only after all previous commands in the stream.
+// Returns false if the stream is idle (or the last command has already completed).
+bool ihipStream_t::lastCompletionSignal(LockedAccessor_StreamCrit_t &crit, ihipSignalRef_t *ref)
+{
+    joinHazards(crit);
+
+    return fenceSignal(crit, ref);
+}
 
-    // Obtain the write index for the command queue
-    uint64_t index = hsa_queue_load_write_index_relaxed(queue);
-    const uint32_t queueMask = queue->size - 1;
 
-    // Define the barrier packet to be at the calculated queue index address
-    hsa_barrier_and_packet_t* barrier = &(((hsa_barrier_and_packet_t*)(queue->base_address))[index&queueMask]);
-    memset(barrier, 0, sizeof(hsa_barrier_and_packet_t));
+//---
+// Return the completion of the last command that is not tracked in _hazards, if it is still in-flight.
+// Without hipStreamTrackHazards this is the last command sent to the stream.
+bool ihipStream_t::fenceSignal(LockedAccessor_StreamCrit_t &crit, ihipSignalRef_t *ref)
+{
+    if (crit->_last_command_type == ihipCommandKernel) {
+        if (crit->_last_kernel_future.get_native_handle() == NULL) {
+            return false;
+        }
+        *ref = ihipSignalRef_t(crit->_last_kernel_future);
+    } else if (crit->_last_copy_signal) {
+        *ref = ihipSignalRef_t(crit->_last_copy_signal);
+    } else {
+        return false;
+    }
 
-    // setup header
-    uint16_t header = HSA_PACKET_TYPE_BARRIER_AND << HSA_PACKET_HEADER_TYPE;
-    header |= 1 << HSA_PACKET_HEADER_BARRIER;
-    //header |= HSA_FENCE_SCOPE_SYSTEM << HSA_PACKET_HEADER_ACQUIRE_FENCE_SCOPE;
-    //header |= HSA_FENCE_SCOPE_SYSTEM << HSA_PACKET_HEADER_RELEASE_FENCE_SCOPE;
-    barrier->header = header;
+    return !ref->completed();
+}
 
-    barrier->dep_signal[0] = depSignal->_hsa_signal;
 
-    barrier->completion_signal.handle = 0;
+//---
+bool ihipStream_t::locked_lastCompletionSignal(ihipSignalRef_t *ref)
+{
+    LockedAccessor_StreamCrit_t crit(_criticalData);
 
-    // TODO - check queue overflow, return error:
-    // Increment write index and ring doorbell to dispatch the kernel
-    hsa_queue_store_write_index_relaxed(queue, index+1);
-    hsa_signal_store_relaxed(queue->doorbell_signal, index);
+    return lastCompletionSignal(crit, ref);
 }
 
 
@@ -354,15 +1022,49 @@ bool ihipStream_t::lockopen_preKernelCommand()
 {
     LockedAccessor_StreamCrit_t crit(_criticalData, false/*no unlock at destruction*/);
 
+    // Held until lockclose_postKernelCommand, so other streams on the queue do not write packets during the dispatch:
+    _queue->_mutex.lock();
+
+    if (_trackHazards && !crit->_hazards.empty()) {
+        // Tracked kernels are ordered by the kernel queue, only copies on the DMA engines need a barrier.
+        // An annotated kernel waits for the copies that overlap its ranges, any other kernel waits for all of them.
+        std::vector<ihipSignalRef_t> deps;
+        ihipSignalRef_t ref;
+        bool annotated = !crit->_kernelRanges.empty();
+        for (auto hazard = crit->_hazards.begin(); hazard != crit->_hazards.end(); hazard++) {
+            if (!hazard->_copy_signal) {
+                continue;
+            }
+            bool overlap = !annotated;
+            for (auto range = crit->_kernelRanges.begin(); !overlap && (range != crit->_kernelRanges.end()); range++) {
+                overlap = hazard->overlaps(range->_start, range->_end, range->_write);
+            }
+            if (overlap && liveHazardSignal(crit, *hazard, &ref)) {
+                deps.push_back(ref);
+            }
+        }
+
+        tprintf (DB_SYNC, "stream %p %s kernel waits on %zu of %zu tracked ranges\n",
+                 this, annotated ? "annotated" : "unannotated", deps.size(), crit->_hazards.size());
+        waitSignals(crit, deps);
+
+        if (!annotated) {
+            // This kernel becomes the fence for everything issued before it.
+            crit->_hazards.clear();
+        }
+    }
+    crit->_annotatedKernel = _trackHazards && !crit->_kernelRanges.empty();
+
     bool addedSync = false;
     // If switching command types, we need to add a barrier packet to synchronize things.
+    // Barriers are already in the kernel queue so the kernel is ordered behind them.
     if (crit->_last_command_type != ihipCommandKernel) {
-        if (crit->_last_copy_signal) {
+        if (crit->_last_copy_signal && (crit->_last_command_type != ihipCommandBarrier)) {
             addedSync = true;
 
-            hsa_queue_t * q =  (hsa_queue_t*)_av.get_hsa_queue();
             if (HIP_DISABLE_HW_KERNEL_DEP == 0) {
-                this->enqueueBarrier(q, crit->_last_copy_signal);
+                std::vector<ihipSignalRef_t> deps(1, ihipSignalRef_t(crit->_last_copy_signal));
+                waitSignals(crit, deps);
                 tprintf (DB_SYNC, "stream %p switch %s to %s (barrier pkt inserted with wait on #%lu)\n",
                         this, ihipCommandName[crit->_last_command_type], ihipCommandName[ihipCommandKernel], crit->_last_copy_signal->_sig_id)
 
@@ -375,75 +1077,511 @@ bool ihipStream_t::lockopen_preKernelCommand()
                         this, ihipCommandName[crit->_last_command_type], ihipCommandName[ihipCommandKernel]);
             }
         }
-        crit->_last_command_type = ihipCommandKernel;
+        if (!crit->_annotatedKernel) {
+            crit->_last_command_type = ihipCommandKernel;
+        }
+    }
+
+    return addedSync;
+}
+
+
+//---
+// Must be called after kernel finishes, this releases the lock on the stream so other commands can submit.
+void ihipStream_t::lockclose_postKernelCommand(hc::completion_future &kernelFuture)
+{
+    // We locked _criticalData in the lockopen_preKernelCommand() so OK to access here:
+    if (_criticalData._annotatedKernel) {
+        // Annotated kernels do not become the fence, later commands only wait for them on overlap.
+        for (auto range = _criticalData._kernelRanges.begin(); range != _criticalData._kernelRanges.end(); range++) {
+            range->_kernel_future = kernelFuture;
+            _criticalData._hazards.push_back(*range);
+        }
+        _criticalData._annotatedKernel = false;
+    } else {
+        _criticalData._last_kernel_future = kernelFuture;
+    }
+    _criticalData._kernelRanges.clear();
+
+    _queue->_mutex.unlock();
+    _criticalData.unlock(); // paired with lock from lockopen_preKernelCommand.
+};
+
+
+
+//---
+// Called whenever a copy command is set to the stream.
+// Examines the last command sent to this stream and returns a signal to wait on, if required.
+// For async copies lastCopy is the copy's completion signal, which holds the returned signal until it is reclaimed.
+// Synchronous copies pass NULL - the stream stays locked until the copy is done, so the signal is not reused meanwhile.
+int ihipStream_t::preCopyCommand(LockedAccessor_StreamCrit_t &crit, ihipSignal_t *lastCopy, hsa_signal_t *waitSignal, ihipCommand_t copyType)
+{
+    int needSync = 0;
+
+    waitSignal->handle = 0;
+
+    if (_trackHazards) {
+        // Untracked copy, order it behind everything in the stream:
+        joinHazards(crit);
+    }
+
+    //_mutex.lock(); // will be unlocked in postCopyCommand
+
+    // If switching command types, we need to add a barrier packet to synchronize things.
+    if (FORCE_SAMEDIR_COPY_DEP || (crit->_last_command_type != copyType)) {
+
+
+        if (crit->_last_command_type == ihipCommandKernel) {
+            tprintf (DB_SYNC, "stream %p switch %s to %s (async copy dep on prev kernel)\n",
+                    this, ihipCommandName[crit->_last_command_type], ihipCommandName[copyType]);
+            needSync = 1;
+            hsa_signal_t *hsaSignal = (static_cast<hsa_signal_t*> (crit->_last_kernel_future.get_native_handle()));
+            if (hsaSignal) {
+                *waitSignal = * hsaSignal;
+                if (lastCopy) {
+                    lastCopy->_pinnedFutures.push_back(crit->_last_kernel_future);
+                }
+            } else {
+                assert(0); // if NULL signal, and we return 1, hsa_amd_memory_copy_async will fail.  Confirm this never happens.
+            }
+        } else if (crit->_last_copy_signal) {
+            needSync = 1;
+            tprintf (DB_SYNC, "stream %p switch %s to %s (async copy dep on other copy #%lu)\n",
+                    this, ihipCommandName[crit->_last_command_type], ihipCommandName[copyType], crit->_last_copy_signal->_sig_id);
+            *waitSignal = crit->_last_copy_signal->_hsa_signal;
+            if (lastCopy) {
+                // Our own signal and the stream is locked, so the hold can not fail:
+                crit->_last_copy_signal->hold(crit->_last_copy_signal->_generation);
+                lastCopy->_pinned.push_back(crit->_last_copy_signal);
+            }
+        }
+
+        if (HIP_DISABLE_HW_COPY_DEP && needSync) {
+            if (HIP_DISABLE_HW_COPY_DEP == -1) {
+                tprintf (DB_SYNC, "IGNORE copy dependency\n")
+
+            } else {
+                tprintf (DB_SYNC, "HOST-wait for copy dependency\n")
+                // do the wait here on the host, and disable the device-side command resolution.
+                SignalWait(*waitSignal, waitMode());
+                needSync = 0;
+            }
+        }
+
+        crit->_last_command_type = copyType;
+    }
+
+    crit->_last_copy_signal = lastCopy;
+
+    return needSync;
+}
+
+
+//---
+// hipStreamTrackHazards:
+// Return the completion of a tracked command, or false if the command has already completed.
+bool ihipStream_t::liveHazardSignal(LockedAccessor_StreamCrit_t &crit, ihipHazard_t &hazard, ihipSignalRef_t *ref)
+{
+    if (hazard._copy_signal) {
+        // Stream signals are recycled after they are reclaimed - a different sig_id means the copy has completed.
+        // Only this stream allocates the signal and it is locked, so the generation still belongs to the copy.
+        if (hazard._copy_signal->_sig_id != hazard._sig_id) {
+            return false;
+        }
+        *ref = ihipSignalRef_t(hazard._copy_signal);
+    } else {
+        if (!hazard._kernel_future.get_native_handle()) {
+            return false;
+        }
+        *ref = ihipSignalRef_t(hazard._kernel_future);
+    }
+
+    return !ref->completed();
+}
+
+
+//---
+// Drop tracked commands which have completed.
+void ihipStream_t::pruneHazards(LockedAccessor_StreamCrit_t &crit)
+{
+    ihipSignalRef_t ref;
+    auto live = crit->_hazards.begin();
+    for (auto hazard = crit->_hazards.begin(); hazard != crit->_hazards.end(); hazard++) {
+        if (liveHazardSignal(crit, *hazard, &ref)) {
+            *live++ = *hazard;
+        }
+    }
+    crit->_hazards.erase(live, crit->_hazards.end());
+}
+
+
+//---
+// Make following kernels in the stream wait for deps, honoring HIP_DISABLE_HW_KERNEL_DEP.
+// The barrier gets a completion signal of its own, which holds the deps until the barrier has been processed.
+void ihipStream_t::waitSignals(LockedAccessor_StreamCrit_t &crit, const std::vector<ihipSignalRef_t> &deps)
+{
+    if (deps.empty() || (HIP_DISABLE_HW_KERNEL_DEP == -1)) {
+        return;
+    }
+
+    if (HIP_DISABLE_HW_KERNEL_DEP > 0) {
+        for (auto dep = deps.begin(); dep != deps.end(); dep++) {
+            dep->wait(waitMode());
+        }
+    } else {
+        ihipSignal_t *ihipSignal = allocSignal(crit);
+
+        std::vector<hsa_signal_t> depSignals;
+        for (auto dep = deps.begin(); dep != deps.end(); dep++) {
+            ihipAddDep(ihipSignal, *dep, depSignals);
+        }
+        if (!depSignals.empty()) {
+            hsa_signal_store_relaxed(ihipSignal->_hsa_signal, 1);
+            this->enqueueBarrier((hsa_queue_t*)_av.get_hsa_queue(), depSignals.size(), depSignals.data(), ihipSignal->_hsa_signal);
+        }
+    }
+}
+
+
+//---
+// Make the fence cover every tracked command, so untracked commands, events and stream waits can keep
+// depending on the fence alone.  The barrier packet waits for the tracked copies, and since it is in the
+// kernel queue it also follows the tracked kernels.
+void ihipStream_t::joinHazards(LockedAccessor_StreamCrit_t &crit)
+{
+    if (!_trackHazards) {
+        return;
+    }
+
+    pruneHazards(crit);
+    if (crit->_hazards.empty()) {
+        return;
+    }
+
+    if (HIP_DISABLE_HW_KERNEL_DEP != 0) {
+        std::vector<ihipSignalRef_t> deps;
+        ihipSignalRef_t ref;
+        for (auto hazard = crit->_hazards.begin(); hazard != crit->_hazards.end(); hazard++) {
+            if (liveHazardSignal(crit, *hazard, &ref)) {
+                deps.push_back(ref);
+            }
+        }
+        tprintf (DB_SYNC, "stream %p join %zu tracked ranges on host\n", this, crit->_hazards.size());
+        waitSignals(crit, deps);
+        crit->_hazards.clear();
+        return;
+    }
+
+    // Allocate the completion first - allocSignal may recycle signals of completed commands.
+    ihipSignal_t *ihipSignal = allocSignal(crit);
+    hsa_signal_store_relaxed(ihipSignal->_hsa_signal, 1);
+
+    std::vector<hsa_signal_t> depSignals;
+    ihipSignalRef_t ref;
+    if ((crit->_last_command_type != ihipCommandKernel) && (crit->_last_command_type != ihipCommandBarrier) &&
+        crit->_last_copy_signal) {
+        // The old fence is a copy, it is not in the kernel queue:
+        ihipAddDep(ihipSignal, ihipSignalRef_t(crit->_last_copy_signal), depSignals);
+    }
+    for (auto hazard = crit->_hazards.begin(); hazard != crit->_hazards.end(); hazard++) {
+        if (hazard->_copy_signal && liveHazardSignal(crit, *hazard, &ref)) {
+            ihipAddDep(ihipSignal, ref, depSignals);
+        }
+    }
+
+    hsa_queue_t * q =  (hsa_queue_t*)_av.get_hsa_queue();
+    this->enqueueBarrier(q, depSignals.size(), depSignals.data(), ihipSignal->_hsa_signal);
+
+    tprintf (DB_SYNC, "stream %p join %zu tracked ranges, barrier on %zu copies completion=#%lu\n",
+             this, crit->_hazards.size(), depSignals.size(), ihipSignal->_sig_id);
+
+    crit->_hazards.clear();
+    crit->_last_command_type = ihipCommandBarrier;
+    crit->_last_copy_signal  = ihipSignal;
+}
+
+
+//---
+// Called instead of preCopyCommand for async copies in a hipStreamTrackHazards stream.
+// The copy waits for the fence and for in-flight tracked commands with a RAW, WAR or WAW overlap, then is
+// tracked itself.  copySignal must already be allocated and set.
+// Returns the number of signals in waitSignals.
+int ihipStream_t::preTrackedCopyCommand(LockedAccessor_StreamCrit_t &crit, ihipSignal_t *copySignal, void *dst, const void *src, size_t sizeBytes,
+                                        std::vector<hsa_signal_t> &waitSignals)
+{
+    waitSignals.clear();
+
+    pruneHazards(crit);
+    if (crit->_hazards.size() + 2 > MAX_TRACKED_HAZARDS) {
+        joinHazards(crit);
+    }
+
+    std::vector<ihipSignalRef_t> deps;
+    ihipSignalRef_t ref;
+    if (fenceSignal(crit, &ref)) {
+        deps.push_back(ref);
+    }
+
+    const char *srcStart = static_cast<const char*> (src);
+    const char *dstStart = static_cast<const char*> (dst);
+    for (auto hazard = crit->_hazards.begin(); hazard != crit->_hazards.end(); hazard++) {
+        if ((hazard->overlaps(srcStart, srcStart + sizeBytes, false) || hazard->overlaps(dstStart, dstStart + sizeBytes, true)) &&
+            liveHazardSignal(crit, *hazard, &ref)) {
+            deps.push_back(ref);
+        }
+    }
+
+    tprintf (DB_SYNC, "stream %p tracked copy #%lu waits on %zu signals (%zu tracked ranges)\n",
+             this, copySignal->_sig_id, deps.size(), crit->_hazards.size());
+
+    if (HIP_DISABLE_HW_COPY_DEP) {
+        if ((HIP_DISABLE_HW_COPY_DEP > 0) && !deps.empty()) {
+            tprintf (DB_SYNC, "HOST-wait for copy dependency\n")
+            for (auto dep = deps.begin(); dep != deps.end(); dep++) {
+                dep->wait(waitMode());
+            }
+        }
+    } else {
+        // The copy holds its dependencies until copySignal is reclaimed:
+        for (auto dep = deps.begin(); dep != deps.end(); dep++) {
+            ihipAddDep(copySignal, *dep, waitSignals);
+        }
+    }
+
+    ihipHazard_t hazard;
+    hazard._copy_signal = copySignal;
+    hazard._sig_id      = copySignal->_sig_id;
+
+    hazard._start = srcStart;
+    hazard._end   = srcStart + sizeBytes;
+    hazard._write = false;
+    crit->_hazards.push_back(hazard);
+
+    hazard._start = dstStart;
+    hazard._end   = dstStart + sizeBytes;
+    hazard._write = true;
+    crit->_hazards.push_back(hazard);
+
+    return waitSignals.size();
+}
+
+
+//---
+// Replay an instantiated graph.  Nodes were resolved by hipGraphInstantiate and are issued in order, so each
+// node only needs the signals of the nodes it depends on:
+//  - kernels and memsets wait for copy dependencies with a barrier packet, kernel dependencies are ordered by the queue.
+//  - copies pass the completion signals of all dependencies to the DMA engine.
+// Nodes without dependencies wait for the stream's previous command, and a barrier on the graph's sinks becomes
+// the stream's last command.  The sink barrier holds the previous command and the kernel futures of the launch,
+// which the copy nodes may read from the DMA engines until the barrier is done.
+void ihipStream_t::locked_launchGraph(ihipGraphExec_t *exec)
+{
+    if (exec->_nodes.empty()) {
+        return;
+    }
+
+    LockedAccessor_StreamCrit_t crit(_criticalData);
+    std::lock_guard<std::recursive_mutex> queueLock(_queue->_mutex);
+
+    ihipSignal_t *sinkSignal = allocSignal(crit);
+
+    ihipSignalRef_t fenceRef;
+    std::vector<hsa_signal_t> fenceSignals;
+    bool haveFence = lastCompletionSignal(crit, &fenceRef) && ihipAddDep(sinkSignal, fenceRef, fenceSignals);
+    bool fenceInQueue = (crit->_last_command_type == ihipCommandKernel) || (crit->_last_command_type == ihipCommandBarrier);
+
+    ihipGraphExec_t::SignalSet &signalSet = exec->nextSignalSet();
+    std::vector<hsa_signal_t> &copySignals = signalSet._signals;
+    std::vector<hsa_signal_t> &depSignals = exec->_depSignals;
+
+    tprintf (DB_SYNC, "stream %p launch graph %p (%zu nodes, %zu copies)\n", this, exec, exec->_nodes.size(), exec->_copyCnt);
+
+    // The set is in use until the sink barrier has completed, even if a node fails to launch below:
+    signalSet._sink = ihipSignalRef_t(sinkSignal);
+
+    hipError_t launchError = hipSuccess;
+    try {
+        for (size_t i=0; i<exec->_nodes.size(); i++) {
+            ihipGraphNode_t &node = exec->_nodes[i];
+            bool isCopy = (node._type == ihipGraphNodeCopy);
+
+            depSignals.clear();
+            if (node._deps.empty() && haveFence && (isCopy || !fenceInQueue)) {
+                depSignals.push_back(fenceSignals[0]);
+            }
+            for (auto d = node._deps.begin(); d != node._deps.end(); d++) {
+                ihipGraphNode_t &dep = exec->_nodes[*d];
+                if (dep._type == ihipGraphNodeCopy) {
+                    depSignals.push_back(copySignals[dep._copySlot]);
+                } else if (isCopy) {
+                    hsa_signal_t *kernelSignal = static_cast<hsa_signal_t*> (exec->_kernelFutures[*d].get_native_handle());
+                    if (kernelSignal) {
+                        depSignals.push_back(*kernelSignal);
+                    }
+                }
+            }
+
+            if (isCopy) {
+                hsa_signal_t completion = copySignals[node._copySlot];
+                hsa_signal_store_relaxed(completion, 1);
+
+                if (HIP_DISABLE_HW_COPY_DEP && !depSignals.empty()) {
+                    if (HIP_DISABLE_HW_COPY_DEP > 0) {
+                        for (auto s = depSignals.begin(); s != depSignals.end(); s++) {
+                            SignalWait(*s, waitMode());
+                        }
+                    }
+                    depSignals.clear();
+                }
+
+                hsa_status_t hsa_status = hsa_amd_memory_async_copy(node._dst, node._dstAgent, node._src, node._srcAgent, node._sizeBytes,
+                                                                    depSignals.size(), depSignals.empty() ? 0x0 : depSignals.data(), completion);
+                if (hsa_status != HSA_STATUS_SUCCESS) {
+                    hsa_signal_store_relaxed(completion, 0);
+                    throw ihipException(hipErrorInvalidValue);
+                }
+            } else {
+                // Copy signals of the graph are not recycled by a stream, so the barrier need not hold them:
+                if (!depSignals.empty() && (HIP_DISABLE_HW_KERNEL_DEP > 0)) {
+                    for (auto s = depSignals.begin(); s != depSignals.end(); s++) {
+                        SignalWait(*s, waitMode());
+                    }
+                } else if (!depSignals.empty() && (HIP_DISABLE_HW_KERNEL_DEP == 0)) {
+                    hsa_signal_t noCompletion;
+                    noCompletion.handle = 0;
+                    this->enqueueBarrier((hsa_queue_t*)_av.get_hsa_queue(), depSignals.size(), depSignals.data(), noCompletion);
+                }
+
+                if (node._type == ihipGraphNodeKernel) {
+                    grid_launch_parm lp = node._lp;
+                    lp.av = &_av;
+                    lp.cf = &exec->_kernelFutures[i];
+                    node._kernel(lp);
+                } else {
+                    exec->_kernelFutures[i] = ihipMemset(this, node._dst, node._value, node._sizeBytes);
+                }
+                sinkSignal->_pinnedFutures.push_back(exec->_kernelFutures[i]);
+            }
+        }
+    }
+    catch (ihipException ex) {
+        // Still enqueue the sink barrier, below, so the copies already issued keep the set and the fence in use.
+        launchError = ex._code;
+    }
+
+    // Make the sink barrier the stream's last command.  It is in the kernel queue, so it also follows the kernels:
+    hsa_signal_store_relaxed(sinkSignal->_hsa_signal, 1);
+
+    depSignals.clear();
+    if (launchError == hipSuccess) {
+        // Every other copy is an ancestor of a sink:
+        for (auto s = exec->_sinks.begin(); s != exec->_sinks.end(); s++) {
+            if (exec->_nodes[*s]._type == ihipGraphNodeCopy) {
+                depSignals.push_back(copySignals[exec->_nodes[*s]._copySlot]);
+            }
+        }
+    } else {
+        // Copies which were not issued are still at 0:
+        depSignals = copySignals;
+    }
+
+    this->enqueueBarrier((hsa_queue_t*)_av.get_hsa_queue(), depSignals.size(), depSignals.data(), sinkSignal->_hsa_signal);
+
+    crit->_last_command_type = ihipCommandBarrier;
+    crit->_last_copy_signal  = sinkSignal;
+
+    if (launchError != hipSuccess) {
+        throw ihipException(launchError);
+    }
+
+    if (HIP_LAUNCH_BLOCKING) {
+        tprintf(DB_SYNC, "LAUNCH_BLOCKING for completion of graph %p\n", exec);
+        this->wait(crit);
     }
-
-    return addedSync;
 }
 
 
 //---
-// Must be called after kernel finishes, this releases the lock on the stream so other commands can submit.
-void ihipStream_t::lockclose_postKernelCommand(hc::completion_future &kernelFuture)
+// Enqueue the event barrier, which completes once all earlier kernels and copies in the stream have completed.
+// Every record gets a fresh stream signal, and the barrier becomes the stream's last command.  A timed event holds
+// the signal (and the copy it takes its time from) until the timestamp has been read, since reusing the signal
+// overwrites its timestamps.
+void ihipStream_t::locked_recordEvent(ihipEvent_t *eh)
 {
-    // We locked _criticalData in the lockopen_preKernelCommand() so OK to access here:
-    _criticalData._last_kernel_future = kernelFuture;
-
-    _criticalData.unlock(); // paired with lock from lockopen_preKernelCommand.
-};
-
-
+    LockedAccessor_StreamCrit_t crit(_criticalData);
 
-//---
-// Called whenever a copy command is set to the stream.
-// Examines the last command sent to this stream and returns a signal to wait on, if required.
-int ihipStream_t::preCopyCommand(LockedAccessor_StreamCrit_t &crit, ihipSignal_t *lastCopy, hsa_signal_t *waitSignal, ihipCommand_t copyType)
-{
-    int needSync = 0;
+    // The barrier must follow tracked copies as well:
+    joinHazards(crit);
 
-    waitSignal->handle = 0;
+    std::lock_guard<std::mutex> el(eh->_mutex);
 
-    //_mutex.lock(); // will be unlocked in postCopyCommand
+    // Release the previous record, waiters hold its signal themselves:
+    ihipEventUnhold(eh);
+    eh->_state     = hipEventStatusRecording;
+    eh->_timestamp = 0;
+    eh->_stream    = this;
+    eh->_device    = getDevice();
 
-    // If switching command types, we need to add a barrier packet to synchronize things.
-    if (FORCE_SAMEDIR_COPY_DEP || (crit->_last_command_type != copyType)) {
+    ihipSignal_t *ihipSignal = allocSignal(crit);
+    hsa_signal_store_relaxed(ihipSignal->_hsa_signal, 1);
 
+    // Kernels and barriers are ahead of the event barrier in the queue, a copy fence is not:
+    std::vector<hsa_signal_t> depSignals;
+    if ((crit->_last_command_type != ihipCommandKernel) && (crit->_last_command_type != ihipCommandBarrier) &&
+        crit->_last_copy_signal) {
+        ihipAddDep(ihipSignal, ihipSignalRef_t(crit->_last_copy_signal), depSignals);
+    }
+    int depSignalCnt = depSignals.size();
+
+    eh->_signal = ihipSignalRef_t(ihipSignal);
+    if (!(eh->_flags & hipEventDisableTiming)) {
+        // Our own signals and the stream is locked, so the holds can not fail:
+        eh->_held = ihipSignal->hold(eh->_signal._generation);
+
+        // The barrier completes some time after the copy it waits for, so timed events read the copy's own end time.
+        // Only hsa_amd_memory_async_copy signals carry copy timestamps - not staged copies or callbacks:
+        bool sdmaCopy = (crit->_last_command_type == ihipCommandCopyH2H) || (crit->_last_command_type == ihipCommandCopyH2D) ||
+                        (crit->_last_command_type == ihipCommandCopyD2H) || (crit->_last_command_type == ihipCommandCopyD2D);
+        if (depSignalCnt && sdmaCopy) {
+            eh->_copy = ihipSignalRef_t(crit->_last_copy_signal);
+            eh->_copy._signal->hold(eh->_copy._generation);
+        }
+    }
 
-        if (crit->_last_command_type == ihipCommandKernel) {
-            tprintf (DB_SYNC, "stream %p switch %s to %s (async copy dep on prev kernel)\n",
-                    this, ihipCommandName[crit->_last_command_type], ihipCommandName[copyType]);
-            needSync = 1;
-            hsa_signal_t *hsaSignal = (static_cast<hsa_signal_t*> (crit->_last_kernel_future.get_native_handle()));
-            if (hsaSignal) {
-                *waitSignal = * hsaSignal;
-            } else {
-                assert(0); // if NULL signal, and we return 1, hsa_amd_memory_copy_async will fail.  Confirm this never happens.
-            }
-        } else if (crit->_last_copy_signal) {
-            needSync = 1;
-            tprintf (DB_SYNC, "stream %p switch %s to %s (async copy dep on other copy #%lu)\n",
-                    this, ihipCommandName[crit->_last_command_type], ihipCommandName[copyType], crit->_last_copy_signal->_sig_id);
-            *waitSignal = crit->_last_copy_signal->_hsa_signal;
+    hsa_queue_t * q =  (hsa_queue_t*)_av.get_hsa_queue();
+    {
+        std::lock_guard<std::recursive_mutex> queueLock(_queue->_mutex);
+        if (!(eh->_flags & hipEventDisableTiming)) {
+            _queue->enableProfiling();
         }
+        this->enqueueBarrier(q, depSignalCnt, depSignals.data(), ihipSignal->_hsa_signal);
+    }
 
-        if (HIP_DISABLE_HW_COPY_DEP && needSync) {
-            if (HIP_DISABLE_HW_COPY_DEP == -1) {
-                tprintf (DB_SYNC, "IGNORE copy dependency\n")
+    crit->_last_command_type = ihipCommandBarrier;
+    crit->_last_copy_signal  = ihipSignal;
 
-            } else {
-                tprintf (DB_SYNC, "HOST-wait for copy dependency\n")
-                // do the wait here on the host, and disable the device-side command resolution.
-                hsa_signal_wait_acquire(*waitSignal, HSA_SIGNAL_CONDITION_LT, 1, UINT64_MAX, HSA_WAIT_STATE_ACTIVE);
-                needSync = 0;
-            }
-        }
+    tprintf (DB_SYNC, "stream %p record event %p, completion=#%lu, barrier waits on %d copies\n", this, eh, ihipSignal->_sig_id, depSignalCnt);
+}
 
-        crit->_last_command_type = copyType;
+
+//---
+// Record a range accessed by the next kernel launched into the stream (hipStreamAnnotateKernelRange).
+// Ignored unless the stream tracks hazards.
+void ihipStream_t::locked_annotateKernelRange(const void *ptr, size_t sizeBytes, unsigned access)
+{
+    if (!_trackHazards) {
+        return;
     }
 
-    crit->_last_copy_signal = lastCopy;
+    LockedAccessor_StreamCrit_t crit(_criticalData);
 
-    return needSync;
+    ihipHazard_t range;
+    range._start       = static_cast<const char*> (ptr);
+    range._end         = range._start + sizeBytes;
+    range._write       = (access & hipKernelRangeWrite) != 0;
+    range._copy_signal = NULL;
+    range._sig_id      = 0;
+    crit->_kernelRanges.push_back(range);
 }
 
 
@@ -477,7 +1615,7 @@ void ihipDevice_t::locked_reset()
 
 
     // Create a fresh default stream and add it:
-    _default_stream = new ihipStream_t(_device_index, _acc.get_default_view(), hipStreamDefault);
+    _default_stream = new ihipStream_t(_device_index, _queue_pool.defaultQueue(), hipStreamDefault);
     crit->addStream(_default_stream);
 
 
@@ -486,7 +1624,17 @@ void ihipDevice_t::locked_reset()
 
     // Reset and release all memory stored in the tracker:
     // Reset will remove peer mapping so don't need to do this explicitly.
+    // The memory pool blocks are tracker allocations, so they are released here too.
+    // Streams are idle, so pending deferred frees retire right away - flush them so the background thread
+    // does not release memory after the tracker has been reset.
+    if (_deferred_free) {
+        _deferred_free->locked_reclaim(true);
+    }
+    if (_mem_pool) {
+        _mem_pool->locked_reset();
+    }
     am_memtracker_reset(_acc);
+    g_allocIndex.locked_removeDevice(_device_index);
 
 };
 
@@ -510,10 +1658,21 @@ void ihipDevice_t::init(unsigned device_index, unsigned deviceCnt, hc::accelerat
         _hsa_agent.handle = static_cast<uint64_t> (-1);
     }
 
+    // Events convert their timestamps to the system domain, so all agents share the system timestamp frequency:
+    if (hsa_system_get_info(HSA_SYSTEM_INFO_TIMESTAMP_FREQUENCY, &_timestamp_frequency) != HSA_STATUS_SUCCESS) {
+        _timestamp_frequency = 0;
+    }
+
     getProperties(&_props);
 
     _criticalData.init(deviceCnt);
 
+    _mem_pool = NULL;
+    _deferred_free = NULL;
+    _copy_pool = NULL;
+    _pin_cache = NULL;
+    _copy_tuner = NULL;
+    _queue_pool.init(_acc, HIP_STREAM_QUEUES);
     locked_reset();
 
 
@@ -521,8 +1680,22 @@ void ihipDevice_t::init(unsigned device_index, unsigned deviceCnt, hc::accelerat
 
     hsa_region_t *pinnedHostRegion;
     pinnedHostRegion = static_cast<hsa_region_t*>(_acc.get_hsa_am_system_region());
-    _staging_buffer[0] = new StagingBuffer(_hsa_agent, *pinnedHostRegion, HIP_STAGING_SIZE*1024, HIP_STAGING_BUFFERS);
-    _staging_buffer[1] = new StagingBuffer(_hsa_agent, *pinnedHostRegion, HIP_STAGING_SIZE*1024, HIP_STAGING_BUFFERS);
+    if (HIP_STAGING_MT_THREADS > 0) {
+        _copy_pool = new HostCopyPool(HIP_STAGING_MT_THREADS, getNumaNode());
+    }
+    if (HIP_PININPLACE || HIP_COPY_TUNE) {
+        _pin_cache = new PinnedRangeCache(_hsa_agent, (size_t)HIP_PININPLACE_MAX_PINNED*1024*1024);
+    }
+    for (int i=0; i<2; i++) {
+        _staging_pool[i] = new StagingBufferPool(_hsa_agent, g_cpu_agent, *pinnedHostRegion, HIP_STAGING_SIZE*1024, HIP_STAGING_BUFFERS, HIP_STAGING_POOL,
+                                                 _copy_pool, (size_t)HIP_STAGING_MT_THRESHOLD*1024, _pin_cache, HIP_STAGING_D2H_RING);
+    }
+    if (HIP_COPY_TUNE) {
+        _copy_tuner = new CopyTuner(this, HIP_COPY_TUNE == 2, HIP_COPY_TUNE_DUMP);
+    }
+
+    _mem_pool = new MemoryPool(this, (HIP_MEMPOOL_RELEASE_THRESHOLD < 0) ? SIZE_MAX : (size_t)HIP_MEMPOOL_RELEASE_THRESHOLD*1024*1024);
+    _deferred_free = new DeferredFreeQueue(this);
 
 };
 
@@ -531,17 +1704,43 @@ void ihipDevice_t::init(unsigned device_index, unsigned deviceCnt, hc::accelerat
 
 ihipDevice_t::~ihipDevice_t()
 {
+    if (_copy_tuner) {
+        delete _copy_tuner;
+        _copy_tuner = NULL;
+    }
+
     if (_default_stream) {
         delete _default_stream;
         _default_stream = NULL;
     }
 
     for (int i=0; i<2; i++) {
-        if (_staging_buffer[i]) {
-            delete _staging_buffer[i];
-            _staging_buffer[i] = NULL;
+        if (_staging_pool[i]) {
+            delete _staging_pool[i];
+            _staging_pool[i] = NULL;
         }
     }
+
+    if (_copy_pool) {
+        delete _copy_pool;
+        _copy_pool = NULL;
+    }
+
+    if (_pin_cache) {
+        delete _pin_cache;
+        _pin_cache = NULL;
+    }
+
+    // Deferred frees may release to the pool, so stop the queue first:
+    if (_deferred_free) {
+        delete _deferred_free;
+        _deferred_free = NULL;
+    }
+
+    if (_mem_pool) {
+        delete _mem_pool;
+        _mem_pool = NULL;
+    }
 }
 
 //----
@@ -604,6 +1803,72 @@ static hsa_status_t countGpuAgents(hsa_agent_t agent, void *data) {
 }
 
 // Internal version,
+//---
+// hipDeviceScheduleAuto uses the process default, set with HIP_WAIT_MODE.
+SignalWaitMode ihipDevice_t::waitMode() const
+{
+    switch (_device_flags & hipDeviceScheduleMask) {
+    case hipDeviceScheduleSpin:         return SignalWaitSpin;
+    case hipDeviceScheduleYield:        return SignalWaitYield;
+    case hipDeviceScheduleBlockingSync: return SignalWaitBlocked;
+    default:                            return SignalWaitDefault;
+    };
+}
+
+
+//---
+// Algorithm for a copy between unpinned host memory and this device.
+StagingCopyPlan ihipDevice_t::copyPlan(bool hostToDevice, size_t sizeBytes)
+{
+    if (_copy_tuner) {
+        return _copy_tuner->locked_lookup(hostToDevice, sizeBytes);
+    } else if (!HIP_STAGING_BUFFERS) {
+        return StagingCopyPlan(StagingCopyDirect);
+    } else if (HIP_PININPLACE) {
+        return StagingCopyPlan(StagingCopyPinInPlace);
+    } else {
+        return StagingCopyPlan(StagingCopyStaged);
+    }
+}
+
+
+//---
+// Return the NUMA node the GPU is attached to, or -1 if unknown.
+// The agent's BDFID gives bus, device and function but not the PCI domain, so match any domain and only trust
+// a unique match.
+int ihipDevice_t::getNumaNode()
+{
+    uint16_t bdf_id;
+    if (hsa_agent_get_info(_hsa_agent, (hsa_agent_info_t)HSA_AMD_AGENT_INFO_BDFID, &bdf_id) != HSA_STATUS_SUCCESS) {
+        return -1;
+    }
+
+    char pattern[128];
+    snprintf(pattern, sizeof(pattern), "/sys/bus/pci/devices/*:%02x:%02x.%x/numa_node",
+             (bdf_id>>8) & 0xFF, (bdf_id>>3) & 0x1F, bdf_id & 0x7);
+
+    int numaNode = -1;
+    glob_t paths;
+    if (glob(pattern, 0, NULL, &paths) == 0) {
+        if (paths.gl_pathc == 1) {
+            FILE *f = fopen(paths.gl_pathv[0], "r");
+            if (f) {
+                if (fscanf(f, "%d", &numaNode) != 1) {
+                    numaNode = -1;
+                }
+                fclose(f);
+            }
+        } else {
+            tprintf(DB_COPY1, "getNumaNode: %zu PCI devices match %s, NUMA node unknown\n", (size_t)paths.gl_pathc, pattern);
+        }
+    }
+    globfree(&paths);
+
+    return numaNode;
+}
+
+
+//---
 hipError_t ihipDevice_t::getProperties(hipDeviceProp_t* prop)
 {
     hipError_t e = hipSuccess;
@@ -770,9 +2035,11 @@ hipError_t ihipDevice_t::getProperties(hipDeviceProp_t* prop)
 // Implement "default" stream syncronization
 //   This waits for all other streams to drain before continuing.
 //   If waitOnSelf is set, this additionally waits for the default stream to empty.
-void ihipDevice_t::locked_syncDefaultStream(bool waitOnSelf)
+//   Returns the first async copy error of the streams waited for.
+hipError_t ihipDevice_t::locked_syncDefaultStream(bool waitOnSelf)
 {
     LockedAccessor_DeviceCrit_t  crit(_criticalData);
+    hipError_t e = hipSuccess;
 
     tprintf(DB_SYNC, "syncDefaultStream\n");
 
@@ -787,11 +2054,70 @@ void ihipDevice_t::locked_syncDefaultStream(bool waitOnSelf)
                 // TODO-hcc - use blocking or active wait here?
                 // TODO-sync - cudaDeviceBlockingSync
                 stream->locked_wait();
+                hipError_t streamError = stream->takeAsyncError();
+                if (e == hipSuccess) {
+                    e = streamError;
+                }
+            }
+        }
+    }
+
+    return e;
+}
+
+//---
+// Collect the completion of the last in-flight command in every blocking stream except the waiter.
+// Idle streams do not add a completion.  The references are generation-checked, since the streams keep running.
+void ihipDevice_t::locked_blockingStreamSignals(ihipStream_t *waiter, std::vector<ihipSignalRef_t> &deps)
+{
+    LockedAccessor_DeviceCrit_t  crit(_criticalData);
+
+    for (auto streamI=crit->const_streams().begin(); streamI!=crit->const_streams().end(); streamI++) {
+        ihipStream_t *stream = *streamI;
+
+        // Don't wait for streams that have "opted-out" of syncing with NULL stream, or ourselves.
+        if (!(stream->_flags & hipStreamNonBlocking) && (stream != waiter)) {
+            ihipSignalRef_t ref;
+            if (stream->locked_lastCompletionSignal(&ref)) {
+                deps.push_back(ref);
             }
         }
     }
 }
 
+
+//---
+// Device-side version of the default stream synchronization.
+// Enqueue a barrier in the waiter stream which waits for the last command in all the other blocking streams.
+// The host does not wait.
+void ihipDevice_t::locked_waitBlockingStreams(ihipStream_t *waiter)
+{
+    std::vector<ihipSignalRef_t> deps;
+
+    locked_blockingStreamSignals(waiter, deps);
+
+    tprintf(DB_SYNC, "stream %p wait for %zu active blocking streams\n", waiter, deps.size());
+
+    waiter->locked_waitSignals(deps);
+}
+
+
+//---
+// Collect the completion of the last in-flight command in every stream on the device, including non-blocking streams.
+// Once all of these complete, every command enqueued before this call has completed.
+void ihipDevice_t::locked_lastCompletionSignals(std::vector<ihipSignalRef_t> &deps)
+{
+    LockedAccessor_DeviceCrit_t  crit(_criticalData);
+
+    for (auto streamI=crit->const_streams().begin(); streamI!=crit->const_streams().end(); streamI++) {
+        ihipSignalRef_t ref;
+        if ((*streamI)->locked_lastCompletionSignal(&ref)) {
+            deps.push_back(ref);
+        }
+    }
+}
+
+
 //---
 void ihipDevice_t::locked_addStream(ihipStream_t *s)
 {
@@ -811,14 +2137,22 @@ void ihipDevice_t::locked_removeStream(ihipStream_t *s)
 
 //---
 //Heavyweight synchronization that waits on all streams, ignoring hipStreamNonBlocking flag.
-void ihipDevice_t::locked_waitAllStreams()
+//Returns the first async copy error of the streams.
+hipError_t ihipDevice_t::locked_waitAllStreams()
 {
     LockedAccessor_DeviceCrit_t  crit(_criticalData);
+    hipError_t e = hipSuccess;
 
     tprintf(DB_SYNC, "waitAllStream\n");
     for (auto streamI=crit->const_streams().begin(); streamI!=crit->const_streams().end(); streamI++) {
         (*streamI)->locked_wait();
+        hipError_t streamError = (*streamI)->takeAsyncError();
+        if (e == hipSuccess) {
+            e = streamError;
+        }
     }
+
+    return e;
 }
 
 
@@ -935,9 +2269,26 @@ void ihipInit()
     READ_ENV_I(release, HIP_TRACE_API, 0,  "Trace each HIP API call.  Print function name and return code to stderr as program executes.");
     READ_ENV_I(release, HIP_ATP_MARKER, 0,  "Add HIP function begin/end to ATP file generated with CodeXL");
     READ_ENV_I(release, HIP_STAGING_SIZE, 0, "Size of each staging buffer (in KB)" );
-    READ_ENV_I(release, HIP_STAGING_BUFFERS, 0, "Number of staging buffers to use in each direction. 0=use hsa_memory_copy.");
-    READ_ENV_I(release, HIP_PININPLACE, 0, "For unpinned transfers, pin the memory in-place in chunks before doing the copy. Under development.");
-    READ_ENV_I(release, HIP_STREAM_SIGNALS, 0, "Number of signals to allocate when new stream is created (signal pool will grow on demand)");
+    READ_ENV_I(release, HIP_STAGING_BUFFERS, 0, "Number of staging buffers to use in each direction (max 32). 0=use hsa_memory_copy.");
+    READ_ENV_I(release, HIP_PININPLACE, 0, "For unpinned transfers, pin the host memory in-place and copy it with one DMA.  Falls back to the staging buffers if the memory can't be pinned.");
+    READ_ENV_I(release, HIP_PININPLACE_MAX_PINNED, 0, "Max host memory (in MB) pinned at once by HIP_PININPLACE copies.  Larger copies use the staging buffers.");
+    READ_ENV_I(release, HIP_COPY_TUNE, 0, "Pick the algorithm for unpinned copies from a table calibrated for this machine.  1=load table (if missing, calibrate in the background from init and use direct copies until done), 2=recalibrate.  0=use HIP_STAGING_BUFFERS/HIP_PININPLACE.");
+    READ_ENV_I(release, HIP_COPY_TUNE_DUMP, 0, "Print the HIP_COPY_TUNE table to stderr when it is loaded or calibrated.");
+    READ_ENV_I(release, HIP_STAGING_POOL, 0, "Max number of staging buffers per direction, used by concurrent unpinned copies on different threads or streams.");
+    READ_ENV_I(release, HIP_STAGING_ASYNC, 0, "hipMemcpyAsync with unpinned host memory returns without waiting, the staged copy runs on a worker thread and its errors are returned by the next stream or device synchronize. 0=staged copies are synchronous.");
+    READ_ENV_I(release, HIP_STAGING_MT_THREADS, 0, "Number of helper threads, bound to the GPU's NUMA node, that split the host memcpy of large staged copies. 0=disable.");
+    READ_ENV_I(release, HIP_STAGING_MT_THRESHOLD, 0, "Min size (in KB) of an unpinned copy that uses the HIP_STAGING_MT_THREADS helper threads.");
+    READ_ENV_I(release, HIP_STAGING_D2H_RING, 0, "D2H staging pipeline: 1=ring, each staging buffer is refilled as soon as it is unloaded.  0=batch, all buffers are unloaded before any is refilled (the older pipeline, for comparisons).");
+    READ_ENV_I(release, HIP_NONTEMPORAL_COPY, 0, "Max instruction set for streaming-store copies into staging buffers and write-combined memory: 0=libc memcpy, 1=SSE2, 2=AVX2, 3=AVX-512.");
+    READ_ENV_I(release, HIP_STREAM_SIGNALS, 0, "Number of signals each stream moves between its local cache and the device signal pool at a time");
+    READ_ENV_I(release, HIP_STREAM_SIGNALS_MAX, 0, "Max number of in-flight signals per stream, further commands wait for the oldest to complete. 0=unlimited");
+    READ_ENV_I(release, HIP_SYNC_NULL_STREAM, 0, "Synchronize on host for the legacy NULL stream ordering. 0=order with device-side barrier packets.");
+    READ_ENV_I(release, HIP_MEMPOOL_RELEASE_THRESHOLD, 0, "Size (in MB) of freed hipMallocAsync memory each device keeps cached for reuse. -1=unlimited.");
+    READ_ENV_I(release, HIP_TRACK_HAZARDS, 0, "Create every stream with hipStreamTrackHazards, so async copies only wait for earlier commands that touch overlapping memory.");
+    READ_ENV_I(release, HIP_CALLBACK_THREADS, 0, "Number of threads which run hipStreamAddCallback callbacks.");
+    READ_ENV_I(release, HIP_WAIT_MODE, 0, "How the host waits for the device, unless set with hipSetDeviceFlags: 0=hybrid (spin for HIP_WAIT_SPIN_US, then block), 1=spin, 2=yield, 3=block.");
+    READ_ENV_I(release, HIP_WAIT_SPIN_US, 0, "Time (in us) a hybrid wait spins before it blocks.");
+    READ_ENV_I(release, HIP_STREAM_QUEUES, 0, "Max number of HSA queues per device for created streams, further streams share queues. 0=unlimited.");
     READ_ENV_I(release, HIP_VISIBLE_DEVICES, CUDA_VISIBLE_DEVICES, "Only devices whose index is present in the secquence are visible to HIP applications and they are enumerated in the order of secquence" );
 
     READ_ENV_I(release, HIP_DISABLE_HW_KERNEL_DEP, 0, "Disable HW dependencies before kernel commands  - instead wait for dependency on host. -1 means ignore these dependencies. (debug mode)");
@@ -958,11 +2309,26 @@ void ihipInit()
     }
 
 
+    HostMemcpyIsa memcpyIsa = HostMemcpyInit(HIP_NONTEMPORAL_COPY);
+    tprintf(DB_COPY1, "streaming host memcpy uses %s\n", HostMemcpyIsaName(memcpyIsa));
+
+    SignalWaitMode waitMode = ((HIP_WAIT_MODE >= SignalWaitHybrid) && (HIP_WAIT_MODE <= SignalWaitBlocked)) ?
+                              (SignalWaitMode)HIP_WAIT_MODE : SignalWaitHybrid;
+    SignalWaitInit(waitMode, HIP_WAIT_SPIN_US > 0 ? HIP_WAIT_SPIN_US : 0);
+    tprintf(DB_SYNC, "default wait mode is %s, spin %dus\n", SignalWaitModeName(waitMode), HIP_WAIT_SPIN_US);
+
     /*
      * Build a table of valid compute devices.
      */
     auto accs = hc::accelerator::get_all();
 
+    // Find the CPU agent first, the device staging buffers use it as the host-side agent for their copies:
+    hsa_status_t err = hsa_iterate_agents(findCpuAgent, &g_cpu_agent);
+    if (err != HSA_STATUS_INFO_BREAK) {
+        // didn't find a CPU.
+        throw ihipException(hipErrorRuntimeOther);
+    }
+
     int deviceCnt = 0;
     for (int i=0; i<accs.size(); i++) {
         if (! accs[i].get_is_emulated()) {
@@ -1000,13 +2366,6 @@ void ihipInit()
     }
 
 
-    hsa_status_t err = hsa_iterate_agents(findCpuAgent, &g_cpu_agent);
-    if (err != HSA_STATUS_INFO_BREAK) {
-        // didn't find a CPU.
-        throw ihipException(hipErrorRuntimeOther);
-    }
-
-
     tprintf(DB_SYNC, "pid=%u %-30s\n", getpid(), "<ihipInit>");
 }
 
@@ -1051,14 +2410,27 @@ hipStream_t ihipSyncAndResolveStream(hipStream_t stream)
         ihipDevice_t *device = ihipGetTlsDefaultDevice();
 
 #ifndef HIP_API_PER_THREAD_DEFAULT_STREAM
-        device->locked_syncDefaultStream(false);
+        if (HIP_SYNC_NULL_STREAM) {
+            device->locked_syncDefaultStream(false);
+        } else {
+            device->locked_waitBlockingStreams(device->_default_stream);
+        }
 #endif
         return device->_default_stream;
     } else {
         // Have to wait for legacy default stream to be empty:
         if (!(stream->_flags & hipStreamNonBlocking))  {
-            tprintf(DB_SYNC, "stream %p wait default stream\n", stream);
-            stream->getDevice()->_default_stream->locked_wait();
+            ihipStream_t *defaultStream = stream->getDevice()->_default_stream;
+            if (HIP_SYNC_NULL_STREAM) {
+                tprintf(DB_SYNC, "stream %p wait default stream\n", stream);
+                defaultStream->locked_wait();
+            } else {
+                ihipSignalRef_t ref;
+                if (defaultStream->locked_lastCompletionSignal(&ref)) {
+                    tprintf(DB_SYNC, "stream %p barrier on default stream\n", stream);
+                    stream->locked_waitSignals(std::vector<ihipSignalRef_t>(1, ref));
+                }
+            }
         }
 
         return stream;
@@ -1069,9 +2441,13 @@ hipStream_t ihipSyncAndResolveStream(hipStream_t stream)
 // TODO - data-up to data-down:
 // Called just before a kernel is launched from hipLaunchKernel.
 // Allows runtime to track some information about the stream.
+// Returns NULL if the stream is capturing, the launch is then recorded with ihipCaptureKernel.
 hipStream_t ihipPreLaunchKernel(hipStream_t stream, hc::accelerator_view **av)
 {
 	std::call_once(hip_initialized, ihipInit);
+    if (stream && stream->_capture) {
+        return NULL;
+    }
     stream = ihipSyncAndResolveStream(stream);
 
 
@@ -1083,6 +2459,19 @@ hipStream_t ihipPreLaunchKernel(hipStream_t stream, hc::accelerator_view **av)
 }
 
 
+//---
+// Record a kernel launch into the graph of a capturing stream.
+void ihipCaptureKernel(hipStream_t stream, const grid_launch_parm &lp, const std::function<void(grid_launch_parm&)> &kernel)
+{
+    ihipGraphNode_t node;
+    node._type   = ihipGraphNodeKernel;
+    node._lp     = lp;
+    node._kernel = kernel;
+
+    stream->_capture->addNode(node);
+}
+
+
 //---
 //Called after kernel finishes execution.
 void ihipPostLaunchKernel(hipStream_t stream, hc::completion_future &kernelFuture)
@@ -1094,6 +2483,50 @@ void ihipPostLaunchKernel(hipStream_t stream, hc::completion_future &kernelFutur
 }
 
 
+//---
+// The pre/post kernel bookkeeping runs once for the batch.  Kernels in the queue complete in order, so the
+// future of the last kernel stands for the whole batch.
+hipError_t hipLaunchKernelBatch(hipStream_t stream, const hipKernelLaunch_t *launches, int count)
+{
+    HIP_INIT_API(stream, launches, count);
+
+    if ((launches == NULL) || (count < 0)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+    if (count == 0) {
+        return ihipLogStatus(hipSuccess);
+    }
+
+    if (stream && stream->_capture) {
+        for (int i=0; i<count; i++) {
+            ihipCaptureKernel(stream, launches[i]._lp, launches[i]._kernel);
+        }
+        return ihipLogStatus(hipSuccess);
+    }
+
+    stream = ihipSyncAndResolveStream(stream);
+
+    stream->lockopen_preKernelCommand();
+
+    hc::completion_future cf;
+    for (int i=0; i<count; i++) {
+        grid_launch_parm lp = launches[i]._lp;
+        lp.av = &stream->_av;
+        lp.cf = &cf;
+        launches[i]._kernel(lp);
+    }
+
+    stream->lockclose_postKernelCommand(cf);
+
+    if (HIP_LAUNCH_BLOCKING) {
+        tprintf(DB_SYNC, " stream:%p LAUNCH_BLOCKING for completion of %d kernel batch\n", stream, count);
+        cf.wait();
+    }
+
+    return ihipLogStatus(hipSuccess);
+}
+
+
 //
 //=================================================================================================
 // HIP API Implementation
@@ -1137,21 +2570,57 @@ const char *ihipErrorString(hipError_t hip_error)
 };
 
 
+//---
+// End time of the SDMA copy before the event.  Copy times are already in the system domain.
+// Returns false if there is no such copy.  The event holds the copy signal, so its timestamps are still the copy's.
+static bool ihipCopyEndTicks(ihipEvent_t *eh, uint64_t *systemTicks)
+{
+    if (eh->_copy._signal == NULL) {
+        return false;
+    }
+
+    hsa_amd_profiling_async_copy_time_t time;
+    hsa_status_t hsa_status = hsa_amd_profiling_get_async_copy_time(eh->_copy._signal->_hsa_signal, &time);
+    if ((hsa_status != HSA_STATUS_SUCCESS) || (time.end == 0)) {
+        return false;
+    }
+
+    *systemTicks = time.end;
+    return true;
+}
+
+
+//---
+// Non-blocking check for completion of a recording event.  Moves the event to hipEventStatusRecorded with the
+// barrier's end timestamp once the record has completed, and releases the signals held for the timestamp.
+// The timestamp stays 0 if profiling is not available on the queue.
 void ihipSetTs(hipEvent_t e)
 {
     ihipEvent_t *eh = e._handle;
-    if (eh->_state == hipEventStatusRecorded) {
-        // already recorded, done:
+    std::lock_guard<std::mutex> el(eh->_mutex);
+
+    if (eh->_state != hipEventStatusRecording) {
+        // already recorded or never recorded, done:
+        return;
+    } else if (!eh->_signal.completed()) {
         return;
+    } else if (eh->_flags & hipEventDisableTiming) {
+        // Sync point only, skip the timestamp:
+        eh->_state = hipEventStatusRecorded;
     } else {
-        // TODO - use completion-future functions to obtain ticks and timestamps:
-        hsa_signal_t *sig  = static_cast<hsa_signal_t*> (eh->_marker.get_native_handle());
-        if (sig) {
-            if (hsa_signal_load_acquire(*sig) == 0) {
-                eh->_timestamp = eh->_marker.get_end_tick();
-                eh->_state = hipEventStatusRecorded;
-            }
+        ihipDevice_t *device = eh->_device;
+
+        // Dispatch times are already in the system domain:
+        hsa_amd_profiling_dispatch_time_t time;
+        uint64_t systemTicks;
+        if (ihipCopyEndTicks(eh, &systemTicks)) {
+            eh->_timestamp = systemTicks;
+        } else if ((hsa_amd_profiling_get_dispatch_time(device->_hsa_agent, eh->_signal._signal->_hsa_signal, &time) == HSA_STATUS_SUCCESS) &&
+                   (time.end != 0)) {
+            eh->_timestamp = time.end;
         }
+        ihipEventUnhold(eh);
+        eh->_state = hipEventStatusRecorded;
     }
 }
 
@@ -1194,6 +2663,50 @@ void ihipStream_t::setCopyAgents(unsigned kind, ihipCommand_t *commandType, hsa_
 }
 
 
+//---
+// Classify a pointer.  Checks the HIP allocation index first and falls back to the am_memtracker for memory HIP
+// did not register (or registered through a path the index does not cover).
+// Returns false if the pointer is not tracked, ie its address is not available in the GPU address space.
+bool ihipGetAllocInfo(const void *ptr, AllocInfo *info)
+{
+    if (g_allocIndex.lookup(ptr, info)) {
+        return true;
+    }
+
+    hc::accelerator acc;
+    hc::AmPointerInfo amPointerInfo(NULL, NULL, 0, acc, 0, 0);
+    if (hc::am_memtracker_getinfo(&amPointerInfo, ptr) != AM_SUCCESS) {
+        return false;
+    }
+
+    info->_hostPointer        = amPointerInfo._hostPointer;
+    info->_devicePointer      = amPointerInfo._devicePointer;
+    info->_sizeBytes          = amPointerInfo._sizeBytes;
+    info->_isInDeviceMem      = amPointerInfo._isInDeviceMem;
+    info->_appId              = amPointerInfo._appId;
+    info->_appAllocationFlags = amPointerInfo._appAllocationFlags;
+
+    return true;
+}
+
+
+//---
+// Host-to-host copy.  Write-combined destinations use streaming stores - cached stores to WC memory
+// are slow and the CPU does not read it back.
+static void ihipHostMemcpy(void* dst, const void* src, size_t sizeBytes)
+{
+    AllocInfo dstPtrInfo;
+    bool dstWriteCombined = ihipGetAllocInfo(dst, &dstPtrInfo) &&
+                            !dstPtrInfo._isInDeviceMem && (dstPtrInfo._appAllocationFlags & hipHostMallocWriteCombined);
+
+    if (dstWriteCombined) {
+        HostMemcpyNonTemporal(dst, src, sizeBytes);
+    } else {
+        memcpy(dst, src, sizeBytes);
+    }
+}
+
+
 void ihipStream_t::copySync(LockedAccessor_StreamCrit_t &crit, void* dst, const void* src, size_t sizeBytes, unsigned kind)
 {
     ihipDevice_t *device = this->getDevice();
@@ -1202,12 +2715,11 @@ void ihipStream_t::copySync(LockedAccessor_StreamCrit_t &crit, void* dst, const
         throw ihipException(hipErrorInvalidDevice);
     }
 
-    hc::accelerator acc;
-    hc::AmPointerInfo dstPtrInfo(NULL, NULL, 0, acc, 0, 0);
-    hc::AmPointerInfo srcPtrInfo(NULL, NULL, 0, acc, 0, 0);
+    AllocInfo dstPtrInfo;
+    AllocInfo srcPtrInfo;
 
-    bool dstTracked = (hc::am_memtracker_getinfo(&dstPtrInfo, dst) == AM_SUCCESS);
-    bool srcTracked = (hc::am_memtracker_getinfo(&srcPtrInfo, src) == AM_SUCCESS);
+    bool dstTracked = ihipGetAllocInfo(dst, &dstPtrInfo);
+    bool srcTracked = ihipGetAllocInfo(src, &srcPtrInfo);
 
 
     // Resolve default to a specific Kind so we know which algorithm to use:
@@ -1221,20 +2733,33 @@ void ihipStream_t::copySync(LockedAccessor_StreamCrit_t &crit, void* dst, const
 
     if ((kind == hipMemcpyHostToDevice) && (!srcTracked)) {
         int depSignalCnt = preCopyCommand(crit, NULL, &depSignal, ihipCommandCopyH2D);
-        if (HIP_STAGING_BUFFERS) {
-            tprintf(DB_COPY1, "D2H && !dstTracked: staged copy H2D dst=%p src=%p sz=%zu\n", dst, src, sizeBytes);
+        StagingCopyPlan plan = device->copyPlan(true, sizeBytes);
+        if (plan._algorithm != StagingCopyDirect) {
+            tprintf(DB_COPY1, "H2D && !srcTracked: staged copy H2D dst=%p src=%p sz=%zu algorithm=%d chunk=%zu\n", dst, src, sizeBytes, plan._algorithm, plan._chunkBytes);
+
+            // The dependency may be produced by a staging worker (an async staged copy, or a barrier behind one) - wait
+            // for it on the host, so the copy never holds a buffer lock while the worker still has to run:
+            if (depSignalCnt) {
+                SignalWait(depSignal, waitMode());
+            }
 
-            if (HIP_PININPLACE) {
-                device->_staging_buffer[0]->CopyHostToDevicePinInPlace(dst, src, sizeBytes, depSignalCnt ? &depSignal : NULL);
-            } else  {
-                device->_staging_buffer[0]->CopyHostToDevice(dst, src, sizeBytes, depSignalCnt ? &depSignal : NULL);
+            StagingBuffer *stagingBuffer = device->_staging_pool[0]->Acquire(highPriority());
+            try {
+                stagingBuffer->Copy(true, dst, src, sizeBytes, NULL, plan);
+            } catch (...) {
+                device->_staging_pool[0]->Release(stagingBuffer);
+                throw;
             }
+            device->_staging_pool[0]->Release(stagingBuffer);
 
             // The copy waits for inputs and then completes before returning so can reset queue to empty:
             this->wait(crit, true);
         } else {
             // TODO - remove, slow path.
             tprintf(DB_COPY1, "H2D && ! srcTracked: am_copy dst=%p src=%p sz=%zu\n", dst, src, sizeBytes);
+            if (depSignalCnt) {
+                SignalWait(depSignal, waitMode());
+            }
 #if USE_AV_COPY
             _av.copy(src,dst,sizeBytes);
 #else
@@ -1243,10 +2768,24 @@ void ihipStream_t::copySync(LockedAccessor_StreamCrit_t &crit, void* dst, const
         }
     } else if ((kind == hipMemcpyDeviceToHost) && (!dstTracked)) {
         int depSignalCnt = preCopyCommand(crit, NULL, &depSignal, ihipCommandCopyD2H);
-        if (HIP_STAGING_BUFFERS) {
-            tprintf(DB_COPY1, "D2H && !dstTracked: staged copy D2H dst=%p src=%p sz=%zu\n", dst, src, sizeBytes);
-            //printf ("staged-copy- read dep signals\n");
-            device->_staging_buffer[1]->CopyDeviceToHost(dst, src, sizeBytes, depSignalCnt ? &depSignal : NULL);
+        StagingCopyPlan plan = device->copyPlan(false, sizeBytes);
+        if (plan._algorithm != StagingCopyDirect) {
+            tprintf(DB_COPY1, "D2H && !dstTracked: staged copy D2H dst=%p src=%p sz=%zu algorithm=%d chunk=%zu\n", dst, src, sizeBytes, plan._algorithm, plan._chunkBytes);
+
+            // The dependency may be produced by a staging worker (an async staged copy, or a barrier behind one) - wait
+            // for it on the host, so the copy never holds a buffer lock while the worker still has to run:
+            if (depSignalCnt) {
+                SignalWait(depSignal, waitMode());
+            }
+
+            StagingBuffer *stagingBuffer = device->_staging_pool[1]->Acquire(highPriority());
+            try {
+                stagingBuffer->Copy(false, dst, src, sizeBytes, NULL, plan);
+            } catch (...) {
+                device->_staging_pool[1]->Release(stagingBuffer);
+                throw;
+            }
+            device->_staging_pool[1]->Release(stagingBuffer);
 
             // The copy completes before returning so can reset queue to empty:
             this->wait(crit, true);
@@ -1254,6 +2793,9 @@ void ihipStream_t::copySync(LockedAccessor_StreamCrit_t &crit, void* dst, const
         } else {
             // TODO - remove, slow path.
             tprintf(DB_COPY1, "D2H && !dstTracked: am_copy dst=%p src=%p sz=%zu\n", dst, src, sizeBytes);
+            if (depSignalCnt) {
+                SignalWait(depSignal, waitMode());
+            }
 #if USE_AV_COPY
             _av.copy(src, dst, sizeBytes);
 #else
@@ -1265,10 +2807,10 @@ void ihipStream_t::copySync(LockedAccessor_StreamCrit_t &crit, void* dst, const
 
         if (depSignalCnt) {
             // host waits before doing host memory copy.
-            hsa_signal_wait_acquire(depSignal, HSA_SIGNAL_CONDITION_LT, 1, UINT64_MAX, HSA_WAIT_STATE_ACTIVE);
+            SignalWait(depSignal, waitMode());
         }
         tprintf(DB_COPY1, "H2H memcpy dst=%p src=%p sz=%zu\n", dst, src, sizeBytes);
-        memcpy(dst, src, sizeBytes);
+        ihipHostMemcpy(dst, src, sizeBytes);
 
     } else {
         // If not special case - these can all be handled by the hsa async copy:
@@ -1276,12 +2818,12 @@ void ihipStream_t::copySync(LockedAccessor_StreamCrit_t &crit, void* dst, const
         hsa_agent_t srcAgent, dstAgent;
         setCopyAgents(kind, &commandType, &srcAgent, &dstAgent);
 
-        int depSignalCnt = preCopyCommand(crit, NULL, &depSignal, commandType);
-
-        // Get a completion signal:
+        // Get a completion signal first - allocSignal may recycle the signal preCopyCommand returns, once it reads 0:
         ihipSignal_t *ihipSignal = allocSignal(crit);
         hsa_signal_t copyCompleteSignal = ihipSignal->_hsa_signal;
 
+        int depSignalCnt = preCopyCommand(crit, ihipSignal, &depSignal, commandType);
+
         hsa_signal_store_relaxed(copyCompleteSignal, 1);
 
         tprintf(DB_COPY1, "HSA Async_copy dst=%p src=%p sz=%zu\n", dst, src, sizeBytes);
@@ -1292,6 +2834,7 @@ void ihipStream_t::copySync(LockedAccessor_StreamCrit_t &crit, void* dst, const
         if (hsa_status == HSA_STATUS_SUCCESS) {
             waitCopy(crit, ihipSignal); // wait for copy, and return to pool.
         } else {
+            hsa_signal_store_relaxed(copyCompleteSignal, 0);
             throw ihipException(hipErrorInvalidValue);
         }
     }
@@ -1326,16 +2869,15 @@ void ihipStream_t::copyAsync(void* dst, const void* src, size_t sizeBytes, unsig
         */
         this->wait(crit);
 
-        memcpy(dst, src, sizeBytes);
+        ihipHostMemcpy(dst, src, sizeBytes);
 
     } else {
         bool trueAsync = true;
 
-        hc::accelerator acc;
-        hc::AmPointerInfo dstPtrInfo(NULL, NULL, 0, acc, 0, 0);
-        hc::AmPointerInfo srcPtrInfo(NULL, NULL, 0, acc, 0, 0);
-        bool dstTracked = (hc::am_memtracker_getinfo(&dstPtrInfo, dst) == AM_SUCCESS);
-        bool srcTracked = (hc::am_memtracker_getinfo(&srcPtrInfo, src) == AM_SUCCESS);
+        AllocInfo dstPtrInfo;
+        AllocInfo srcPtrInfo;
+        bool dstTracked = ihipGetAllocInfo(dst, &dstPtrInfo);
+        bool srcTracked = ihipGetAllocInfo(src, &srcPtrInfo);
 
 
         // "tracked" really indicates if the pointer's virtual address is available in the GPU address space.
@@ -1350,23 +2892,38 @@ void ihipStream_t::copyAsync(void* dst, const void* src, size_t sizeBytes, unsig
             kind = resolveMemcpyDirection(srcInDeviceMem, dstInDeviceMem);
         }
 
-
-        ihipSignal_t *ihip_signal = allocSignal(crit);
-        hsa_signal_store_relaxed(ihip_signal->_hsa_signal, 1);
+        // Unpinned host memory to or from the device - may be staged asynchronously:
+        bool unpinnedCopy = ((kind == hipMemcpyHostToDevice) && !srcTracked && dstTracked) ||
+                            ((kind == hipMemcpyDeviceToHost) && srcTracked && !dstTracked);
+        StagingCopyPlan plan(StagingCopyDirect);
+        if (unpinnedCopy && HIP_STAGING_ASYNC) {
+            plan = device->copyPlan(kind == hipMemcpyHostToDevice, sizeBytes);
+        }
 
 
         if(trueAsync == true){
 
+            ihipSignal_t *ihip_signal = allocSignal(crit);
+            hsa_signal_store_relaxed(ihip_signal->_hsa_signal, 1);
+
             ihipCommand_t commandType;
             hsa_agent_t srcAgent, dstAgent;
             setCopyAgents(kind, &commandType, &srcAgent, &dstAgent);
 
             hsa_signal_t depSignal;
-            int depSignalCnt = preCopyCommand(crit, ihip_signal, &depSignal, commandType);
+            std::vector<hsa_signal_t> trackedDepSignals;
+            const hsa_signal_t *depSignals = &depSignal;
+            int depSignalCnt;
+            if (_trackHazards) {
+                depSignalCnt = preTrackedCopyCommand(crit, ihip_signal, dst, src, sizeBytes, trackedDepSignals);
+                depSignals = trackedDepSignals.data();
+            } else {
+                depSignalCnt = preCopyCommand(crit, ihip_signal, &depSignal, commandType);
+            }
 
-            tprintf (DB_SYNC, " copy-async, waitFor=%lu completion=#%lu(%lu)\n", depSignalCnt? depSignal.handle:0x0, ihip_signal->_sig_id, ihip_signal->_hsa_signal.handle);
+            tprintf (DB_SYNC, " copy-async, waitFor=%lu(%d signals) completion=#%lu(%lu)\n", depSignalCnt? depSignals[0].handle:0x0, depSignalCnt, ihip_signal->_sig_id, ihip_signal->_hsa_signal.handle);
 
-            hsa_status_t hsa_status = hsa_amd_memory_async_copy(dst, dstAgent, src, srcAgent, sizeBytes, depSignalCnt, depSignalCnt ? &depSignal:0x0, ihip_signal->_hsa_signal);
+            hsa_status_t hsa_status = hsa_amd_memory_async_copy(dst, dstAgent, src, srcAgent, sizeBytes, depSignalCnt, depSignalCnt ? depSignals:0x0, ihip_signal->_hsa_signal);
 
 
             if (hsa_status == HSA_STATUS_SUCCESS) {
@@ -1377,8 +2934,36 @@ void ihipStream_t::copyAsync(void* dst, const void* src, size_t sizeBytes, unsig
             } else {
                 // This path can be hit if src or dst point to unpinned host memory.
                 // TODO-stream - does async-copy fall back to sync if input pointers are not pinned?
+                // Nothing will decrement the signal, release it so in-order reclaim does not stall on it:
+                hsa_signal_store_relaxed(ihip_signal->_hsa_signal, 0);
                 throw ihipException(hipErrorInvalidValue);
             }
+        } else if (plan._algorithm != StagingCopyDirect) {
+            // Unpinned host memory - hand the copy to the staging worker for this direction.
+            // The stream's copy signal tracks completion so later commands and events order behind the copy.
+            bool hostToDevice = (kind == hipMemcpyHostToDevice);
+
+            ihipSignal_t *ihip_signal = allocSignal(crit);
+            hsa_signal_store_relaxed(ihip_signal->_hsa_signal, 1);
+
+            hsa_signal_t depSignal;
+            int depSignalCnt = preCopyCommand(crit, ihip_signal, &depSignal, hostToDevice ? ihipCommandCopyH2D : ihipCommandCopyD2H);
+            if (!depSignalCnt) {
+                depSignal.handle = 0;
+            }
+
+            // The worker is not in any device queue, so every following command must depend on the copy signal:
+            crit->_last_command_type = ihipCommandCopyStaged;
+
+            tprintf (DB_SYNC, " staged-copy-async, waitFor=%lu completion=#%lu(%lu)\n", depSignal.handle, ihip_signal->_sig_id, ihip_signal->_hsa_signal.handle);
+
+            device->_staging_pool[hostToDevice ? 0 : 1]->StreamBuffer(_id)->EnqueueCopy(hostToDevice, dst, src, sizeBytes, depSignal, ihip_signal->_hsa_signal, plan,
+                                                                                        highPriority(), &_asyncError);
+
+            if (HIP_LAUNCH_BLOCKING) {
+                tprintf(DB_SYNC, "LAUNCH_BLOCKING for completion of hipMemcpyAsync(%zu)\n", sizeBytes);
+                this->wait(crit);
+            }
         } else {
             copySync(crit, dst, src, sizeBytes, kind);
         }
@@ -19,6 +19,7 @@ THE SOFTWARE.
 
 #include "hip_runtime.h"
 #include "hcc_detail/hip_hcc.h"
+#include "hcc_detail/memory_pool.h"
 #include "hcc_detail/trace_helper.h"
 #include <hsa.h>
 #include <hc_am.hpp>
@@ -40,10 +41,8 @@ hipError_t hipPointerGetAttributes(hipPointerAttribute_t *attributes, void* ptr)
 
     hipError_t e = hipSuccess;
 
-    hc::accelerator acc;
-    hc::AmPointerInfo amPointerInfo(NULL, NULL, 0, acc, 0, 0);
-    am_status_t status = hc::am_memtracker_getinfo(&amPointerInfo, ptr);
-    if (status == AM_SUCCESS) {
+    AllocInfo amPointerInfo;
+    if (ihipGetAllocInfo(ptr, &amPointerInfo)) {
 
         attributes->memoryType    = amPointerInfo._isInDeviceMem ? hipMemoryTypeDevice: hipMemoryTypeHost;
         attributes->hostPointer   = amPointerInfo._hostPointer;
@@ -93,10 +92,8 @@ hipError_t hipHostGetDevicePointer(void **devicePointer, void *hostPointer, unsi
     if (flags != 0) {
         e = hipErrorInvalidValue;
     } else {
-        hc::accelerator acc;
-        hc::AmPointerInfo amPointerInfo(NULL, NULL, 0, acc, 0, 0);
-        am_status_t status = hc::am_memtracker_getinfo(&amPointerInfo, hostPointer);
-        if (status == AM_SUCCESS) {
+        AllocInfo amPointerInfo;
+        if (ihipGetAllocInfo(hostPointer, &amPointerInfo)) {
             *devicePointer = amPointerInfo._devicePointer;
         } else {
             e = hipErrorMemoryAllocation;
@@ -110,6 +107,37 @@ hipError_t hipHostGetDevicePointer(void **devicePointer, void *hostPointer, unsi
 
 
 
+//---
+// Allocate device memory on the specified device, register it with the tracker and map it to the enabled peers.
+hipError_t ihipDeviceMalloc(ihipDevice_t *device, void **ptr, size_t sizeBytes)
+{
+    hipError_t  hip_status = hipSuccess;
+
+    const unsigned am_flags = 0;
+    *ptr = hc::am_alloc(sizeBytes, device->_acc, am_flags);
+
+    if (sizeBytes && (*ptr == NULL)) {
+        hip_status = hipErrorMemoryAllocation;
+    } else {
+        hc::am_memtracker_update(*ptr, device->_device_index, 0);
+
+        AllocInfo info = { NULL, *ptr, sizeBytes, true, (int)device->_device_index, 0 };
+        g_allocIndex.locked_insert(*ptr, info, device->_device_index);
+        {
+            LockedAccessor_DeviceCrit_t crit(device->criticalData());
+            if (crit->peerCnt() > 1) { // peerCnt includes self so only call allow_access if other peers involved:
+                hsa_status_t hsa_status = hsa_amd_agents_allow_access(crit->peerCnt(), crit->peerAgents(), NULL, *ptr);
+                if (hsa_status != HSA_STATUS_SUCCESS) {
+                    hip_status = hipErrorMemoryAllocation; 
+                }
+            }
+        }
+    }
+
+    return hip_status;
+}
+
+
 //---
 /**
  * @returns #hipSuccess #hipErrorMemoryAllocation
@@ -123,23 +151,45 @@ hipError_t hipMalloc(void** ptr, size_t sizeBytes)
 	auto device = ihipGetTlsDefaultDevice();
 
     if (device) {
-        const unsigned am_flags = 0;
-        *ptr = hc::am_alloc(sizeBytes, device->_acc, am_flags);
-
-        if (sizeBytes && (*ptr == NULL)) {
-            hip_status = hipErrorMemoryAllocation;
-        } else {
-            hc::am_memtracker_update(*ptr, device->_device_index, 0);
-            {
-                LockedAccessor_DeviceCrit_t crit(device->criticalData());
-                if (crit->peerCnt() > 1) { // peerCnt includes self so only call allow_access if other peers involved:
-                    hsa_status_t hsa_status = hsa_amd_agents_allow_access(crit->peerCnt(), crit->peerAgents(), NULL, *ptr);
-                    if (hsa_status != HSA_STATUS_SUCCESS) {
-                        hip_status = hipErrorMemoryAllocation; 
-                    }
-                }
+        hip_status = ihipDeviceMalloc(device, ptr, sizeBytes);
+        if (hip_status == hipErrorMemoryAllocation) {
+            // Memory may be held by pending hipFree calls or the hipMallocAsync cache, release what we can and try again:
+            if (device->_deferred_free) {
+                device->_deferred_free->locked_reclaim(true);
+            }
+            if (device->_mem_pool) {
+                device->_mem_pool->locked_trimTo(0);
             }
+            hip_status = ihipDeviceMalloc(device, ptr, sizeBytes);
+        }
+    } else {
+        hip_status = hipErrorMemoryAllocation;
+    }
+
+    return ihipLogStatus(hip_status);
+}
+
+
+//---
+/**
+ * @returns #hipSuccess #hipErrorMemoryAllocation #hipErrorInvalidValue
+ */
+hipError_t hipMallocAsync(void** ptr, size_t sizeBytes, hipStream_t stream)
+{
+    HIP_INIT_API(ptr, sizeBytes, stream);
+
+    hipError_t  hip_status = hipSuccess;
+
+    auto device = stream ? stream->getDevice() : ihipGetTlsDefaultDevice();
+
+    if (ptr == NULL) {
+        hip_status = hipErrorInvalidValue;
+    } else if (device && device->_mem_pool) {
+        if (stream == NULL) {
+            // Allocation does not enqueue any work, so no need to synchronize the NULL stream here.
+            stream = device->_default_stream;
         }
+        hip_status = device->_mem_pool->locked_alloc(ptr, sizeBytes, stream);
     } else {
         hip_status = hipErrorMemoryAllocation;
     }
@@ -148,6 +198,115 @@ hipError_t hipMalloc(void** ptr, size_t sizeBytes)
 }
 
 
+//---
+/**
+ * @returns #hipSuccess #hipErrorInvalidDevicePointer
+ */
+hipError_t hipFreeAsync(void* ptr, hipStream_t stream)
+{
+    HIP_INIT_API(ptr, stream);
+
+    hipError_t hipStatus = hipErrorInvalidDevicePointer;
+
+    if (ptr == NULL) {
+        hipStatus = hipSuccess;
+    } else {
+        // NULL stream: the free must be ordered after work in all blocking streams.
+        stream = ihipSyncAndResolveStream(stream);
+
+        ihipDevice_t *device = stream->getDevice();
+        if (device && device->_mem_pool && device->_mem_pool->locked_free(ptr, stream)) {
+            hipStatus = hipSuccess;
+        }
+    }
+
+    return ihipLogStatus(hipStatus);
+}
+
+
+//---
+/**
+ * @returns #hipSuccess #hipErrorInvalidDevice
+ */
+hipError_t hipDeviceMemPoolTrimTo(size_t minBytesToKeep)
+{
+    HIP_INIT_API(minBytesToKeep);
+
+    hipError_t e = hipSuccess;
+
+    ihipDevice_t *device = ihipGetTlsDefaultDevice();
+    if (device && device->_mem_pool) {
+        device->_mem_pool->locked_trimTo(minBytesToKeep);
+    } else {
+        e = hipErrorInvalidDevice;
+    }
+
+    return ihipLogStatus(e);
+}
+
+
+//---
+/**
+ * @returns #hipSuccess #hipErrorInvalidDevice
+ */
+hipError_t hipDeviceMemPoolSetReleaseThreshold(size_t releaseThreshold)
+{
+    HIP_INIT_API(releaseThreshold);
+
+    hipError_t e = hipSuccess;
+
+    ihipDevice_t *device = ihipGetTlsDefaultDevice();
+    if (device && device->_mem_pool) {
+        device->_mem_pool->locked_setReleaseThreshold(releaseThreshold);
+    } else {
+        e = hipErrorInvalidDevice;
+    }
+
+    return ihipLogStatus(e);
+}
+
+
+//---
+/**
+ * @returns #hipSuccess #hipErrorInvalidDevice
+ */
+hipError_t hipDeviceMemPoolGetUsage(size_t *reservedBytes, size_t *usedBytes, size_t *reservedHighWater, size_t *usedHighWater)
+{
+    HIP_INIT_API(reservedBytes, usedBytes, reservedHighWater, usedHighWater);
+
+    hipError_t e = hipSuccess;
+
+    ihipDevice_t *device = ihipGetTlsDefaultDevice();
+    if (device && device->_mem_pool) {
+        device->_mem_pool->locked_getUsage(reservedBytes, usedBytes, reservedHighWater, usedHighWater);
+    } else {
+        e = hipErrorInvalidDevice;
+    }
+
+    return ihipLogStatus(e);
+}
+
+
+//---
+/**
+ * @returns #hipSuccess #hipErrorInvalidDevice
+ */
+hipError_t hipDeviceMemPoolResetHighWater()
+{
+    HIP_INIT_API();
+
+    hipError_t e = hipSuccess;
+
+    ihipDevice_t *device = ihipGetTlsDefaultDevice();
+    if (device && device->_mem_pool) {
+        device->_mem_pool->locked_resetHighWater();
+    } else {
+        e = hipErrorInvalidDevice;
+    }
+
+    return ihipLogStatus(e);
+}
+
 
 hipError_t hipHostMalloc(void** ptr, size_t sizeBytes, unsigned int flags)
 {
@@ -164,6 +323,9 @@ hipError_t hipHostMalloc(void** ptr, size_t sizeBytes, unsigned int flags)
                 hip_status = hipErrorMemoryAllocation;
             }else{
                 hc::am_memtracker_update(*ptr, device->_device_index, 0);
+
+                AllocInfo info = { *ptr, *ptr, sizeBytes, false, (int)device->_device_index, 0 };
+                g_allocIndex.locked_insert(*ptr, info, device->_device_index);
             }
             tprintf(DB_MEM, " %s: pinned ptr=%p\n", __func__, *ptr);
         } else if(flags & hipHostMallocMapped){
@@ -172,6 +334,9 @@ hipError_t hipHostMalloc(void** ptr, size_t sizeBytes, unsigned int flags)
                 hip_status = hipErrorMemoryAllocation;
             }else{
                 hc::am_memtracker_update(*ptr, device->_device_index, flags);
+
+                AllocInfo info = { *ptr, *ptr, sizeBytes, false, (int)device->_device_index, flags };
+                g_allocIndex.locked_insert(*ptr, info, device->_device_index);
                 {
                     // TODO - allow_access only works for device memory, need to change am_alloc to allocate host directly.
                     LockedAccessor_DeviceCrit_t crit(device->criticalData());
@@ -213,10 +378,8 @@ hipError_t hipHostGetFlags(unsigned int* flagsPtr, void* hostPtr)
 
 	hipError_t hip_status = hipSuccess;
 
-	hc::accelerator acc;
-	hc::AmPointerInfo amPointerInfo(NULL, NULL, 0, acc, 0, 0);
-	am_status_t status = hc::am_memtracker_getinfo(&amPointerInfo, hostPtr);
-	if(status == AM_SUCCESS){
+	AllocInfo amPointerInfo;
+	if(ihipGetAllocInfo(hostPtr, &amPointerInfo)){
 		*flagsPtr = amPointerInfo._appAllocationFlags;
 		if(*flagsPtr == 0){
 			hip_status = hipErrorInvalidValue;
@@ -254,6 +417,15 @@ hipError_t hipHostRegister(void *hostPtr, size_t sizeBytes, unsigned int flags)
 //		hsa_status_t hsa_status = hsa_amd_memory_lock(hostPtr, sizeBytes, &device->_hsa_agent, 1, &srcPtr);
 		if(am_status == AM_SUCCESS){
 			hip_status = hipSuccess;	
+
+			// The device pointer for the locked range is only known to the tracker, so index what it recorded:
+			hc::accelerator acc;
+			hc::AmPointerInfo amPointerInfo(NULL, NULL, 0, acc, 0, 0);
+			if(hc::am_memtracker_getinfo(&amPointerInfo, hostPtr) == AM_SUCCESS){
+				AllocInfo info = { amPointerInfo._hostPointer, amPointerInfo._devicePointer, amPointerInfo._sizeBytes,
+				                   amPointerInfo._isInDeviceMem, amPointerInfo._appId, amPointerInfo._appAllocationFlags };
+				g_allocIndex.locked_insert(amPointerInfo._hostPointer, info, device->_device_index);
+			}
 		}else{
 			hip_status = hipErrorMemoryAllocation;
 		}
@@ -277,6 +449,7 @@ hipError_t hipHostUnregister(void *hostPtr)
 	if(hostPtr == NULL){
 		hip_status = hipErrorInvalidValue;
 	}else{
+	g_allocIndex.locked_remove(hostPtr);
 	hsa_status_t hsa_status = hsa_amd_memory_unlock(hostPtr);
 	if(hsa_status != HSA_STATUS_SUCCESS){
 		hip_status = hipErrorInvalidValue;
@@ -336,7 +509,7 @@ hipError_t hipMemcpy(void* dst, const void* src, size_t sizeBytes, hipMemcpyKind
 /**
  * @result #hipSuccess, #hipErrorInvalidDevice, #hipErrorInvalidMemcpyDirection, 
  * @result #hipErrorInvalidValue : If dst==NULL or src==NULL, or other bad argument.
- * @warning on HCC hipMemcpyAsync does not support overlapped H2D and D2H copies.
+ * @warning on HCC, overlapped H2D and D2H copies must be issued to different streams; each direction runs on its own DMA engine.
  * @warning on HCC hipMemcpyAsync requires that any host pointers are pinned (ie via the hipMallocHost call).
  */
 //---
@@ -346,6 +519,21 @@ hipError_t hipMemcpyAsync(void* dst, const void* src, size_t sizeBytes, hipMemcp
 
     hipError_t e = hipSuccess;
 
+    if (stream && stream->_capture) {
+        if ((dst == NULL) || (src == NULL)) {
+            return ihipLogStatus(hipErrorInvalidValue);
+        }
+        ihipGraphNode_t node;
+        node._type      = ihipGraphNodeCopy;
+        node._dst       = dst;
+        node._src       = src;
+        node._sizeBytes = sizeBytes;
+        node._kind      = kind;
+        stream->_capture->addNode(node);
+
+        return ihipLogStatus(hipSuccess);
+    }
+
     stream = ihipSyncAndResolveStream(stream);
 
 
@@ -366,6 +554,22 @@ hipError_t hipMemcpyAsync(void* dst, const void* src, size_t sizeBytes, hipMemcp
 }
 
 
+//---
+// Launch the memset kernel into the stream's queue.  Caller orders it in the stream (and holds the stream lock).
+hc::completion_future ihipMemset(hipStream_t stream, void* dst, int value, size_t sizeBytes)
+{
+    if ((sizeBytes & 0x3) == 0) {
+        // use a faster word-per-workitem copy:
+        value = value & 0xff;
+        unsigned value32 = (value << 24) | (value << 16) | (value << 8) | (value) ;
+        return ihipMemsetKernel<unsigned> (stream, static_cast<unsigned*> (dst), value32, sizeBytes/sizeof(unsigned));
+    } else {
+        // use a slow byte-per-workitem copy:
+        return ihipMemsetKernel<char> (stream, static_cast<char*> (dst), value, sizeBytes);
+    }
+}
+
+
 // TODO-sync: function is async unless target is pinned host memory - then these are fully sync.
 /** @return #hipErrorInvalidValue
  */
@@ -375,6 +579,17 @@ hipError_t hipMemsetAsync(void* dst, int  value, size_t sizeBytes, hipStream_t s
 
     hipError_t e = hipSuccess;
 
+    if (stream && stream->_capture) {
+        ihipGraphNode_t node;
+        node._type      = ihipGraphNodeMemset;
+        node._dst       = dst;
+        node._value     = value;
+        node._sizeBytes = sizeBytes;
+        stream->_capture->addNode(node);
+
+        return ihipLogStatus(hipSuccess);
+    }
+
     stream =  ihipSyncAndResolveStream(stream);
 
     if (stream) {
@@ -382,24 +597,11 @@ hipError_t hipMemsetAsync(void* dst, int  value, size_t sizeBytes, hipStream_t s
 
         hc::completion_future cf ;
 
-        if ((sizeBytes & 0x3) == 0) {
-            // use a faster word-per-workitem copy:
-            try {
-                value = value & 0xff;
-                unsigned value32 = (value << 24) | (value << 16) | (value << 8) | (value) ;
-                cf = ihipMemsetKernel<unsigned> (stream, static_cast<unsigned*> (dst), value32, sizeBytes/sizeof(unsigned));
-            }
-            catch (std::exception &ex) {
-                e = hipErrorInvalidValue;
-            }
-        } else {
-            // use a slow byte-per-workitem copy:
-            try {
-                cf = ihipMemsetKernel<char> (stream, static_cast<char*> (dst), value, sizeBytes);
-            }
-            catch (std::exception &ex) {
-                e = hipErrorInvalidValue;
-            }
+        try {
+            cf = ihipMemset(stream, dst, value, sizeBytes);
+        }
+        catch (std::exception &ex) {
+            e = hipErrorInvalidValue;
         }
 
         stream->lockclose_postKernelCommand(cf);
@@ -445,6 +647,9 @@ hipError_t hipMemGetInfo  (size_t *free, size_t *total)
         }
 
         if (free) {
+            if (hipDevice->_deferred_free) {
+                hipDevice->_deferred_free->locked_reclaim(false);
+            }
             // TODO - replace with kernel-level for reporting free memory:
             size_t deviceMemSize, hostMemSize, userMemSize;
             hc::am_memtracker_sizeinfo(hipDevice->_acc, &deviceMemSize, &hostMemSize, &userMemSize);
@@ -460,23 +665,36 @@ hipError_t hipMemGetInfo  (size_t *free, size_t *total)
 
 
 //---
+// The memory is not released until commands already enqueued on the device (in any stream) complete, but hipFree
+// does not wait for them - the release is done by the device's DeferredFreeQueue.
 hipError_t hipFree(void* ptr)
 {
     HIP_INIT_API(ptr);
 
     hipError_t hipStatus = hipErrorInvalidDevicePointer;
 
-   // Synchronize to ensure all work has finished.
-    ihipGetTlsDefaultDevice()->locked_waitAllStreams(); // ignores non-blocking streams, this waits for all activity to finish.
-
     if (ptr) {
-        hc::accelerator acc;
-        hc::AmPointerInfo amPointerInfo(NULL, NULL, 0, acc, 0, 0);
-        am_status_t status = hc::am_memtracker_getinfo(&amPointerInfo, ptr);
-        if(status == AM_SUCCESS){
+        AllocInfo amPointerInfo;
+        if(ihipGetAllocInfo(ptr, &amPointerInfo)){
             if(amPointerInfo._hostPointer == NULL){
-                hc::am_free(ptr);
-                hipStatus = hipSuccess;
+                ihipDevice_t *device = ihipGetDevice(amPointerInfo._appId);
+                if (device == NULL) {
+                    device = ihipGetTlsDefaultDevice();
+                }
+
+                std::vector<ihipSignalRef_t> deps;
+                device->locked_lastCompletionSignals(deps);
+
+                if (device->_mem_pool && device->_mem_pool->locked_isLive(ptr)) {
+                    // hipMallocAsync memory goes back to the pool.  The default stream waits for every stream, and the
+                    // free is ordered after that - so the block is reused only once all earlier commands complete:
+                    device->_default_stream->locked_waitSignals(deps);
+                    if (device->_mem_pool->locked_free(ptr, device->_default_stream)) {
+                        hipStatus = hipSuccess;
+                    }
+                } else if (device->_deferred_free->locked_enqueue(ptr, deps)) {
+                    hipStatus = hipSuccess;
+                }
             }
         }
     }
@@ -494,11 +712,10 @@ hipError_t hipHostFree(void* ptr)
 
     hipError_t hipStatus = hipErrorInvalidDevicePointer;
     if (ptr) {
-        hc::accelerator acc;
-        hc::AmPointerInfo amPointerInfo(NULL, NULL, 0, acc, 0, 0);
-        am_status_t status = hc::am_memtracker_getinfo(&amPointerInfo, ptr);
-        if(status == AM_SUCCESS){
+        AllocInfo amPointerInfo;
+        if(ihipGetAllocInfo(ptr, &amPointerInfo)){
             if(amPointerInfo._hostPointer == ptr){
+                g_allocIndex.locked_remove(ptr);
                 hc::am_free(ptr);
                 hipStatus = hipSuccess;
             }
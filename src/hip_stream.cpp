@@ -28,18 +28,20 @@ THE SOFTWARE.
 //
 
 //---
-hipError_t ihipStreamCreate(hipStream_t *stream, unsigned int flags)
+hipError_t ihipStreamCreate(hipStream_t *stream, unsigned int flags, int priority)
 {
     ihipDevice_t *device = ihipGetTlsDefaultDevice();
-    hc::accelerator acc = device->_acc;
 
     // TODO - se try-catch loop to detect memory exception?
     //
     //
-    //Note this is an execute_in_order queue, so all kernels submitted will atuomatically wait for prev to complete:
-    //This matches CUDA stream behavior:
+    // Queues are in-order, so all kernels submitted will automatically wait for prev to complete.
+    // This matches CUDA stream behavior.  The queue comes from the device pool and may be shared with other streams
+    // of the same priority.
 
-    auto istream = new ihipStream_t(device->_device_index, acc.create_view(), flags);
+    priority = std::min(std::max(priority, hipStreamPriorityHigh), hipStreamPriorityLow);
+
+    auto istream = new ihipStream_t(device->_device_index, device->_queue_pool.locked_acquire(priority), flags);
 
     device->locked_addStream(istream);
 
@@ -55,22 +57,54 @@ hipError_t hipStreamCreateWithFlags(hipStream_t *stream, unsigned int flags)
 {
     HIP_INIT_API(stream, flags);
 
-    return ihipLogStatus(ihipStreamCreate(stream, flags));
+    return ihipLogStatus(ihipStreamCreate(stream, flags, hipStreamPriorityNormal));
+
+}
+
+
+//---
+/**
+ * @return #hipSuccess
+ */
+hipError_t hipStreamCreateWithPriority(hipStream_t *stream, unsigned int flags, int priority)
+{
+    HIP_INIT_API(stream, flags, priority);
 
+    return ihipLogStatus(ihipStreamCreate(stream, flags, priority));
 }
 
+
 //---
 hipError_t hipStreamCreate(hipStream_t *stream) 
 {
     HIP_INIT_API(stream);
 
-    return ihipLogStatus(ihipStreamCreate(stream, hipStreamDefault));
+    return ihipLogStatus(ihipStreamCreate(stream, hipStreamDefault, hipStreamPriorityNormal));
+}
+
+
+//---
+/**
+ * @return #hipSuccess
+ */
+hipError_t hipDeviceGetStreamPriorityRange(int *leastPriority, int *greatestPriority)
+{
+    HIP_INIT_API(leastPriority, greatestPriority);
+
+    if (leastPriority) {
+        *leastPriority = hipStreamPriorityLow;
+    }
+    if (greatestPriority) {
+        *greatestPriority = hipStreamPriorityHigh;
+    }
+
+    return ihipLogStatus(hipSuccess);
 }
 
 
 //---
 /**
- * @bug This function conservatively waits for all work in the specified stream to complete.
+ * @return #hipSuccess, #hipErrorInvalidResourceHandle
  */
 hipError_t hipStreamWaitEvent(hipStream_t stream, hipEvent_t event, unsigned int flags)
 {
@@ -78,12 +112,17 @@ hipError_t hipStreamWaitEvent(hipStream_t stream, hipEvent_t event, unsigned int
 
     hipError_t e = hipSuccess;
 
-    {
-        // TODO-hcc Convert to use create_blocking_marker(...) functionality.
-        // Currently we have a super-conservative version of this - block on host, and drain the queue.
-        // This should create a barrier packet in the target queue.
-        stream->locked_wait();
-        e = hipSuccess;
+    ihipEvent_t *eh = event._handle;
+
+    if ((eh == NULL) || (eh->_state == hipEventStatusUnitialized)) {
+        e = hipErrorInvalidResourceHandle;
+    } else {
+        if (stream == hipStreamNull) {
+            stream = ihipGetTlsDefaultDevice()->_default_stream;
+        }
+
+        // Enqueue a barrier packet in the target stream that waits for the event - the host does not block.
+        stream->locked_waitEvent(eh);
     }
 
     return ihipLogStatus(e);
@@ -99,10 +138,10 @@ hipError_t hipStreamSynchronize(hipStream_t stream)
 
     if (stream == NULL) {
         ihipDevice_t *device = ihipGetTlsDefaultDevice();
-        device->locked_syncDefaultStream(true/*waitOnSelf*/);
+        e = device->locked_syncDefaultStream(true/*waitOnSelf*/);
     } else {
         stream->locked_wait();
-        e = hipSuccess;
+        e = stream->takeAsyncError();
     }
 
 
@@ -158,4 +197,67 @@ hipError_t hipStreamGetFlags(hipStream_t stream, unsigned int *flags)
 }
 
 
+//---
+/**
+ * @return #hipSuccess, #hipErrorInvalidValue, #hipErrorInvalidResourceHandle
+ */
+hipError_t hipStreamGetPriority(hipStream_t stream, int *priority)
+{
+    HIP_INIT_API(stream, priority);
+
+    if (priority == NULL) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    } else if (stream == NULL) {
+        return ihipLogStatus(hipErrorInvalidResourceHandle);
+    } else {
+        *priority = stream->priority();
+        return ihipLogStatus(hipSuccess);
+    }
+}
+
+
+//---
+hipError_t hipStreamAnnotateKernelRange(hipStream_t stream, const void *ptr, size_t sizeBytes, unsigned int access)
+{
+    HIP_INIT_API(stream, ptr, sizeBytes, access);
+
+    if ((ptr == NULL) || (access & ~(hipKernelRangeRead | hipKernelRangeWrite)) || (access == 0)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    if (stream == NULL) {
+        stream = ihipGetTlsDefaultDevice()->_default_stream;
+    }
+    stream->locked_annotateKernelRange(ptr, sizeBytes, access);
+
+    return ihipLogStatus(hipSuccess);
+}
+
+
+//---
+hipError_t hipStreamAddCallback(hipStream_t stream, hipStreamCallback_t callback, void *userData, unsigned int flags)
+{
+    HIP_INIT_API(stream, callback, userData, flags);
+
+    if ((callback == NULL) || (flags & ~hipStreamCallbackBlocking) || (stream && stream->_capture)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    hipError_t e = hipSuccess;
+
+    // The callback receives the stream as passed in, the NULL stream first waits for the other blocking streams:
+    hipStream_t userStream = stream;
+    stream = ihipSyncAndResolveStream(stream);
+
+    try {
+        stream->locked_addCallback(userStream, callback, userData, flags);
+    }
+    catch (ihipException ex) {
+        e = ex._code;
+    }
+
+    return ihipLogStatus(e);
+}
+
+
 
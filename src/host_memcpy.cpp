@@ -0,0 +1,164 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANNTY OF ANY KIND, EXPRESS OR
+IMPLIED, INNCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANNY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER INN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR INN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <cstring>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HOST_MEMCPY_X86 1
+#include <immintrin.h>
+#endif
+
+#include "hcc_detail/host_memcpy.h"
+
+// Copies smaller than this use plain memcpy - the streaming loop does not pay off and small
+// copies are likely to be read again soon.
+static const size_t s_minStreamingSize = 4096;
+
+// Distance (in bytes) to prefetch ahead of the source pointer.
+static const size_t s_prefetchDistance = 512;
+
+
+static void memcpyLibc(void* dst, const void* src, size_t sizeBytes)
+{
+    memcpy(dst, src, sizeBytes);
+}
+
+
+#if HOST_MEMCPY_X86
+
+//---
+// Each streaming implementation copies the unaligned head with memcpy so the stores are aligned
+// to the vector width, then streams whole vectors, then copies the tail with memcpy.
+#define STREAMING_COPY_BODY(VEC_BYTES, UNROLL, COPY_ONE)                                    \
+    char* d = static_cast<char*> (dst);                                                     \
+    const char* s = static_cast<const char*> (src);                                         \
+    if (sizeBytes < s_minStreamingSize) {                                                   \
+        memcpy(d, s, sizeBytes);                                                            \
+        return;                                                                             \
+    }                                                                                       \
+    size_t head = (VEC_BYTES - ((uintptr_t)d & (VEC_BYTES-1))) & (VEC_BYTES-1);              \
+    memcpy(d, s, head);                                                                     \
+    d += head; s += head; sizeBytes -= head;                                                \
+    const size_t stepBytes = VEC_BYTES * UNROLL;                                            \
+    while (sizeBytes >= stepBytes) {                                                        \
+        _mm_prefetch(s + s_prefetchDistance, _MM_HINT_NTA);                                 \
+        _mm_prefetch(s + s_prefetchDistance + 64, _MM_HINT_NTA);                            \
+        for (int u=0; u<UNROLL; u++) {                                                      \
+            COPY_ONE(d + u*VEC_BYTES, s + u*VEC_BYTES);                                     \
+        }                                                                                   \
+        d += stepBytes; s += stepBytes; sizeBytes -= stepBytes;                             \
+    }                                                                                       \
+    _mm_sfence();                                                                           \
+    memcpy(d, s, sizeBytes);
+
+
+#define COPY_SSE2(d, s)   _mm_stream_si128((__m128i*)(d), _mm_loadu_si128((const __m128i*)(s)))
+#define COPY_AVX2(d, s)   _mm256_stream_si256((__m256i*)(d), _mm256_loadu_si256((const __m256i*)(s)))
+#define COPY_AVX512(d, s) _mm512_stream_si512((__m512i*)(d), _mm512_loadu_si512((const void*)(s)))
+
+
+__attribute__((target("sse2")))
+static void memcpyNonTemporalSse2(void* dst, const void* src, size_t sizeBytes)
+{
+    STREAMING_COPY_BODY(16, 8, COPY_SSE2);
+}
+
+
+__attribute__((target("avx2")))
+static void memcpyNonTemporalAvx2(void* dst, const void* src, size_t sizeBytes)
+{
+    STREAMING_COPY_BODY(32, 4, COPY_AVX2);
+}
+
+
+__attribute__((target("avx512f")))
+static void memcpyNonTemporalAvx512(void* dst, const void* src, size_t sizeBytes)
+{
+    STREAMING_COPY_BODY(64, 2, COPY_AVX512);
+}
+
+#endif
+
+
+static HostMemcpyFn s_nonTemporalMemcpy = memcpyLibc;
+
+
+//---
+HostMemcpyFn HostMemcpyGetImpl(HostMemcpyIsa isa)
+{
+    switch (isa) {
+    case HostMemcpyIsaLibc:
+        return memcpyLibc;
+#if HOST_MEMCPY_X86
+    case HostMemcpyIsaSse2:
+        return __builtin_cpu_supports("sse2") ? memcpyNonTemporalSse2 : NULL;
+    case HostMemcpyIsaAvx2:
+        return __builtin_cpu_supports("avx2") ? memcpyNonTemporalAvx2 : NULL;
+    case HostMemcpyIsaAvx512:
+        return __builtin_cpu_supports("avx512f") ? memcpyNonTemporalAvx512 : NULL;
+#endif
+    default:
+        return NULL;
+    };
+}
+
+
+//---
+HostMemcpyIsa HostMemcpyInit(int maxIsa)
+{
+#if HOST_MEMCPY_X86
+    __builtin_cpu_init();
+#endif
+
+    if (maxIsa > HostMemcpyIsaAvx512) {
+        maxIsa = HostMemcpyIsaAvx512;
+    }
+
+    for (int isa=maxIsa; isa>HostMemcpyIsaLibc; isa--) {
+        HostMemcpyFn fn = HostMemcpyGetImpl((HostMemcpyIsa)isa);
+        if (fn) {
+            s_nonTemporalMemcpy = fn;
+            return (HostMemcpyIsa)isa;
+        }
+    }
+
+    s_nonTemporalMemcpy = memcpyLibc;
+    return HostMemcpyIsaLibc;
+}
+
+
+//---
+void HostMemcpyNonTemporal(void* dst, const void* src, size_t sizeBytes)
+{
+    s_nonTemporalMemcpy(dst, src, sizeBytes);
+}
+
+
+//---
+const char* HostMemcpyIsaName(HostMemcpyIsa isa)
+{
+    switch (isa) {
+    case HostMemcpyIsaLibc:   return "libc";
+    case HostMemcpyIsaSse2:   return "SSE2";
+    case HostMemcpyIsaAvx2:   return "AVX2";
+    case HostMemcpyIsaAvx512: return "AVX-512";
+    default:                  return "unknown";
+    };
+}
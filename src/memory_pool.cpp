@@ -0,0 +1,503 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANNTY OF ANY KIND, EXPRESS OR
+IMPLIED, INNCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANNY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER INN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR INN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <hc_am.hpp>
+
+#include "hsa_ext_amd.h"
+
+#include "hip_runtime.h"
+#include "hcc_detail/hip_hcc.h"
+#include "hcc_detail/memory_pool.h"
+#include "hcc_detail/trace_helper.h"
+
+
+//-------------------------------------------------------------------------------------------------
+MemoryPool::MemoryPool(ihipDevice_t *device, size_t releaseThreshold) :
+    _device(device),
+    _releaseThreshold(releaseThreshold),
+    _reservedBytes(0),
+    _usedBytes(0),
+    _reservedHighWater(0),
+    _usedHighWater(0)
+{
+}
+
+
+//---
+// Memory is owned by the am_memtracker, which releases it when the accelerator is torn down.
+MemoryPool::~MemoryPool()
+{
+}
+
+
+//---
+// Round to one of four size classes between each power of two.
+size_t MemoryPool::roundSize(size_t sizeBytes)
+{
+    const size_t minBlock = 512;
+    if (sizeBytes <= minBlock) {
+        return minBlock;
+    }
+
+    int log2Size = 63 - __builtin_clzll(sizeBytes - 1); // 2^log2Size < sizeBytes <= 2^(log2Size+1)
+    size_t step = (size_t(1) << log2Size) / 4;
+
+    return (sizeBytes + step - 1) & ~(step - 1);
+}
+
+
+//---
+bool MemoryPool::isReady(const Block &block)
+{
+    return block._ready.completed();
+}
+
+
+//---
+// Allocate from the cache if possible, else from the device.
+hipError_t MemoryPool::locked_alloc(void **ptr, size_t sizeBytes, ihipStream_t *stream)
+{
+    size_t size = roundSize(sizeBytes);
+    Block block;
+
+    bool found = false;
+    bool pending = false;  // found a block, but stream must wait for it on the device.
+    {
+        std::lock_guard<std::mutex> l(_mutex);
+
+        auto bin = _cached.find(size);
+        if (bin != _cached.end()) {
+            // Prefer a block freed on the same stream - it is safe to reuse right away.
+            // Then any block whose free has retired.
+            auto match = bin->second.end();
+            for (auto iter=bin->second.begin(); iter!=bin->second.end(); iter++) {
+                if (iter->_stream == stream) {
+                    match = iter;
+                    break;
+                } else if ((match == bin->second.end()) && isReady(*iter)) {
+                    match = iter;
+                }
+            }
+
+            if (match != bin->second.end()) {
+                block = *match;
+                bin->second.erase(match);
+                found = true;
+            }
+        }
+
+        if (found) {
+            _live[block._ptr] = block;
+            _usedBytes += block._size;
+            _usedHighWater = std::max(_usedHighWater, _usedBytes);
+        }
+    }
+
+    if (!found) {
+        void *p = NULL;
+        hipError_t e = ihipDeviceMalloc(_device, &p, size);
+        if (e != hipSuccess) {
+            // Out of device memory - return idle cached blocks to the device and try again:
+            locked_trimTo(0);
+            e = ihipDeviceMalloc(_device, &p, size);
+        }
+
+        std::lock_guard<std::mutex> l(_mutex);
+
+        if (e == hipSuccess) {
+            block._ptr  = p;
+            block._size = size;
+            block._stream = stream;
+            block._ready  = ihipSignalRef_t();
+            found = true;
+
+            _reservedBytes += size;
+            _reservedHighWater = std::max(_reservedHighWater, _reservedBytes);
+
+        } else {
+            // Last resort - take a block which is still in use and have the stream wait for it on the device.
+            auto bin = _cached.find(size);
+            if ((bin != _cached.end()) && !bin->second.empty()) {
+                block = bin->second.front();
+                bin->second.pop_front();
+                found = pending = true;
+            }
+        }
+
+        if (found) {
+            _live[block._ptr] = block;
+            _usedBytes += block._size;
+            _usedHighWater = std::max(_usedHighWater, _usedBytes);
+        }
+    }
+
+    if (!found) {
+        *ptr = NULL;
+        return hipErrorMemoryAllocation;
+    }
+
+    if (pending && stream) {
+        tprintf(DB_MEM, "mempool: stream %p reuses busy block %p, add device-side dependency\n", stream, block._ptr);
+        stream->locked_waitSignals(std::vector<ihipSignalRef_t>(1, block._ready));
+    }
+
+    tprintf(DB_MEM, "mempool: alloc %p size=%zu (class %zu) stream=%p\n", block._ptr, sizeBytes, size, stream);
+
+    *ptr = block._ptr;
+    return hipSuccess;
+}
+
+
+//---
+bool MemoryPool::locked_isLive(void *ptr)
+{
+    std::lock_guard<std::mutex> l(_mutex);
+
+    return _live.find(ptr) != _live.end();
+}
+
+
+//---
+bool MemoryPool::locked_free(void *ptr, ihipStream_t *stream)
+{
+    ihipSignalRef_t ready;
+
+    // Read the stream's last command before acquiring the pool mutex - pool mutex must not be held while taking other locks.
+    if (stream && !stream->locked_lastCompletionSignal(&ready)) {
+        ready = ihipSignalRef_t(); // stream is idle.
+    }
+
+    std::vector<void*> toFree;
+    {
+        std::lock_guard<std::mutex> l(_mutex);
+
+        auto liveI = _live.find(ptr);
+        if (liveI == _live.end()) {
+            return false;
+        }
+
+        Block block = liveI->second;
+        _live.erase(liveI);
+
+        block._stream = stream;
+        block._ready  = ready;
+
+        _cached[block._size].push_back(block);
+        _usedBytes -= block._size;
+
+        tprintf(DB_MEM, "mempool: free %p size=%zu stream=%p ready=%d\n", ptr, block._size, stream, isReady(block));
+
+        if (_reservedBytes - _usedBytes > _releaseThreshold) {
+            collectCached(_releaseThreshold, toFree);
+        }
+    }
+
+    freeBlocks(toFree);
+
+    return true;
+}
+
+
+//---
+// Pick idle cached blocks to release until cached bytes <= maxCachedBytes.  Larger classes are released first.
+// Must be called with the pool mutex held.  The caller frees the blocks after releasing the mutex.
+void MemoryPool::collectCached(size_t maxCachedBytes, std::vector<void*> &toFree)
+{
+    for (auto bin=_cached.rbegin(); bin!=_cached.rend(); bin++) {
+        for (auto iter=bin->second.begin(); iter!=bin->second.end(); ) {
+            if (_reservedBytes - _usedBytes <= maxCachedBytes) {
+                return;
+            }
+            if (isReady(*iter)) {
+                toFree.push_back(iter->_ptr);
+                _reservedBytes -= iter->_size;
+                iter = bin->second.erase(iter);
+            } else {
+                iter++;
+            }
+        }
+    }
+}
+
+
+//---
+void MemoryPool::freeBlocks(const std::vector<void*> &toFree)
+{
+    for (auto iter=toFree.begin(); iter!=toFree.end(); iter++) {
+        tprintf(DB_MEM, "mempool: release %p to device\n", *iter);
+        g_allocIndex.locked_remove(*iter);
+        hc::am_free(*iter);
+    }
+}
+
+
+//---
+void MemoryPool::locked_trimTo(size_t minBytesToKeep)
+{
+    std::vector<void*> toFree;
+    {
+        std::lock_guard<std::mutex> l(_mutex);
+        collectCached(minBytesToKeep, toFree);
+    }
+
+    freeBlocks(toFree);
+}
+
+
+//---
+void MemoryPool::locked_setReleaseThreshold(size_t releaseThreshold)
+{
+    std::vector<void*> toFree;
+    {
+        std::lock_guard<std::mutex> l(_mutex);
+        _releaseThreshold = releaseThreshold;
+        collectCached(_releaseThreshold, toFree);
+    }
+
+    freeBlocks(toFree);
+}
+
+
+//---
+void MemoryPool::locked_getUsage(size_t *reservedBytes, size_t *usedBytes, size_t *reservedHighWater, size_t *usedHighWater)
+{
+    std::lock_guard<std::mutex> l(_mutex);
+
+    if (reservedBytes)     *reservedBytes     = _reservedBytes;
+    if (usedBytes)         *usedBytes         = _usedBytes;
+    if (reservedHighWater) *reservedHighWater = _reservedHighWater;
+    if (usedHighWater)     *usedHighWater     = _usedHighWater;
+}
+
+
+//---
+void MemoryPool::locked_resetHighWater()
+{
+    std::lock_guard<std::mutex> l(_mutex);
+
+    _reservedHighWater = _reservedBytes;
+    _usedHighWater     = _usedBytes;
+}
+
+
+//---
+void MemoryPool::locked_reset()
+{
+    std::lock_guard<std::mutex> l(_mutex);
+
+    _cached.clear();
+    _live.clear();
+    _reservedBytes = _usedBytes = 0;
+    _reservedHighWater = _usedHighWater = 0;
+}
+
+
+
+//=================================================================================================
+// DeferredFreeQueue:
+//=================================================================================================
+DeferredFreeQueue::DeferredFreeQueue(ihipDevice_t *device) :
+    _device(device),
+    _releasing(0),
+    _stop(false)
+{
+}
+
+
+//---
+// Pending entries are left to the am_memtracker, which releases them when the accelerator is torn down.
+DeferredFreeQueue::~DeferredFreeQueue()
+{
+    {
+        std::lock_guard<std::mutex> l(_mutex);
+        _stop = true;
+    }
+    _cv.notify_one();
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+
+//---
+bool DeferredFreeQueue::locked_enqueue(void *ptr, const std::vector<ihipSignalRef_t> &deps)
+{
+    {
+        std::lock_guard<std::mutex> l(_mutex);
+
+        if (!_pendingPtrs.insert(ptr).second) {
+            return false;
+        }
+
+        Entry entry;
+        entry._ptr = ptr;
+        entry._deps = deps;
+        _pending.push_back(entry);
+
+        if (!_thread.joinable()) {
+            _thread = std::thread(&DeferredFreeQueue::reclaimThread, this);
+        }
+
+        tprintf(DB_MEM, "deferred free %p, waiting on %zu commands (%zu pending)\n", ptr, deps.size(), _pending.size());
+    }
+
+    _cv.notify_one();
+
+    return true;
+}
+
+
+//---
+bool DeferredFreeQueue::isRetired(Entry &entry)
+{
+    while (!entry._deps.empty()) {
+        if (!entry._deps.back().completed()) {
+            return false;
+        }
+        entry._deps.pop_back();
+    }
+
+    return true;
+}
+
+
+//---
+// Block until dep completes, or about timeoutHint ns pass.  A stream signal is held during the wait, so the
+// stream does not reuse it for a later command meanwhile.
+void DeferredFreeQueue::waitDep(const ihipSignalRef_t &dep, uint64_t timeoutHint)
+{
+    hsa_signal_t signal;
+    if (dep._signal) {
+        if (!dep._signal->hold(dep._generation)) {
+            return;
+        }
+        signal = dep._signal->_hsa_signal;
+    } else {
+        hsa_signal_t *kernelSignal = static_cast<hsa_signal_t*> (dep._future.get_native_handle());
+        if (kernelSignal == NULL) {
+            return;
+        }
+        signal = *kernelSignal;
+    }
+
+    hsa_signal_wait_acquire(signal, HSA_SIGNAL_CONDITION_LT, 1, timeoutHint, HSA_WAIT_STATE_BLOCKED);
+
+    if (dep._signal) {
+        dep._signal->unhold();
+    }
+}
+
+
+//---
+// Return memory to the device.  hipFree sends hipMallocAsync blocks to the pool instead, never here.
+void DeferredFreeQueue::release(void *ptr)
+{
+    tprintf(DB_MEM, "deferred free: release %p\n", ptr);
+
+    g_allocIndex.locked_remove(ptr);
+    hc::am_free(ptr);
+}
+
+
+//---
+// Must be called with the mutex held.  The mutex is dropped while releasing memory and while waiting on a signal.
+void DeferredFreeQueue::reclaim(std::unique_lock<std::mutex> &lock, bool wait)
+{
+    do {
+        std::vector<void*> retired;
+        for (auto iter=_pending.begin(); iter!=_pending.end(); ) {
+            if (isRetired(*iter)) {
+                retired.push_back(iter->_ptr);
+                _pendingPtrs.erase(iter->_ptr);
+                iter = _pending.erase(iter);
+            } else {
+                iter++;
+            }
+        }
+
+        if (!retired.empty()) {
+            // am_free and the pool take their own locks, so release without blocking hipFree on other threads:
+            _releasing += retired.size();
+            lock.unlock();
+            for (auto p=retired.begin(); p!=retired.end(); p++) {
+                release(*p);
+            }
+            lock.lock();
+            _releasing -= retired.size();
+            if (_releasing == 0) {
+                _releasedCv.notify_all();
+            }
+        }
+
+        // Entries may have been queued while the mutex was dropped, the next pass checks them first:
+        if (wait && !_pending.empty() && !_pending.front()._deps.empty()) {
+            ihipSignalRef_t dep = _pending.front()._deps.back();
+            lock.unlock();
+            waitDep(dep, UINT64_MAX);
+            lock.lock();
+        }
+    } while (wait && !_pending.empty());
+
+    if (wait) {
+        // Another thread may still be releasing entries it took off the queue:
+        _releasedCv.wait(lock, [this] { return _releasing == 0; });
+    }
+}
+
+
+//---
+void DeferredFreeQueue::locked_reclaim(bool wait)
+{
+    std::unique_lock<std::mutex> l(_mutex);
+
+    reclaim(l, wait);
+}
+
+
+//---
+size_t DeferredFreeQueue::locked_pendingCount()
+{
+    std::lock_guard<std::mutex> l(_mutex);
+
+    return _pending.size();
+}
+
+
+//---
+// Background reclaim pass: sleep until something is queued, then wait for the oldest entry to retire.
+void DeferredFreeQueue::reclaimThread()
+{
+    // Timeout is only a hint to the wait; the loop re-checks _stop and picks up newer entries which may retire first.
+    const uint64_t waitTimeoutHint = 1000000;
+
+    std::unique_lock<std::mutex> l(_mutex);
+
+    while (!_stop) {
+        reclaim(l, false);
+
+        if (_pending.empty()) {
+            _cv.wait(l);
+        } else if (!_pending.front()._deps.empty()) {
+            ihipSignalRef_t dep = _pending.front()._deps.back();
+            l.unlock();
+            waitDep(dep, waitTimeoutHint);
+            l.lock();
+        }
+    }
+}
@@ -0,0 +1,86 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANNTY OF ANY KIND, EXPRESS OR
+IMPLIED, INNCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANNY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER INN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR INN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <chrono>
+#include <thread>
+
+#include "hcc_detail/signal_wait.h"
+
+static SignalWaitMode s_defaultMode = SignalWaitHybrid;
+static unsigned s_spinUs = 50;
+
+
+//---
+void SignalWaitInit(SignalWaitMode defaultMode, unsigned spinUs)
+{
+    s_defaultMode = (defaultMode == SignalWaitDefault) ? SignalWaitHybrid : defaultMode;
+    s_spinUs = spinUs;
+}
+
+
+//---
+void SignalWait(hsa_signal_t signal, SignalWaitMode mode)
+{
+    if (mode == SignalWaitDefault) {
+        mode = s_defaultMode;
+    }
+
+    switch (mode) {
+    case SignalWaitSpin:
+        hsa_signal_wait_acquire(signal, HSA_SIGNAL_CONDITION_LT, 1, UINT64_MAX, HSA_WAIT_STATE_ACTIVE);
+        break;
+
+    case SignalWaitYield:
+        while (hsa_signal_load_acquire(signal) >= 1) {
+            std::this_thread::yield();
+        }
+        break;
+
+    case SignalWaitBlocked:
+        hsa_signal_wait_acquire(signal, HSA_SIGNAL_CONDITION_LT, 1, UINT64_MAX, HSA_WAIT_STATE_BLOCKED);
+        break;
+
+    case SignalWaitHybrid:
+    default:
+        {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(s_spinUs);
+            while (hsa_signal_load_acquire(signal) >= 1) {
+                if (std::chrono::steady_clock::now() >= deadline) {
+                    hsa_signal_wait_acquire(signal, HSA_SIGNAL_CONDITION_LT, 1, UINT64_MAX, HSA_WAIT_STATE_BLOCKED);
+                    break;
+                }
+            }
+        }
+        break;
+    }
+}
+
+
+//---
+const char* SignalWaitModeName(SignalWaitMode mode)
+{
+    switch (mode) {
+    case SignalWaitDefault: return "default";
+    case SignalWaitHybrid:  return "hybrid";
+    case SignalWaitSpin:    return "spin";
+    case SignalWaitYield:   return "yield";
+    case SignalWaitBlocked: return "blocked";
+    default:                return "unknown";
+    };
+}
@@ -17,24 +17,308 @@ OUT OF OR INN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
 
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <cstdio>
+#include <algorithm>
+
 #include <hc_am.hpp>
 
 #include "hsa_ext_amd.h"
 
 #include "hcc_detail/staging_buffer.h"
+#include "hcc_detail/host_memcpy.h"
+#include "hcc_detail/signal_wait.h"
 
 #ifdef HIP_HCC
 #define THROW_ERROR(e) throw ihipException(e)
+#define COPY_ERROR_UNKNOWN hipErrorUnknown
 #else
 #define THROW_ERROR(e) throw 
+#define COPY_ERROR_UNKNOWN 1
 #define tprintf(trace_level, ...) 
 #endif
 
 //-------------------------------------------------------------------------------------------------
-StagingBuffer::StagingBuffer(hsa_agent_t hsaAgent, hsa_region_t systemRegion, size_t bufferSize, int numBuffers) :
+HostCopyPool::HostCopyPool(int numThreads, int numaNode) :
+    _dst(NULL),
+    _src(NULL),
+    _sizeBytes(0),
+    _sliceBytes(0),
+    _nonTemporal(false),
+    _numSlices(0),
+    _generation(0),
+    _pending(0),
+    _stop(false)
+{
+    // Read the CPUs of the NUMA node so helper threads run close to the GPU:
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    bool bindCpus = false;
+    if (numaNode >= 0) {
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", numaNode);
+        FILE *f = fopen(path, "r");
+        if (f) {
+            // Format is a comma-separated list of ranges, ie "0-7,16-23"
+            int first, last;
+            char sep;
+            while (fscanf(f, "%d", &first) == 1) {
+                last = first;
+                if (fscanf(f, "%c", &sep) != 1) {
+                    sep = '\n'; // end of file after the last entry.
+                } else if (sep == '-') {
+                    if ((fscanf(f, "%d", &last) != 1) || (last < first)) {
+                        break;
+                    }
+                    if (fscanf(f, "%c", &sep) != 1) {
+                        sep = '\n';
+                    }
+                }
+                for (int cpu=first; (cpu<=last) && (cpu<CPU_SETSIZE); cpu++) {
+                    CPU_SET(cpu, &cpus);
+                    bindCpus = true;
+                }
+                if (sep != ',') {
+                    break;
+                }
+            }
+            fclose(f);
+        }
+    }
+
+    for (int i=0; i<numThreads; i++) {
+        _threads.push_back(std::thread(&HostCopyPool::Worker, this, i));
+        if (bindCpus) {
+            pthread_setaffinity_np(_threads.back().native_handle(), sizeof(cpu_set_t), &cpus);
+        }
+    }
+
+    tprintf (DB_COPY1, "host copy pool: %d threads, numa node %d%s\n", numThreads, numaNode, bindCpus ? "" : " (not bound)");
+}
+
+
+//---
+HostCopyPool::~HostCopyPool()
+{
+    {
+        std::lock_guard<std::mutex> l (_job_lock);
+        _stop = true;
+    }
+    _work_cv.notify_all();
+
+    for (auto iter=_threads.begin(); iter!=_threads.end(); iter++) {
+        iter->join();
+    }
+}
+
+
+//---
+void HostCopyPool::CopySlice(int sliceIndex)
+{
+    size_t offset = sliceIndex * _sliceBytes;
+    if (offset < _sizeBytes) {
+        size_t theseBytes = std::min(_sliceBytes, _sizeBytes - offset);
+        if (_nonTemporal) {
+            HostMemcpyNonTemporal(_dst + offset, _src + offset, theseBytes);
+        } else {
+            memcpy(_dst + offset, _src + offset, theseBytes);
+        }
+    }
+}
+
+
+//---
+//Copy sizeBytes from src to dst, using the helper threads if the copy is large enough to split.
+void HostCopyPool::Memcpy(void* dst, const void* src, size_t sizeBytes, bool nonTemporal)
+{
+    int numSlices = std::min((size_t)_threads.size() + 1, sizeBytes / _min_slice);
+
+    // If another staging buffer is using the helpers, copy on this thread rather than wait for them:
+    std::unique_lock<std::mutex> ml (_memcpy_lock, std::defer_lock);
+    if ((numSlices <= 1) || !ml.try_lock()) {
+        if (nonTemporal) {
+            HostMemcpyNonTemporal(dst, src, sizeBytes);
+        } else {
+            memcpy(dst, src, sizeBytes);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> l (_job_lock);
+        _dst        = static_cast<char*> (dst);
+        _src        = static_cast<const char*> (src);
+        _sizeBytes  = sizeBytes;
+        _sliceBytes = ((sizeBytes + numSlices - 1) / numSlices + 63) & ~(size_t)63; // cache-line aligned slices.
+        _numSlices  = numSlices;
+        _nonTemporal = nonTemporal;
+        _pending    = numSlices - 1;
+        _generation++;
+    }
+    _work_cv.notify_all();
+
+    // Caller copies slice 0:
+    CopySlice(0);
+
+    std::unique_lock<std::mutex> l (_job_lock);
+    _done_cv.wait(l, [this] { return _pending == 0; });
+}
+
+
+//---
+//Helper thread i copies slice i+1 of each job, if the job has that many slices.
+void HostCopyPool::Worker(int threadIndex)
+{
+    uint64_t lastGeneration = 0;
+
+    std::unique_lock<std::mutex> l (_job_lock);
+    while (true) {
+        _work_cv.wait(l, [&] { return _stop || (_generation != lastGeneration); });
+        if (_stop) {
+            break;
+        }
+
+        lastGeneration = _generation;
+        int sliceIndex = threadIndex + 1;
+        if (sliceIndex < _numSlices) {
+            l.unlock();
+            CopySlice(sliceIndex);
+            l.lock();
+
+            if (--_pending == 0) {
+                _done_cv.notify_one();
+            }
+        }
+    }
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+PinnedRangeCache::PinnedRangeCache(hsa_agent_t hsaAgent, size_t maxPinnedBytes) :
+    _hsa_agent(hsaAgent),
+    _maxPinnedBytes(maxPinnedBytes),
+    _pageSize(sysconf(_SC_PAGESIZE)),
+    _pinnedBytes(0)
+{
+}
+
+
+//---
+PinnedRangeCache::~PinnedRangeCache()
+{
+    std::lock_guard<std::mutex> l (_lock);
+    while (!_ranges.empty()) {
+        unpin(_ranges.begin());
+    }
+}
+
+
+//---
+// Return the range which contains [start,end), or _ranges.end() if none.
+PinnedRangeCache::RangeMap::iterator PinnedRangeCache::findContaining(uintptr_t start, uintptr_t end)
+{
+    auto iter = _ranges.upper_bound(start);
+    if (iter != _ranges.begin()) {
+        --iter;
+        if (iter->second._end >= end) {
+            return iter;
+        }
+    }
+    return _ranges.end();
+}
+
+
+//---
+// Caller must hold _lock.
+void PinnedRangeCache::unpin(RangeMap::iterator iter)
+{
+    tprintf (DB_COPY2, "pin cache: unpin %p+%zu\n", (void*)iter->first, (size_t)(iter->second._end - iter->first));
+
+    hsa_amd_memory_unlock((void*)iter->first);
+    _pinnedBytes -= iter->second._end - iter->first;
+    _ranges.erase(iter);
+}
+
+
+//---
+void* PinnedRangeCache::Acquire(const void* hostPtr, size_t sizeBytes)
+{
+    if (sizeBytes == 0) {
+        return NULL;
+    }
+
+    uintptr_t start = (uintptr_t)hostPtr & ~(uintptr_t)(_pageSize-1);
+    uintptr_t end   = ((uintptr_t)hostPtr + sizeBytes + _pageSize - 1) & ~(uintptr_t)(_pageSize-1);
+
+    std::lock_guard<std::mutex> l (_lock);
+
+    auto iter = findContaining(start, end);
+    if (iter != _ranges.end()) {
+        Range &r = iter->second;
+        r._refCount++;
+        tprintf (DB_COPY2, "pin cache: share %p+%zu\n", hostPtr, sizeBytes);
+        return r._agentPtr + ((uintptr_t)hostPtr - iter->first);
+    }
+
+    if (_pinnedBytes + (end - start) > _maxPinnedBytes) {
+        return NULL;
+    }
+
+    // A page can only be pinned once, so a range which partly overlaps one in use by another copy can't be pinned now:
+    iter = _ranges.lower_bound(end);
+    if ((iter != _ranges.begin()) && ((--iter)->second._end > start)) {
+        return NULL;
+    }
+
+    void *agentPtr;
+    hsa_status_t hsa_status = hsa_amd_memory_lock((void*)start, end - start, &_hsa_agent, 1, &agentPtr);
+    tprintf (DB_COPY2, "pin cache: pin %p+%zu for %p+%zu status=%x\n", (void*)start, (size_t)(end-start), hostPtr, sizeBytes, hsa_status);
+    if (hsa_status != HSA_STATUS_SUCCESS) {
+        return NULL;
+    }
+
+    Range &r = _ranges[start];
+    r._end = end;
+    r._agentPtr = static_cast<char*> (agentPtr);
+    r._refCount = 1;
+    _pinnedBytes += end - start;
+
+    return r._agentPtr + ((uintptr_t)hostPtr - start);
+}
+
+
+//---
+void PinnedRangeCache::Release(const void* hostPtr)
+{
+    std::lock_guard<std::mutex> l (_lock);
+
+    auto iter = findContaining((uintptr_t)hostPtr, (uintptr_t)hostPtr);
+    if ((iter == _ranges.end()) || (iter->second._refCount == 0)) {
+        THROW_ERROR(hipErrorInvalidValue);
+    }
+
+    if (--iter->second._refCount == 0) {
+        unpin(iter);
+    }
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+StagingBuffer::StagingBuffer(hsa_agent_t hsaAgent, hsa_agent_t cpuAgent, hsa_region_t systemRegion, size_t bufferSize, int numBuffers,
+                             HostCopyPool *copyPool, size_t copyPoolThreshold, PinnedRangeCache *pinCache, bool d2hRing) :
     _hsa_agent(hsaAgent),
+    _cpu_agent(cpuAgent),
     _bufferSize(bufferSize),
-    _numBuffers(numBuffers > _max_buffers ? _max_buffers : numBuffers)
+    _numBuffers(numBuffers > _max_buffers ? _max_buffers : numBuffers),
+    _copyPool(copyPool),
+    _copyPoolThreshold(copyPoolThreshold),
+    _pinCache(pinCache),
+    _d2hRing(d2hRing),
+    _stop_worker(false)
 {
     for (int i=0; i<_numBuffers; i++) {
         // TODO - experiment with alignment here.
@@ -51,6 +335,15 @@ StagingBuffer::StagingBuffer(hsa_agent_t hsaAgent, hsa_region_t systemRegion, si
 //---
 StagingBuffer::~StagingBuffer()
 {
+    if (_worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> l (_job_lock);
+            _stop_worker = true;
+        }
+        _job_cv.notify_one();
+        _worker.join();
+    }
+
     for (int i=0; i<_numBuffers; i++) {
         if (_pinnedStagingBuffer[i]) {
             hsa_memory_free(_pinnedStagingBuffer[i]);
@@ -63,68 +356,106 @@ StagingBuffer::~StagingBuffer()
 
 
 //---
-//Copies sizeBytes from src to dst, using either a copy to a staging buffer or a staged pin-in-place strategy
-//IN: dst - dest pointer - must be accessible from host CPU.
-//IN: src - src pointer for copy.  Must be accessible from agent this buffer is associated with (via _hsa_agent)
-//IN: waitFor - hsaSignal to wait for - the copy will begin only when the specified dependency is resolved.  May be NULL indicating no dependency.
-void StagingBuffer::CopyHostToDevicePinInPlace(void* dst, const void* src, size_t sizeBytes, hsa_signal_t *waitFor)
+//Host-side copy into or out of a staging buffer.
+//Copies into the staging buffer use streaming stores since the CPU never reads the staging buffer back.
+void StagingBuffer::StagingMemcpy(void* dst, const void* src, size_t sizeBytes, bool useCopyPool, bool nonTemporal)
 {
-    std::lock_guard<std::mutex> l (_copy_lock);
+    if (useCopyPool) {
+        _copyPool->Memcpy(dst, src, sizeBytes, nonTemporal);
+    } else if (nonTemporal) {
+        HostMemcpyNonTemporal(dst, src, sizeBytes);
+    } else {
+        memcpy(dst, src, sizeBytes);
+    }
+}
 
-    const char *srcp = static_cast<const char*> (src);
-    char *dstp = static_cast<char*> (dst);
 
-    for (int i=0; i<_numBuffers; i++) {
-        hsa_signal_store_relaxed(_completion_signal[i], 0);
+//---
+//Copy with the algorithm and chunk size from plan.  plan._algorithm must be StagingCopyStaged or StagingCopyPinInPlace.
+void StagingBuffer::Copy(bool hostToDevice, void* dst, const void* src, size_t sizeBytes, hsa_signal_t *waitFor, const StagingCopyPlan &plan)
+{
+    if (hostToDevice) {
+        if (plan._algorithm == StagingCopyPinInPlace) {
+            CopyHostToDevicePinInPlace(dst, src, sizeBytes, waitFor);
+        } else {
+            CopyHostToDevice(dst, src, sizeBytes, waitFor, plan._chunkBytes);
+        }
+    } else {
+        if (plan._algorithm == StagingCopyPinInPlace) {
+            CopyDeviceToHostPinInPlace(dst, src, sizeBytes, waitFor);
+        } else {
+            CopyDeviceToHost(dst, src, sizeBytes, waitFor, plan._chunkBytes);
+        }
     }
+}
 
-    if (sizeBytes >= UINT64_MAX/2) {
-        THROW_ERROR (hipErrorInvalidValue);
+
+//---
+//Copies sizeBytes from src to dst by pinning the host source in-place and copying it with one DMA.
+//Falls back to CopyHostToDevice if the source can't be pinned.
+//IN: dst - dest pointer - must be accessible from agent this buffer is associated with (via _hsa_agent).
+//IN: src - src pointer for copy.  Must be accessible from host CPU.
+//IN: waitFor - hsaSignal to wait for - the copy will begin only when the specified dependency is resolved.  May be NULL indicating no dependency.
+void StagingBuffer::CopyHostToDevicePinInPlace(void* dst, const void* src, size_t sizeBytes, hsa_signal_t *waitFor)
+{
+    void *locked_srcp = _pinCache ? _pinCache->Acquire(src, sizeBytes) : NULL;
+    if (locked_srcp == NULL) {
+        tprintf (DB_COPY2, "H2D: pin-in-place of %p+%zu failed, use staged copy\n", src, sizeBytes);
+        CopyHostToDevice(dst, src, sizeBytes, waitFor);
+        return;
     }
-    int bufferIndex = 0;
-    for (int64_t bytesRemaining=sizeBytes; bytesRemaining>0 ;  bytesRemaining -= _bufferSize) {
 
-        size_t theseBytes = (bytesRemaining > _bufferSize) ? _bufferSize : bytesRemaining;
+    std::lock_guard<std::mutex> l (_copy_lock);
 
-        tprintf (DB_COPY2, "H2D: waiting... on completion signal handle=%lu\n", _completion_signal[bufferIndex].handle);
-        hsa_signal_wait_acquire(_completion_signal[bufferIndex], HSA_SIGNAL_CONDITION_LT, 1, UINT64_MAX, HSA_WAIT_STATE_ACTIVE);
+    tprintf (DB_COPY2, "H2D: pin-in-place async_copy %zu bytes %p(locked %p) to %p\n", sizeBytes, src, locked_srcp, dst);
+    hsa_signal_store_relaxed(_completion_signal[0], 1);
+    hsa_status_t hsa_status = hsa_amd_memory_async_copy(dst, _hsa_agent, locked_srcp, _cpu_agent, sizeBytes, waitFor ? 1:0, waitFor, _completion_signal[0]);
 
-        void * masked_srcp = (void*) ((uintptr_t)srcp & (uintptr_t)(~0x3f)) ; // TODO
-        void *locked_srcp;
-        hsa_status_t hsa_status = hsa_amd_memory_lock(masked_srcp, theseBytes, &_hsa_agent, 1, &locked_srcp);
-        //hsa_status_t hsa_status = hsa_amd_memory_lock(const_cast<char*> (srcp), theseBytes, &_hsa_agent, 1, &locked_srcp);
-        tprintf (DB_COPY2, "H2D: bytesRemaining=%zu: pin-in-place:%p+%zu bufferIndex[%d]\n", bytesRemaining, srcp, theseBytes, bufferIndex);
-        printf ("status=%x srcp=%p, masked_srcp=%p, locked_srcp=%p\n", hsa_status, srcp, masked_srcp, locked_srcp);
+    if (hsa_status == HSA_STATUS_SUCCESS) {
+        SignalWait(_completion_signal[0], SignalWaitDefault);
+    } else {
+        hsa_signal_store_relaxed(_completion_signal[0], 0);
+    }
 
-        if (hsa_status != HSA_STATUS_SUCCESS) {
-            THROW_ERROR (hipErrorRuntimeMemory);
-        }
+    _pinCache->Release(src);
 
-        hsa_signal_store_relaxed(_completion_signal[bufferIndex], 1);
+    if (hsa_status != HSA_STATUS_SUCCESS) {
+        THROW_ERROR (hipErrorRuntimeMemory);
+    }
+}
 
-        hsa_status = hsa_amd_memory_async_copy(dstp, _hsa_agent, locked_srcp, _hsa_agent, theseBytes, waitFor ? 1:0, waitFor, _completion_signal[bufferIndex]);
-        tprintf (DB_COPY2, "H2D: bytesRemaining=%zu: async_copy %zu bytes %p to %p status=%x\n", bytesRemaining, theseBytes, _pinnedStagingBuffer[bufferIndex], dstp, hsa_status);
 
-        if (hsa_status != HSA_STATUS_SUCCESS) {
-            THROW_ERROR (hipErrorRuntimeMemory);
-        }
+//---
+//Copies sizeBytes from src to dst by pinning the host destination in-place and copying it with one DMA.
+//Falls back to CopyDeviceToHost if the destination can't be pinned.
+//IN: dst - dest pointer - must be accessible from host CPU.
+//IN: src - src pointer for copy.  Must be accessible from agent this buffer is associated with (via _hsa_agent).
+//IN: waitFor - hsaSignal to wait for - the copy will begin only when the specified dependency is resolved.  May be NULL indicating no dependency.
+void StagingBuffer::CopyDeviceToHostPinInPlace(void* dst, const void* src, size_t sizeBytes, hsa_signal_t *waitFor)
+{
+    void *locked_dstp = _pinCache ? _pinCache->Acquire(dst, sizeBytes) : NULL;
+    if (locked_dstp == NULL) {
+        tprintf (DB_COPY2, "D2H: pin-in-place of %p+%zu failed, use staged copy\n", dst, sizeBytes);
+        CopyDeviceToHost(dst, src, sizeBytes, waitFor);
+        return;
+    }
 
-        srcp += theseBytes;
-        dstp += theseBytes;
-        if (++bufferIndex >= _numBuffers) {
-            bufferIndex = 0;
-        }
+    std::lock_guard<std::mutex> l (_copy_lock);
 
-        // Assume subsequent commands are dependent on previous and don't need dependency after first copy submitted, HIP_ONESHOT_COPY_DEP=1 
-        waitFor = NULL; 
-    }
+    tprintf (DB_COPY2, "D2H: pin-in-place async_copy %zu bytes %p to %p(locked %p)\n", sizeBytes, src, dst, locked_dstp);
+    hsa_signal_store_relaxed(_completion_signal[0], 1);
+    hsa_status_t hsa_status = hsa_amd_memory_async_copy(locked_dstp, _cpu_agent, src, _hsa_agent, sizeBytes, waitFor ? 1:0, waitFor, _completion_signal[0]);
 
-    // TODO -
-    printf ("unpin the memory\n");
+    if (hsa_status == HSA_STATUS_SUCCESS) {
+        SignalWait(_completion_signal[0], SignalWaitDefault);
+    } else {
+        hsa_signal_store_relaxed(_completion_signal[0], 0);
+    }
 
+    _pinCache->Release(dst);
 
-    for (int i=0; i<_numBuffers; i++) {
-        hsa_signal_wait_acquire(_completion_signal[i], HSA_SIGNAL_CONDITION_LT, 1, UINT64_MAX, HSA_WAIT_STATE_ACTIVE);
+    if (hsa_status != HSA_STATUS_SUCCESS) {
+        THROW_ERROR (hipErrorRuntimeMemory);
     }
 }
 
@@ -136,8 +467,10 @@ void StagingBuffer::CopyHostToDevicePinInPlace(void* dst, const void* src, size_
 //IN: dst - dest pointer - must be accessible from host CPU.
 //IN: src - src pointer for copy.  Must be accessible from agent this buffer is associated with (via _hsa_agent)
 //IN: waitFor - hsaSignal to wait for - the copy will begin only when the specified dependency is resolved.  May be NULL indicating no dependency.
-void StagingBuffer::CopyHostToDevice(void* dst, const void* src, size_t sizeBytes, hsa_signal_t *waitFor)
+void StagingBuffer::CopyHostToDevice(void* dst, const void* src, size_t sizeBytes, hsa_signal_t *waitFor, size_t chunkBytes)
 {
+    size_t chunkSize = ((chunkBytes == 0) || (chunkBytes > _bufferSize)) ? _bufferSize : chunkBytes;
+
     std::lock_guard<std::mutex> l (_copy_lock);
 
     const char *srcp = static_cast<const char*> (src);
@@ -150,22 +483,22 @@ void StagingBuffer::CopyHostToDevice(void* dst, const void* src, size_t sizeByte
     if (sizeBytes >= UINT64_MAX/2) {
         THROW_ERROR (hipErrorInvalidValue);
     }
+    bool useCopyPool = _copyPool && (sizeBytes >= _copyPoolThreshold);
     int bufferIndex = 0;
-    for (int64_t bytesRemaining=sizeBytes; bytesRemaining>0 ;  bytesRemaining -= _bufferSize) {
+    for (int64_t bytesRemaining=sizeBytes; bytesRemaining>0 ;  bytesRemaining -= chunkSize) {
 
-        size_t theseBytes = (bytesRemaining > _bufferSize) ? _bufferSize : bytesRemaining;
+        size_t theseBytes = (bytesRemaining > chunkSize) ? chunkSize : bytesRemaining;
 
         tprintf (DB_COPY2, "H2D: waiting... on completion signal handle=%lu\n", _completion_signal[bufferIndex].handle);
-        hsa_signal_wait_acquire(_completion_signal[bufferIndex], HSA_SIGNAL_CONDITION_LT, 1, UINT64_MAX, HSA_WAIT_STATE_ACTIVE);
+        SignalWait(_completion_signal[bufferIndex], SignalWaitDefault);
 
         tprintf (DB_COPY2, "H2D: bytesRemaining=%zu: copy %zu bytes %p to stagingBuf[%d]:%p\n", bytesRemaining, theseBytes, srcp, bufferIndex, _pinnedStagingBuffer[bufferIndex]);
-        // TODO - use uncached memcpy, someday.
-        memcpy(_pinnedStagingBuffer[bufferIndex], srcp, theseBytes);
+        StagingMemcpy(_pinnedStagingBuffer[bufferIndex], srcp, theseBytes, useCopyPool, true/*nonTemporal*/);
 
 
         hsa_signal_store_relaxed(_completion_signal[bufferIndex], 1);
 
-        hsa_status_t hsa_status = hsa_amd_memory_async_copy(dstp, _hsa_agent, _pinnedStagingBuffer[bufferIndex], _hsa_agent, theseBytes, waitFor ? 1:0, waitFor, _completion_signal[bufferIndex]);
+        hsa_status_t hsa_status = hsa_amd_memory_async_copy(dstp, _hsa_agent, _pinnedStagingBuffer[bufferIndex], _cpu_agent, theseBytes, waitFor ? 1:0, waitFor, _completion_signal[bufferIndex]);
         tprintf (DB_COPY2, "H2D: bytesRemaining=%zu: async_copy %zu bytes %p to %p status=%x\n", bytesRemaining, theseBytes, _pinnedStagingBuffer[bufferIndex], dstp, hsa_status);
 
         if (hsa_status != HSA_STATUS_SUCCESS) {
@@ -184,7 +517,7 @@ void StagingBuffer::CopyHostToDevice(void* dst, const void* src, size_t sizeByte
 
 
     for (int i=0; i<_numBuffers; i++) {
-        hsa_signal_wait_acquire(_completion_signal[i], HSA_SIGNAL_CONDITION_LT, 1, UINT64_MAX, HSA_WAIT_STATE_ACTIVE);
+        SignalWait(_completion_signal[i], SignalWaitDefault);
     }
 }
 
@@ -193,8 +526,10 @@ void StagingBuffer::CopyHostToDevice(void* dst, const void* src, size_t sizeByte
 //IN: dst - dest pointer - must be accessible from agent this buffer is associated with (via _hsa_agent).
 //IN: src - src pointer for copy.  Must be accessible from host CPU.
 //IN: waitFor - hsaSignal to wait for - the copy will begin only when the specified dependency is resolved.  May be NULL indicating no dependency.
-void StagingBuffer::CopyDeviceToHost(void* dst, const void* src, size_t sizeBytes, hsa_signal_t *waitFor)
+void StagingBuffer::CopyDeviceToHost(void* dst, const void* src, size_t sizeBytes, hsa_signal_t *waitFor, size_t chunkBytes)
 {
+    size_t chunkSize = ((chunkBytes == 0) || (chunkBytes > _bufferSize)) ? _bufferSize : chunkBytes;
+
     std::lock_guard<std::mutex> l (_copy_lock);
 
     const char *srcp0 = static_cast<const char*> (src);
@@ -207,47 +542,241 @@ void StagingBuffer::CopyDeviceToHost(void* dst, const void* src, size_t sizeByte
     if (sizeBytes >= UINT64_MAX/2) {
         THROW_ERROR (hipErrorInvalidValue);
     }
+    bool useCopyPool = _copyPool && (sizeBytes >= _copyPoolThreshold);
 
     int64_t bytesRemaining0 = sizeBytes; // bytes to copy from dest into staging buffer.
     int64_t bytesRemaining1 = sizeBytes; // bytes to copy from staging buffer into final dest
 
+    // Issue the async copy of the next chunk from device into the specified staging buffer:
+    auto issueChunk = [&] (int bufferIndex) {
+        size_t theseBytes = (bytesRemaining0 > chunkSize) ? chunkSize : bytesRemaining0;
+
+        tprintf (DB_COPY2, "D2H: bytesRemaining0=%zu  async_copy %zu bytes src:%p to staging:%p\n", bytesRemaining0, theseBytes, srcp0, _pinnedStagingBuffer[bufferIndex]);
+        hsa_signal_store_relaxed(_completion_signal[bufferIndex], 1);
+        hsa_status_t hsa_status = hsa_amd_memory_async_copy(_pinnedStagingBuffer[bufferIndex], _cpu_agent, srcp0, _hsa_agent, theseBytes, waitFor ? 1:0, waitFor, _completion_signal[bufferIndex]);
+        if (hsa_status != HSA_STATUS_SUCCESS) {
+            THROW_ERROR (hipErrorRuntimeMemory);
+        }
+
+        srcp0 += theseBytes;
+        bytesRemaining0 -= theseBytes;
+
+        // Assume subsequent commands are dependent on previous and don't need dependency after first copy submitted, HIP_ONESHOT_COPY_DEP=1 
+        waitFor = NULL; 
+    };
+
+    // Fill the pipeline:
+    for (int bufferIndex = 0; (bytesRemaining0>0) && (bufferIndex < _numBuffers); bufferIndex++) {
+        issueChunk(bufferIndex);
+    }
+
+    // Unload the staging buffers in ring order.  As soon as a buffer is unloaded, re-use it for chunk i+_numBuffers
+    // so the DMA engine keeps running while the CPU copies out of the other buffers.
+    // Without _d2hRing, refill all buffers only once the whole batch is unloaded - the DMA engine idles meanwhile.
+    int bufferIndex = 0;
     while (bytesRemaining1 > 0) {
-        // First launch the async copies to copy from dest to host
-        for (int bufferIndex = 0; (bytesRemaining0>0) && (bufferIndex < _numBuffers);  bytesRemaining0 -= _bufferSize, bufferIndex++) {
+        size_t theseBytes = (bytesRemaining1 > chunkSize) ? chunkSize : bytesRemaining1;
+
+        tprintf (DB_COPY2, "D2H: wait_completion[%d] bytesRemaining=%zu\n", bufferIndex, bytesRemaining1);
+        SignalWait(_completion_signal[bufferIndex], SignalWaitDefault);
 
-            size_t theseBytes = (bytesRemaining0 > _bufferSize) ? _bufferSize : bytesRemaining0;
+        tprintf (DB_COPY2, "D2H: bytesRemaining1=%zu copy %zu bytes stagingBuf[%d]:%p to dst:%p\n", bytesRemaining1, theseBytes, bufferIndex, _pinnedStagingBuffer[bufferIndex], dstp1);
+        StagingMemcpy(dstp1, _pinnedStagingBuffer[bufferIndex], theseBytes, useCopyPool, false/*nonTemporal*/);
+
+        dstp1 += theseBytes;
+        bytesRemaining1 -= theseBytes;
+
+        if (_d2hRing && (bytesRemaining0 > 0)) {
+            issueChunk(bufferIndex);
+        }
 
-            tprintf (DB_COPY2, "D2H: bytesRemaining0=%zu  async_copy %zu bytes src:%p to staging:%p\n", bytesRemaining0, theseBytes, srcp0, _pinnedStagingBuffer[bufferIndex]);
-            hsa_signal_store_relaxed(_completion_signal[bufferIndex], 1);
-            hsa_status_t hsa_status = hsa_amd_memory_async_copy(_pinnedStagingBuffer[bufferIndex], _hsa_agent, srcp0, _hsa_agent, theseBytes, waitFor ? 1:0, waitFor, _completion_signal[bufferIndex]);
-            if (hsa_status != HSA_STATUS_SUCCESS) {
-                THROW_ERROR (hipErrorRuntimeMemory);
+        if (++bufferIndex >= _numBuffers) {
+            bufferIndex = 0;
+            for (int i = 0; !_d2hRing && (bytesRemaining0>0) && (i < _numBuffers); i++) {
+                issueChunk(i);
             }
+        }
+    }
+}
 
-            srcp0 += theseBytes;
 
+//---
+//Queue a staged copy for the worker thread and return immediately.
+//IN: hostToDevice - true for CopyHostToDevice, false for CopyDeviceToHost.
+//IN: waitFor - hsaSignal the copy depends on, 0 handle if none.
+//IN: completion - signal which the worker sets to 0 when the copy has finished.  Caller must set it to 1 before enqueueing.
+//IN: error - if the copy fails the worker sets it to the error code, unless it already holds an error.  May be NULL.
+//The host memory must remain valid until the completion signal is set.
+void StagingBuffer::EnqueueCopy(bool hostToDevice, void* dst, const void* src, size_t sizeBytes, hsa_signal_t waitFor, hsa_signal_t completion,
+                                const StagingCopyPlan &plan, bool highPriority, std::atomic<int> *error)
+{
+    CopyJob job;
+    job._hostToDevice = hostToDevice;
+    job._plan = plan;
+    job._dst = dst;
+    job._src = src;
+    job._sizeBytes = sizeBytes;
+    job._waitFor = waitFor;
+    job._completion = completion;
+    job._highPriority = highPriority;
+    job._error = error;
+
+    {
+        std::lock_guard<std::mutex> l (_job_lock);
+
+        if (!_worker.joinable()) {
+            _worker = std::thread(&StagingBuffer::CopyWorker, this);
+        }
 
-            // Assume subsequent commands are dependent on previous and don't need dependency after first copy submitted, HIP_ONESHOT_COPY_DEP=1 
-            waitFor = NULL; 
+        // The worker blocks on each job's waitFor in queue order.  A high-priority job may only pass normal jobs
+        // once its dependency has completed - else it could wait for a normal job queued behind it.  It always
+        // stays behind the other high-priority jobs, which keeps the order of its own stream.
+        bool ready = (waitFor.handle == 0) || (hsa_signal_load_acquire(waitFor) == 0);
+        if (highPriority && ready) {
+            auto iter = _jobs.end();
+            while ((iter != _jobs.begin()) && !(iter - 1)->_highPriority) {
+                --iter;
+            }
+            _jobs.insert(iter, job);
+        } else {
+            _jobs.push_back(job);
         }
+    }
+
+    _job_cv.notify_one();
+}
 
-        // Now unload the staging buffers:
-        for (int bufferIndex=0; (bytesRemaining1>0) && (bufferIndex < _numBuffers);  bytesRemaining1 -= _bufferSize, bufferIndex++) {
 
-            size_t theseBytes = (bytesRemaining1 > _bufferSize) ? _bufferSize : bytesRemaining1;
+//---
+//Worker thread which pumps the queued copies through the staging buffers, one at a time in queue order.
+void StagingBuffer::CopyWorker()
+{
+    std::unique_lock<std::mutex> l (_job_lock);
 
-            tprintf (DB_COPY2, "D2H: wait_completion[%d] bytesRemaining=%zu\n", bufferIndex, bytesRemaining1);
-            hsa_signal_wait_acquire(_completion_signal[bufferIndex], HSA_SIGNAL_CONDITION_LT, 1, UINT64_MAX, HSA_WAIT_STATE_ACTIVE);
+    while (true) {
+        _job_cv.wait(l, [this] { return _stop_worker || !_jobs.empty(); });
+        if (_jobs.empty()) {
+            break; // stop requested and queue drained.
+        }
 
-            tprintf (DB_COPY2, "D2H: bytesRemaining1=%zu copy %zu bytes stagingBuf[%d]:%p to dst:%p\n", bytesRemaining1, theseBytes, bufferIndex, _pinnedStagingBuffer[bufferIndex], dstp1);
-            memcpy(dstp1, _pinnedStagingBuffer[bufferIndex], theseBytes);
+        CopyJob job = _jobs.front();
+        _jobs.pop_front();
+        l.unlock();
 
-            dstp1 += theseBytes;
+        hsa_signal_t *waitFor = job._waitFor.handle ? &job._waitFor : NULL;
+        int error = 0;
+        try {
+            tprintf (DB_COPY2, "staging worker: %s dst=%p src=%p sz=%zu\n", job._hostToDevice ? "H2D" : "D2H", job._dst, job._src, job._sizeBytes);
+            Copy(job._hostToDevice, job._dst, job._src, job._sizeBytes, waitFor, job._plan);
+#ifdef HIP_HCC
+        } catch (ihipException ex) {
+            error = ex._code;
+#endif
+        } catch (...) {
+            error = COPY_ERROR_UNKNOWN;
+        }
+
+        // Record the error before the release below, so whoever waits on the completion also sees it.
+        // The signal is released even on error so the stream does not hang.
+        if (error && job._error) {
+            int noError = 0;
+            job._error->compare_exchange_strong(noError, error);
         }
+        hsa_signal_store_release(job._completion, 0);
+
+        l.lock();
     }
+}
+
 
 
-    //for (int i=0; i<_numBuffers; i++) {
-    //    hsa_signal_wait_acquire(_completion_signal[i], HSA_SIGNAL_CONDITION_LT, 1, UINT64_MAX, HSA_WAIT_STATE_ACTIVE);
-    //}
+//-------------------------------------------------------------------------------------------------
+StagingBufferPool::StagingBufferPool(hsa_agent_t hsaAgent, hsa_agent_t cpuAgent, hsa_region_t systemRegion, size_t bufferSize, int numBuffers, int maxBuffers,
+                                     HostCopyPool *copyPool, size_t copyPoolThreshold, PinnedRangeCache *pinCache, bool d2hRing) :
+    _hsa_agent(hsaAgent),
+    _cpu_agent(cpuAgent),
+    _systemRegion(systemRegion),
+    _bufferSize(bufferSize),
+    _numBuffers(numBuffers),
+    _maxBuffers(maxBuffers < 1 ? 1 : maxBuffers),
+    _copyPool(copyPool),
+    _copyPoolThreshold(copyPoolThreshold),
+    _pinCache(pinCache),
+    _d2hRing(d2hRing),
+    _highWaiters(0)
+{
+    // Always have one buffer, so the common single-threaded case never allocates after init:
+    std::lock_guard<std::mutex> l (_lock);
+    _buffers.push_back(newBuffer());
+    _idle.push_back(_buffers.back());
+}
+
+
+//---
+StagingBufferPool::~StagingBufferPool()
+{
+    for (auto iter=_buffers.begin(); iter!=_buffers.end(); iter++) {
+        delete *iter;
+    }
+    for (auto iter=_streamBuffers.begin(); iter!=_streamBuffers.end(); iter++) {
+        delete *iter;
+    }
+}
+
+
+//---
+StagingBuffer* StagingBufferPool::newBuffer()
+{
+    StagingBuffer *buffer = new StagingBuffer(_hsa_agent, _cpu_agent, _systemRegion, _bufferSize, _numBuffers, _copyPool, _copyPoolThreshold, _pinCache, _d2hRing);
+    tprintf (DB_COPY1, "staging pool: created staging buffer, %zu leased + %zu worker\n", _buffers.size(), _streamBuffers.size());
+    return buffer;
+}
+
+
+//---
+StagingBuffer* StagingBufferPool::Acquire(bool highPriority)
+{
+    std::unique_lock<std::mutex> l (_lock);
+
+    if (_idle.empty() && (_buffers.size() < _maxBuffers)) {
+        _buffers.push_back(newBuffer());
+        return _buffers.back();
+    }
+
+    if (highPriority) {
+        _highWaiters++;
+        _released_cv.wait(l, [this] { return !_idle.empty(); });
+        _highWaiters--;
+    } else {
+        _released_cv.wait(l, [this] { return !_idle.empty() && (_highWaiters == 0); });
+    }
+
+    StagingBuffer *buffer = _idle.back();
+    _idle.pop_back();
+    return buffer;
+}
+
+
+//---
+void StagingBufferPool::Release(StagingBuffer* buffer)
+{
+    {
+        std::lock_guard<std::mutex> l (_lock);
+        _idle.push_back(buffer);
+    }
+    // Wake everyone, so a normal-priority waiter can not take the notify from a high-priority one:
+    _released_cv.notify_all();
+}
+
+
+//---
+StagingBuffer* StagingBufferPool::StreamBuffer(uint64_t streamId)
+{
+    std::lock_guard<std::mutex> l (_lock);
+
+    size_t index = streamId % _maxBuffers;
+    while (_streamBuffers.size() <= index) {
+        _streamBuffers.push_back(newBuffer());
+    }
+    return _streamBuffers[index];
 }
@@ -0,0 +1,157 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Test hipEventCreateWithFlags:
+// - every flag combination is accepted, and invalid ones are rejected.
+// - hipEventDisableTiming events work as sync points (query, synchronize, hipStreamWaitEvent) and refuse
+//   hipEventElapsedTime.
+// - hipEventBlockingSync events synchronize.
+// Also reports the cost of record + synchronize for events with and without timing.
+
+#include <chrono>
+#include "hip_runtime.h"
+#include "test_common.h"
+
+
+__global__ void
+addOne(hipLaunchParm lp, int *A)
+{
+    if ((hipBlockIdx_x == 0) && (hipThreadIdx_x == 0)) {
+        A[0] += 1;
+    }
+}
+
+
+void testFlags()
+{
+    const unsigned valid[] = {hipEventDefault, hipEventBlockingSync, hipEventDisableTiming,
+                              hipEventBlockingSync | hipEventDisableTiming,
+                              hipEventDisableTiming | hipEventInterprocess,
+                              hipEventBlockingSync | hipEventDisableTiming | hipEventInterprocess};
+    for (int i=0; i<sizeof(valid)/sizeof(valid[0]); i++) {
+        hipEvent_t event;
+        HIPCHECK (hipEventCreateWithFlags(&event, valid[i]));
+        HIPCHECK (hipEventRecord(event, NULL));
+        HIPCHECK (hipEventSynchronize(event));
+        HIPCHECK (hipEventDestroy(event));
+    }
+
+    hipEvent_t event;
+    HIPASSERT (hipEventCreateWithFlags(&event, hipEventInterprocess) == hipErrorInvalidValue);
+    HIPASSERT (hipEventCreateWithFlags(&event, 0x80) == hipErrorInvalidValue);
+}
+
+
+void testSyncPoint(hipStream_t stream1, hipStream_t stream2, unsigned flags)
+{
+    int *C_d;
+    HIPCHECK (hipMalloc(&C_d, sizeof(int)));
+    HIPCHECK (hipMemset(C_d, 0, sizeof(int)));
+
+    hipEvent_t start, stop;
+    HIPCHECK (hipEventCreateWithFlags(&start, flags));
+    HIPCHECK (hipEventCreateWithFlags(&stop, flags));
+
+    HIPCHECK (hipEventRecord(start, stream1));
+    for (int i=0; i<iterations; i++) {
+        hipLaunchKernel(addOne, dim3(1), dim3(64), 0, stream1, C_d);
+    }
+    HIPCHECK (hipEventRecord(stop, stream1));
+
+    // stream2 runs after stream1's kernels:
+    HIPCHECK (hipStreamWaitEvent(stream2, stop, 0));
+    hipLaunchKernel(addOne, dim3(1), dim3(64), 0, stream2, C_d);
+    HIPCHECK (hipStreamSynchronize(stream2));
+
+    HIPCHECK (hipEventQuery(stop));
+    HIPCHECK (hipEventSynchronize(stop));
+
+    int count = 0;
+    HIPCHECK (hipMemcpy(&count, C_d, sizeof(int), hipMemcpyDeviceToHost));
+    HIPASSERT (count == iterations + 1);
+
+    float ms;
+    hipError_t e = hipEventElapsedTime(&ms, start, stop);
+    if (flags & hipEventDisableTiming) {
+        HIPASSERT (e == hipErrorInvalidResourceHandle);
+    } else {
+        HIPCHECK (e);
+        HIPASSERT (ms >= 0.0f);
+    }
+
+    HIPCHECK (hipEventDestroy(start));
+    HIPCHECK (hipEventDestroy(stop));
+    HIPCHECK (hipFree(C_d));
+}
+
+
+void timeRecordSync(hipStream_t stream, unsigned flags, int count)
+{
+    int *C_d;
+    HIPCHECK (hipMalloc(&C_d, sizeof(int)));
+
+    hipEvent_t event;
+    HIPCHECK (hipEventCreateWithFlags(&event, flags));
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<count; i++) {
+        hipLaunchKernel(addOne, dim3(1), dim3(64), 0, stream, C_d);
+        HIPCHECK (hipEventRecord(event, stream));
+        HIPCHECK (hipEventSynchronize(event));
+    }
+    auto stop = std::chrono::high_resolution_clock::now();
+
+    double us = std::chrono::duration<double, std::micro>(stop - start).count();
+    printf ("  flags=0x%x: kernel + record + synchronize %8.2f us\n", flags, us/count);
+
+    HIPCHECK (hipEventDestroy(event));
+    HIPCHECK (hipFree(C_d));
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    hipStream_t stream1, stream2, stream3;
+    HIPCHECK (hipStreamCreate(&stream1));
+    HIPCHECK (hipStreamCreate(&stream2));
+    HIPCHECK (hipStreamCreate(&stream3));
+
+    testFlags();
+
+    const unsigned flags[] = {hipEventDefault, hipEventBlockingSync, hipEventDisableTiming, hipEventBlockingSync | hipEventDisableTiming};
+    for (int i=0; i<sizeof(flags)/sizeof(flags[0]); i++) {
+        testSyncPoint(stream1, stream2, flags[i]);
+    }
+
+    // stream3 only records events without timing, so they do not turn on profiling for its queue:
+    timeRecordSync(stream3, hipEventDisableTiming, 1000);
+    timeRecordSync(stream1, hipEventDefault, 1000);
+    timeRecordSync(stream1, hipEventDisableTiming, 1000);
+
+    HIPCHECK (hipStreamDestroy(stream1));
+    HIPCHECK (hipStreamDestroy(stream2));
+    HIPCHECK (hipStreamDestroy(stream3));
+
+    passed();
+}
@@ -0,0 +1,252 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Test hipEventQuery:
+// - A query on an event behind a long-running kernel returns hipErrorNotReady, and later returns hipSuccess without
+//   any synchronize call.
+// - A query covers async copies recorded before the event, so the host data is valid once the query succeeds.
+// - Many in-flight events in many streams are multiplexed by a polling loop, and events are created and destroyed
+//   (and re-recorded while in-flight) to exercise the event slab.
+// Also reports the cost of hipEventQuery and of hipEventCreate + hipEventDestroy.
+
+#include <chrono>
+#include <vector>
+#include "hip_runtime.h"
+#include "test_common.h"
+
+
+__global__ void
+spinKernel(hipLaunchParm lp, long long cycles)
+{
+    long long start = clock64();
+    while ((clock64() - start) < cycles) {
+    }
+}
+
+
+__global__ void
+addOne(hipLaunchParm lp, int *A)
+{
+    if ((hipBlockIdx_x == 0) && (hipThreadIdx_x == 0)) {
+        A[0] += 1;
+    }
+}
+
+
+// Poll until the event completes, with no synchronize call.  Returns the number of polls.
+long pollEvent(hipEvent_t event)
+{
+    long polls = 0;
+    hipError_t e;
+    while ((e = hipEventQuery(event)) == hipErrorNotReady) {
+        polls++;
+    }
+    HIPCHECK (e);
+    return polls;
+}
+
+
+void testNotReady(hipStream_t stream)
+{
+    hipEvent_t event;
+    HIPCHECK (hipEventCreate(&event));
+
+    // Never recorded:
+    HIPCHECK (hipEventQuery(event));
+
+    hipLaunchKernel(spinKernel, dim3(1), dim3(1), 0, stream, 100000000LL);
+    HIPCHECK (hipEventRecord(event, stream));
+    HIPASSERT (hipEventQuery(event) == hipErrorNotReady);
+
+    long polls = pollEvent(event);
+    printf ("  event after spin kernel completed after %ld polls\n", polls);
+    HIPASSERT (polls > 0);
+
+    // Stays complete:
+    HIPCHECK (hipEventQuery(event));
+
+    HIPCHECK (hipEventDestroy(event));
+}
+
+
+void testCopy(hipStream_t stream, size_t N)
+{
+    size_t Nbytes = N*sizeof(int);
+    int *A_h = (int*)malloc(Nbytes);
+    int *B_h = (int*)malloc(Nbytes);
+    int *A_d;
+    HIPCHECK (hipMalloc(&A_d, Nbytes));
+
+    for (size_t i=0; i<N; i++) {
+        A_h[i] = i;
+        B_h[i] = 0;
+    }
+
+    hipEvent_t event;
+    HIPCHECK (hipEventCreate(&event));
+
+    for (int i=0; i<iterations; i++) {
+        memset(B_h, 0, Nbytes);
+        HIPCHECK (hipMemcpyAsync(A_d, A_h, Nbytes, hipMemcpyHostToDevice, stream));
+        HIPCHECK (hipMemcpyAsync(B_h, A_d, Nbytes, hipMemcpyDeviceToHost, stream));
+        HIPCHECK (hipEventRecord(event, stream));
+
+        pollEvent(event);
+        for (size_t j=0; j<N; j++) {
+            HIPASSERT (B_h[j] == (int)j);
+        }
+    }
+
+    HIPCHECK (hipEventDestroy(event));
+    HIPCHECK (hipFree(A_d));
+    free(A_h);
+    free(B_h);
+}
+
+
+void testMultiplex(int streamCnt, int requests)
+{
+    std::vector<hipStream_t> streams(streamCnt);
+    std::vector<hipEvent_t> events(streamCnt);
+    std::vector<int> issued(streamCnt, 0);
+    int *C_d;
+    HIPCHECK (hipMalloc(&C_d, streamCnt*sizeof(int)));
+    HIPCHECK (hipMemset(C_d, 0, streamCnt*sizeof(int)));
+
+    for (int i=0; i<streamCnt; i++) {
+        HIPCHECK (hipStreamCreate(&streams[i]));
+        HIPCHECK (hipEventCreate(&events[i]));
+    }
+
+    // Keep one request in-flight per stream, issue the next as soon as a query says the last one completed.
+    // Every request uses a new event, and the old one is destroyed, so the slab recycles events continuously.
+    long queries = 0;
+    int done = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<streamCnt; i++) {
+        hipLaunchKernel(addOne, dim3(1), dim3(64), 0, streams[i], C_d + i);
+        HIPCHECK (hipEventRecord(events[i], streams[i]));
+        issued[i]++;
+    }
+    while (done < streamCnt) {
+        for (int i=0; i<streamCnt; i++) {
+            if (issued[i] > requests) {
+                continue;
+            }
+            queries++;
+            hipError_t e = hipEventQuery(events[i]);
+            if (e == hipErrorNotReady) {
+                continue;
+            }
+            HIPCHECK (e);
+
+            if (issued[i] == requests) {
+                issued[i]++;
+                done++;
+            } else {
+                HIPCHECK (hipEventDestroy(events[i]));
+                HIPCHECK (hipEventCreate(&events[i]));
+                hipLaunchKernel(addOne, dim3(1), dim3(64), 0, streams[i], C_d + i);
+                HIPCHECK (hipEventRecord(events[i], streams[i]));
+                issued[i]++;
+            }
+        }
+    }
+    auto stop = std::chrono::high_resolution_clock::now();
+
+    std::vector<int> C_h(streamCnt);
+    HIPCHECK (hipMemcpy(C_h.data(), C_d, streamCnt*sizeof(int), hipMemcpyDeviceToHost));
+    for (int i=0; i<streamCnt; i++) {
+        HIPASSERT (C_h[i] == requests);
+    }
+
+    double us = std::chrono::duration<double, std::micro>(stop - start).count();
+    printf ("  %d streams x %d requests: %8.2f us/request, %ld queries (%.2f us/query)\n",
+            streamCnt, requests, us/(streamCnt*requests), queries, us/queries);
+
+    for (int i=0; i<streamCnt; i++) {
+        HIPCHECK (hipEventDestroy(events[i]));
+        HIPCHECK (hipStreamDestroy(streams[i]));
+    }
+    HIPCHECK (hipFree(C_d));
+}
+
+
+// Record an event again while its last record is still in-flight, then destroy it while in-flight.
+void testRerecord(hipStream_t stream)
+{
+    hipEvent_t event;
+    HIPCHECK (hipEventCreate(&event));
+
+    hipLaunchKernel(spinKernel, dim3(1), dim3(1), 0, stream, 10000000LL);
+    HIPCHECK (hipEventRecord(event, stream));
+    hipLaunchKernel(spinKernel, dim3(1), dim3(1), 0, stream, 10000000LL);
+    HIPCHECK (hipEventRecord(event, stream));
+    HIPCHECK (hipEventSynchronize(event));
+    HIPCHECK (hipEventQuery(event));
+
+    hipLaunchKernel(spinKernel, dim3(1), dim3(1), 0, stream, 10000000LL);
+    HIPCHECK (hipEventRecord(event, stream));
+    HIPCHECK (hipEventDestroy(event));
+
+    // Likely reuses the destroyed event from the slab:
+    HIPCHECK (hipEventCreate(&event));
+    HIPCHECK (hipEventQuery(event));
+    HIPCHECK (hipEventRecord(event, stream));
+    pollEvent(event);
+    HIPCHECK (hipEventDestroy(event));
+}
+
+
+void timeCreateDestroy(int count)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<count; i++) {
+        hipEvent_t event;
+        HIPCHECK (hipEventCreate(&event));
+        HIPCHECK (hipEventDestroy(event));
+    }
+    auto stop = std::chrono::high_resolution_clock::now();
+
+    double us = std::chrono::duration<double, std::micro>(stop - start).count();
+    printf ("  create+destroy: %8.3f us/event\n", us/count);
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    hipStream_t stream;
+    HIPCHECK (hipStreamCreate(&stream));
+
+    testNotReady(stream);
+    testCopy(stream, N);
+    testRerecord(stream);
+    testMultiplex(16, 10 * iterations);
+    testMultiplex(256, iterations);
+    timeCreateDestroy(10000);
+
+    HIPCHECK (hipStreamDestroy(stream));
+
+    passed();
+}
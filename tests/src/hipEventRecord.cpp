@@ -27,6 +27,50 @@ THE SOFTWARE.
 #include "hip_runtime.h"
 #include "test_common.h"
 
+
+__global__ void
+spinKernel(hipLaunchParm lp, long long cycles)
+{
+    long long start = clock64();
+    while ((clock64() - start) < cycles) {
+    }
+}
+
+
+// An event recorded in the NULL stream waits for the blocking streams on the device, without blocking the host.
+void testNullStreamJoin()
+{
+    hipStream_t blocking;
+    HIPCHECK (hipStreamCreate(&blocking));
+
+    hipEvent_t event, blockingDone;
+    HIPCHECK (hipEventCreate(&event));
+    HIPCHECK (hipEventCreate(&blockingDone));
+
+    hipLaunchKernel(spinKernel, dim3(1), dim3(1), 0, blocking, 100000000LL);
+    HIPCHECK (hipEventRecord(blockingDone, blocking));
+
+    long long hostStart = HipTest::get_time();
+    HIPCHECK (hipEventRecord(event, NULL));
+    long long hostStop = HipTest::get_time();
+    printf ("hipEventRecord(NULL) with a busy blocking stream took %6.3fms\n", HipTest::elapsed_time(hostStart, hostStop));
+
+    // The host did not wait for the blocking stream:
+    HIPASSERT (hipEventQuery(event) == hipErrorNotReady);
+
+    HIPCHECK (hipEventSynchronize(event));
+    HIPCHECK (hipEventQuery(blockingDone));
+
+    float ms;
+    HIPCHECK (hipEventElapsedTime(&ms, blockingDone, event));
+    HIPASSERT (ms >= 0.0f);
+
+    HIPCHECK (hipEventDestroy(event));
+    HIPCHECK (hipEventDestroy(blockingDone));
+    HIPCHECK (hipStreamDestroy(blocking));
+}
+
+
 int main(int argc, char *argv[])
 {
     HipTest::parseStandardArguments(argc, argv, true);
@@ -93,6 +137,7 @@ int main(int argc, char *argv[])
 
     HipTest::checkVectorADD(A_h, B_h, C_h, N, true);
 
+    testNullStreamJoin();
 
 
     passed();
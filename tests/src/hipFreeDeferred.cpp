@@ -0,0 +1,194 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Test the deferred hipFree.
+// hipFree does not wait for the device: the memory is released once the commands enqueued before the free
+// have completed.  Kernels still running must keep using the old memory, a second free of a pending pointer
+// must fail, and hipMalloc must reclaim pending frees when the device runs out of memory.
+
+#include "hip_runtime.h"
+#include "test_common.h"
+
+
+int p_kernelIters = 4096;
+
+
+// Re-reads A on every iteration, so the kernel keeps accessing A for its whole run time.
+__global__ void
+slowSum(hipLaunchParm lp, const volatile float *A_d, float *C_d, size_t NELEM, int iters)
+{
+    size_t offset = (hipBlockIdx_x * hipBlockDim_x + hipThreadIdx_x);
+    size_t stride = hipBlockDim_x * hipGridDim_x ;
+
+    for (size_t i=offset; i<NELEM; i+=stride) {
+        float sum = 0.0f;
+        for (int k=0; k<iters; k++) {
+            sum += A_d[i];
+        }
+        C_d[i] = sum;
+    }
+}
+
+
+// Small integers, so the sums are exact.
+void initInput(float *A_h, size_t n)
+{
+    for (size_t i=0; i<n; i++) {
+        A_h[i] = (float)(i % 64);
+    }
+}
+
+
+void checkSum(const float *A_h, const float *C_h, size_t n, int iters)
+{
+    for (size_t i=0; i<n; i++) {
+        float expected = A_h[i] * iters;
+        if (C_h[i] != expected) {
+            failed("C_h[%zu] = %f, expected %f\n", i, C_h[i], expected);
+        }
+    }
+}
+
+
+// Free the input of a running kernel, then allocate and overwrite memory from another stream.
+// If hipFree released the input early, the new allocation could reuse it and corrupt the kernel's result.
+void testFreeWhileInUse(hipStream_t stream, hipStream_t otherStream)
+{
+    size_t Nbytes = N*sizeof(float);
+
+    float *A_h = (float*)malloc(Nbytes);
+    float *C_h = (float*)malloc(Nbytes);
+    initInput(A_h, N);
+
+    float *A_d, *C_d;
+    HIPCHECK (hipMalloc(&A_d, Nbytes));
+    HIPCHECK (hipMalloc(&C_d, Nbytes));
+    HIPCHECK (hipMemcpy(A_d, A_h, Nbytes, hipMemcpyHostToDevice));
+
+    unsigned blocks = HipTest::setNumBlocks(blocksPerCU, threadsPerBlock, N);
+    hipLaunchKernel(slowSum, dim3(blocks), dim3(threadsPerBlock), 0, stream, A_d, C_d, N, p_kernelIters);
+
+    HIPCHECK (hipFree(A_d));
+
+    float *X_d;
+    HIPCHECK (hipMalloc(&X_d, Nbytes));
+    HIPCHECK (hipMemsetAsync(X_d, 0xff, Nbytes, otherStream));
+
+    HIPCHECK (hipStreamSynchronize(otherStream));
+    HIPCHECK (hipStreamSynchronize(stream));
+
+    HIPCHECK (hipMemcpy(C_h, C_d, Nbytes, hipMemcpyDeviceToHost));
+    checkSum(A_h, C_h, N, p_kernelIters);
+
+    HIPCHECK (hipFree(X_d));
+    HIPCHECK (hipFree(C_d));
+    free(A_h);
+    free(C_h);
+}
+
+
+// A second free of a pointer whose first free is still pending must fail, and must not release it twice.
+void testDoubleFree(hipStream_t stream)
+{
+    size_t Nbytes = N*sizeof(float);
+
+    float *A_d, *C_d;
+    HIPCHECK (hipMalloc(&A_d, Nbytes));
+    HIPCHECK (hipMalloc(&C_d, Nbytes));
+    HIPCHECK (hipMemset(A_d, 0, Nbytes));
+
+    unsigned blocks = HipTest::setNumBlocks(blocksPerCU, threadsPerBlock, N);
+    hipLaunchKernel(slowSum, dim3(blocks), dim3(threadsPerBlock), 0, stream, A_d, C_d, N, p_kernelIters);
+
+    HIPCHECK (hipFree(A_d));
+    HIPASSERT (hipFree(A_d) != hipSuccess);
+
+    HIPCHECK (hipStreamSynchronize(stream));
+    HIPASSERT (hipFree(A_d) != hipSuccess);
+
+    HIPCHECK (hipFree(C_d));
+}
+
+
+// Free most of the device memory while a kernel still uses it, then allocate the same amount again.
+// The memory is only released once the kernel completes, so hipMalloc has to reclaim the pending free.
+void testMallocReclaims(hipStream_t stream)
+{
+    size_t freeBytes, totalBytes;
+    HIPCHECK (hipMemGetInfo(&freeBytes, &totalBytes));
+
+    size_t bigBytes = freeBytes / 4 * 3;
+    size_t Nbytes = N*sizeof(float);
+    if (bigBytes < 2*Nbytes) {
+        printf ("  skip, only %zu bytes free\n", freeBytes);
+        return;
+    }
+
+    float *big_d, *C_d;
+    HIPCHECK (hipMalloc(&C_d, Nbytes));
+    if (hipMalloc(&big_d, bigBytes) != hipSuccess) {
+        printf ("  skip, can not allocate %zu of %zu free bytes\n", bigBytes, freeBytes);
+        HIPCHECK (hipFree(C_d));
+        return;
+    }
+    HIPCHECK (hipMemset(big_d, 0, Nbytes));
+
+    unsigned blocks = HipTest::setNumBlocks(blocksPerCU, threadsPerBlock, N);
+    hipLaunchKernel(slowSum, dim3(blocks), dim3(threadsPerBlock), 0, stream, big_d, C_d, N, p_kernelIters);
+
+    HIPCHECK (hipFree(big_d));
+    HIPCHECK (hipMalloc(&big_d, bigBytes));
+
+    HIPCHECK (hipStreamSynchronize(stream));
+    HIPCHECK (hipFree(big_d));
+    HIPCHECK (hipFree(C_d));
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    hipStream_t stream, otherStream;
+    HIPCHECK (hipStreamCreateWithFlags(&stream, hipStreamNonBlocking));
+    HIPCHECK (hipStreamCreateWithFlags(&otherStream, hipStreamNonBlocking));
+
+    for (int i=0; i<iterations; i++) {
+        if (p_tests & 0x1) {
+            printf ("test: free while a kernel uses the memory\n");
+            testFreeWhileInUse(stream, otherStream);
+        }
+        if (p_tests & 0x2) {
+            printf ("test: double free while the first free is pending\n");
+            testDoubleFree(stream);
+        }
+        if (p_tests & 0x4) {
+            printf ("test: hipMalloc reclaims pending frees\n");
+            testMallocReclaims(stream);
+        }
+    }
+
+    HIPCHECK (hipStreamDestroy(otherStream));
+    HIPCHECK (hipStreamDestroy(stream));
+
+    passed();
+}
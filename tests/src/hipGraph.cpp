@@ -0,0 +1,116 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Test stream capture and graph replay.
+// Copies, a memset and a kernel are captured from a stream, then the graph is replayed several times with new
+// host inputs.  Back-to-back launches without a host sync check that in-flight launches do not share signals, and
+// destroying the executable graph waits for launches still in flight.
+
+#include "hip_runtime.h"
+#include "test_common.h"
+
+
+void testGraph(hipStream_t stream, int launches)
+{
+    size_t Nbytes = N*sizeof(float);
+
+    float *A_d, *B_d, *C_d;
+    float *A_h, *B_h, *C_h;
+    HipTest::initArrays (&A_d, &B_d, &C_d, &A_h, &B_h, &C_h, N, true);
+
+    unsigned blocks = HipTest::setNumBlocks(blocksPerCU, threadsPerBlock, N);
+    memset(C_h, 0, Nbytes);
+
+    HIPCHECK (hipStreamBeginCapture(stream));
+    HIPCHECK (hipMemcpyAsync(A_d, A_h, Nbytes, hipMemcpyHostToDevice, stream));
+    HIPCHECK (hipMemcpyAsync(B_d, B_h, Nbytes, hipMemcpyHostToDevice, stream));
+    HIPCHECK (hipMemsetAsync(C_d, 0xff, Nbytes, stream));
+    hipLaunchKernel(HipTest::vectorADD, dim3(blocks), dim3(threadsPerBlock), 0, stream, A_d, B_d, C_d, N);
+    HIPCHECK (hipMemcpyAsync(C_h, C_d, Nbytes, hipMemcpyDeviceToHost, stream));
+
+    hipGraph_t graph;
+    HIPCHECK (hipStreamEndCapture(stream, &graph));
+
+    // Nothing ran during capture:
+    HIPCHECK (hipStreamSynchronize(stream));
+    for (size_t i=0; i<N; i++) {
+        HIPASSERT(C_h[i] == 0.0f);
+    }
+
+    hipGraphExec_t graphExec;
+    HIPCHECK (hipGraphInstantiate(&graphExec, graph));
+    HIPCHECK (hipGraphDestroy(graph));
+
+    for (int l=0; l<launches; l++) {
+        for (size_t i=0; i<N; i++) {
+            A_h[i] = l + i;
+        }
+        HIPCHECK (hipGraphLaunch(graphExec, stream));
+        HIPCHECK (hipStreamSynchronize(stream));
+        HipTest::checkVectorADD(A_h, B_h, C_h, N);
+    }
+
+    // Back-to-back launches, then a command that must run after the last launch:
+    for (int l=0; l<launches; l++) {
+        HIPCHECK (hipGraphLaunch(graphExec, stream));
+    }
+    HIPCHECK (hipMemsetAsync(C_d, 0, Nbytes, stream));
+    HIPCHECK (hipMemcpyAsync(C_h, C_d, Nbytes, hipMemcpyDeviceToHost, stream));
+    HIPCHECK (hipStreamSynchronize(stream));
+    for (size_t i=0; i<N; i++) {
+        HIPASSERT(C_h[i] == 0.0f);
+    }
+
+    // Launching into a capturing stream is an error, and records nothing:
+    HIPCHECK (hipStreamBeginCapture(stream));
+    HIPASSERT(hipGraphLaunch(graphExec, stream) == hipErrorInvalidValue);
+    HIPCHECK (hipStreamEndCapture(stream, &graph));
+    HIPCHECK (hipGraphDestroy(graph));
+
+    // Destroy with launches still in flight:
+    for (int l=0; l<launches; l++) {
+        HIPCHECK (hipGraphLaunch(graphExec, stream));
+    }
+    HIPCHECK (hipGraphExecDestroy(graphExec));
+    HIPCHECK (hipStreamSynchronize(stream));
+
+    HipTest::freeArrays (A_d, B_d, C_d, A_h, B_h, C_h, true);
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    hipStream_t stream;
+    HIPCHECK (hipStreamCreate(&stream));
+
+    // The NULL stream can not be captured:
+    HIPASSERT(hipStreamBeginCapture(0) == hipErrorInvalidValue);
+
+    testGraph(stream, iterations);
+
+    HIPCHECK (hipStreamDestroy(stream));
+
+    passed();
+}
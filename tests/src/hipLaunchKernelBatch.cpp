@@ -0,0 +1,121 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Test hipLaunchKernelBatch.
+// A batch of increment kernels is launched into a stream and followed by a copy, which must wait for the whole batch.
+// On a created stream the same descriptors are then launched from a captured graph.
+
+#include "hip_runtime.h"
+#include "test_common.h"
+
+#include <vector>
+
+
+__global__ void
+addOne(hipLaunchParm lp, int *A, size_t N)
+{
+    size_t offset = (hipBlockIdx_x * hipBlockDim_x + hipThreadIdx_x);
+    size_t stride = hipBlockDim_x * hipGridDim_x ;
+
+    for (size_t i=offset; i<N; i+=stride) {
+        A[i] += 1;
+    }
+}
+
+
+void checkArray(const int *A_h, int expected)
+{
+    for (size_t i=0; i<N; i++) {
+        if (A_h[i] != expected) {
+            failed("A_h[%zu] = %d, expected %d\n", i, A_h[i], expected);
+        }
+    }
+}
+
+
+void testBatch(hipStream_t stream, int count)
+{
+    size_t Nbytes = N*sizeof(int);
+
+    int *A_d, *A_h;
+    HIPCHECK (hipMalloc(&A_d, Nbytes));
+    HIPCHECK (hipHostMalloc((void**)&A_h, Nbytes));
+
+    unsigned blocks = HipTest::setNumBlocks(blocksPerCU, threadsPerBlock, N);
+
+    std::vector<hipKernelLaunch_t> launches(count);
+    for (int i=0; i<count; i++) {
+        hipKernelLaunchInit(launches[i], addOne, dim3(blocks), dim3(threadsPerBlock), 0, A_d, N);
+    }
+
+    HIPCHECK (hipMemsetAsync(A_d, 0, Nbytes, stream));
+    HIPCHECK (hipLaunchKernelBatch(stream, launches.data(), count));
+    HIPCHECK (hipMemcpyAsync(A_h, A_d, Nbytes, hipMemcpyDeviceToHost, stream));
+    HIPCHECK (hipStreamSynchronize(stream));
+    checkArray(A_h, count);
+
+    // Descriptors are reusable, and an empty batch is a no-op:
+    HIPCHECK (hipLaunchKernelBatch(stream, launches.data(), count));
+    HIPCHECK (hipLaunchKernelBatch(stream, launches.data(), 0));
+    HIPCHECK (hipMemcpyAsync(A_h, A_d, Nbytes, hipMemcpyDeviceToHost, stream));
+    HIPCHECK (hipStreamSynchronize(stream));
+    checkArray(A_h, 2*count);
+
+    // A batch issued while capturing becomes part of the graph.  The NULL stream can not be captured.
+    if (stream) {
+        hipGraph_t graph;
+        hipGraphExec_t graphExec;
+        HIPCHECK (hipStreamBeginCapture(stream));
+        HIPCHECK (hipLaunchKernelBatch(stream, launches.data(), count));
+        HIPCHECK (hipStreamEndCapture(stream, &graph));
+        HIPCHECK (hipGraphInstantiate(&graphExec, graph));
+        HIPCHECK (hipGraphLaunch(graphExec, stream));
+        HIPCHECK (hipMemcpyAsync(A_h, A_d, Nbytes, hipMemcpyDeviceToHost, stream));
+        HIPCHECK (hipStreamSynchronize(stream));
+        checkArray(A_h, 3*count);
+
+        HIPCHECK (hipGraphExecDestroy(graphExec));
+        HIPCHECK (hipGraphDestroy(graph));
+    }
+
+    HIPCHECK (hipFree(A_d));
+    HIPCHECK (hipHostFree(A_h));
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    hipStream_t stream;
+    HIPCHECK (hipStreamCreate(&stream));
+
+    HIPASSERT(hipLaunchKernelBatch(stream, NULL, 1) == hipErrorInvalidValue);
+
+    testBatch(stream, iterations);
+    testBatch(0, iterations);
+
+    HIPCHECK (hipStreamDestroy(stream));
+
+    passed();
+}
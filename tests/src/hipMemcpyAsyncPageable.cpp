@@ -0,0 +1,137 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Test hipMemcpyAsync with unpinned (pageable) host memory.
+// These copies are staged through pinned buffers on a runtime worker thread, so the API returns before
+// the copy completes.  Kernels, other copies and events in the stream must still be ordered after the copy.
+
+#include "hip_runtime.h"
+#include "test_common.h"
+
+
+// H2D staged copies -> kernel -> D2H staged copy, synchronize only at the end.
+void testStream(hipStream_t stream)
+{
+    size_t Nbytes = N*sizeof(float);
+
+    float *A_d, *B_d, *C_d;
+    float *A_h, *B_h, *C_h;
+    HipTest::initArrays (&A_d, &B_d, &C_d, &A_h, &B_h, &C_h, N, false/*usePinnedHost*/);
+
+    unsigned blocks = HipTest::setNumBlocks(blocksPerCU, threadsPerBlock, N);
+
+    HIPCHECK (hipMemcpyAsync(A_d, A_h, Nbytes, hipMemcpyHostToDevice, stream));
+    HIPCHECK (hipMemcpyAsync(B_d, B_h, Nbytes, hipMemcpyHostToDevice, stream));
+    hipLaunchKernel(HipTest::vectorADD, dim3(blocks), dim3(threadsPerBlock), 0, stream, A_d, B_d, C_d, N);
+    HIPCHECK (hipMemcpyAsync(C_h, C_d, Nbytes, hipMemcpyDeviceToHost, stream));
+    HIPCHECK (hipStreamSynchronize(stream));
+
+    HipTest::checkVectorADD(A_h, B_h, C_h, N);
+
+    HipTest::freeArrays (A_d, B_d, C_d, A_h, B_h, C_h, false);
+}
+
+
+// D2H staged copy followed by an event - synchronizing on the event must cover the copy.
+void testEvent(hipStream_t stream)
+{
+    size_t Nbytes = N*sizeof(float);
+
+    float *A_d, *B_d, *C_d;
+    float *A_h, *B_h, *C_h;
+    HipTest::initArrays (&A_d, &B_d, &C_d, &A_h, &B_h, &C_h, N, false/*usePinnedHost*/);
+
+    unsigned blocks = HipTest::setNumBlocks(blocksPerCU, threadsPerBlock, N);
+
+    hipEvent_t done;
+    HIPCHECK (hipEventCreate(&done));
+
+    HIPCHECK (hipMemcpy(A_d, A_h, Nbytes, hipMemcpyHostToDevice));
+    HIPCHECK (hipMemcpy(B_d, B_h, Nbytes, hipMemcpyHostToDevice));
+    hipLaunchKernel(HipTest::vectorADD, dim3(blocks), dim3(threadsPerBlock), 0, stream, A_d, B_d, C_d, N);
+    HIPCHECK (hipMemcpyAsync(C_h, C_d, Nbytes, hipMemcpyDeviceToHost, stream));
+    HIPCHECK (hipEventRecord(done, stream));
+    HIPCHECK (hipEventSynchronize(done));
+
+    HipTest::checkVectorADD(A_h, B_h, C_h, N);
+
+    HIPCHECK (hipEventDestroy(done));
+    HipTest::freeArrays (A_d, B_d, C_d, A_h, B_h, C_h, false);
+}
+
+
+// Staged async copies followed by synchronous staged copies (hipMemcpy, on the NULL stream) which depend on them.
+// With stream==NULL both run on the NULL stream, else the sync copies wait for the stream through the NULL stream.
+void testMixed(hipStream_t stream)
+{
+    size_t Nbytes = N*sizeof(float);
+
+    float *A_d, *B_d, *C_d;
+    float *A_h, *B_h, *C_h;
+    HipTest::initArrays (&A_d, &B_d, &C_d, &A_h, &B_h, &C_h, N, false/*usePinnedHost*/);
+    float *D_h = (float*)malloc(Nbytes);
+
+    unsigned blocks = HipTest::setNumBlocks(blocksPerCU, threadsPerBlock, N);
+
+    HIPCHECK (hipMemcpyAsync(A_d, A_h, Nbytes, hipMemcpyHostToDevice, stream));
+    HIPCHECK (hipMemcpy(B_d, B_h, Nbytes, hipMemcpyHostToDevice));
+    hipLaunchKernel(HipTest::vectorADD, dim3(blocks), dim3(threadsPerBlock), 0, stream, A_d, B_d, C_d, N);
+    HIPCHECK (hipMemcpyAsync(C_h, C_d, Nbytes, hipMemcpyDeviceToHost, stream));
+    HIPCHECK (hipMemcpy(D_h, C_d, Nbytes, hipMemcpyDeviceToHost));
+    HIPCHECK (hipDeviceSynchronize());
+
+    HipTest::checkVectorADD(A_h, B_h, C_h, N);
+    HipTest::checkVectorADD(A_h, B_h, D_h, N);
+
+    free(D_h);
+    HipTest::freeArrays (A_d, B_d, C_d, A_h, B_h, C_h, false);
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    hipStream_t stream;
+    HIPCHECK (hipStreamCreate(&stream));
+
+    for (int i=0; i<iterations; i++) {
+        if (p_tests & 0x1) {
+            printf ("test: stream ordering\n");
+            testStream(stream);
+        }
+        if (p_tests & 0x2) {
+            printf ("test: event\n");
+            testEvent(stream);
+        }
+        if (p_tests & 0x4) {
+            printf ("test: async then sync copies, stream\n");
+            testMixed(stream);
+            printf ("test: async then sync copies, NULL stream\n");
+            testMixed(0);
+        }
+    }
+
+    HIPCHECK (hipStreamDestroy(stream));
+
+    passed();
+}
@@ -0,0 +1,124 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Test hipMemcpy of unpinned host memory with HIP_PININPLACE=1, which pins the host range in-place
+// for the copy and copies it with one DMA.
+// The host buffers start and end in the middle of a page, the bytes around them must not be touched, and the
+// pages must be unpinned once the copy returns.  Host buffers are freed and reallocated every iteration, so
+// copies to a reused VA must see the new pages.
+
+#include <unistd.h>
+
+#include "hip_runtime.h"
+#include "test_common.h"
+
+
+size_t p_offset = 7;   // bytes from the start of the host allocation, not a multiple of any copy alignment.
+
+
+// Host buffer with guard bytes on both sides of the copied range.
+struct HostBuffer {
+    HostBuffer(size_t sizeBytes, char fill)
+    {
+        _pageSize = sysconf(_SC_PAGESIZE);
+        _allocBytes = (p_offset + sizeBytes + 2*_pageSize) & ~(_pageSize-1);
+        HIPASSERT (posix_memalign((void**)&_alloc, _pageSize, _allocBytes) == 0);
+        memset(_alloc, fill, _allocBytes);
+        _ptr = _alloc + p_offset;
+        _sizeBytes = sizeBytes;
+        _fill = fill;
+    }
+    ~HostBuffer() { free(_alloc); }
+
+    void checkGuards() const
+    {
+        for (size_t i=0; i<_allocBytes; i++) {
+            char *p = _alloc + i;
+            if (((p < _ptr) || (p >= _ptr + _sizeBytes)) && (*p != _fill)) {
+                failed("guard byte %zu of the host allocation was overwritten\n", i);
+            }
+        }
+    }
+
+    // hsa_amd_memory_lock pins a page only once, so registering the allocation fails if a copy left it pinned.
+    void checkUnpinned() const
+    {
+        HIPCHECK (hipHostRegister(_alloc, _allocBytes, 0));
+        HIPCHECK (hipHostUnregister(_alloc));
+    }
+
+    char   *_alloc;
+    size_t  _allocBytes;
+    size_t  _pageSize;
+    char   *_ptr;
+    size_t  _sizeBytes;
+    char    _fill;
+};
+
+
+// H2D then D2H through pin-in-place, with the seed giving each iteration different data.
+void testRoundTrip(size_t sizeBytes, int seed)
+{
+    HostBuffer src(sizeBytes, 0x5a);
+    HostBuffer dst(sizeBytes, 0x3c);
+    for (size_t i=0; i<sizeBytes; i++) {
+        src._ptr[i] = (char)(i*7 + seed);
+    }
+
+    char *A_d;
+    HIPCHECK (hipMalloc(&A_d, sizeBytes));
+
+    HIPCHECK (hipMemcpy(A_d, src._ptr, sizeBytes, hipMemcpyHostToDevice));
+    src.checkUnpinned();
+
+    HIPCHECK (hipMemcpy(dst._ptr, A_d, sizeBytes, hipMemcpyDeviceToHost));
+    dst.checkUnpinned();
+
+    for (size_t i=0; i<sizeBytes; i++) {
+        if (dst._ptr[i] != src._ptr[i]) {
+            failed("dst[%zu] = %d, expected %d\n", i, dst._ptr[i], src._ptr[i]);
+        }
+    }
+    src.checkGuards();
+    dst.checkGuards();
+
+    HIPCHECK (hipFree(A_d));
+}
+
+
+int main(int argc, char *argv[])
+{
+    // Read when the runtime initializes, so must be set before the first HIP call.  An explicit setting wins.
+    setenv("HIP_PININPLACE", "1", 0);
+
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    // Odd length, so the copy also ends in the middle of a page:
+    size_t sizeBytes = N*sizeof(float) + 5;
+
+    for (int i=0; i<iterations; i++) {
+        printf ("test: pin-in-place round trip, %zu bytes at offset %zu\n", sizeBytes, p_offset);
+        testRoundTrip(sizeBytes, i);
+    }
+
+    passed();
+}
@@ -0,0 +1,101 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Test the legacy NULL stream ordering with blocking streams.
+// Work in a blocking stream must complete before subsequent NULL stream commands start, and NULL stream
+// commands must complete before later commands in a blocking stream start.
+// No explicit synchronization is used between the producer and the consumer.
+
+#include "hip_runtime.h"
+#include "test_common.h"
+
+
+// Blocking stream -> NULL stream
+void testStreamToNull(hipStream_t stream)
+{
+    size_t Nbytes = N*sizeof(float);
+
+    float *A_d, *B_d, *C_d;
+    float *A_h, *B_h, *C_h;
+    HipTest::initArrays (&A_d, &B_d, &C_d, &A_h, &B_h, &C_h, N, true);
+
+    unsigned blocks = HipTest::setNumBlocks(blocksPerCU, threadsPerBlock, N);
+
+    HIPCHECK (hipMemcpyAsync(A_d, A_h, Nbytes, hipMemcpyHostToDevice, stream));
+    HIPCHECK (hipMemcpyAsync(B_d, B_h, Nbytes, hipMemcpyHostToDevice, stream));
+    hipLaunchKernel(HipTest::vectorADD, dim3(blocks), dim3(threadsPerBlock), 0, stream, A_d, B_d, C_d, N);
+
+    HIPCHECK (hipMemcpyAsync(C_h, C_d, Nbytes, hipMemcpyDeviceToHost, NULL));
+    HIPCHECK (hipStreamSynchronize(NULL));
+
+    HipTest::checkVectorADD(A_h, B_h, C_h, N);
+
+    HipTest::freeArrays (A_d, B_d, C_d, A_h, B_h, C_h, true);
+}
+
+
+// NULL stream -> blocking stream
+void testNullToStream(hipStream_t stream)
+{
+    size_t Nbytes = N*sizeof(float);
+
+    float *A_d, *B_d, *C_d;
+    float *A_h, *B_h, *C_h;
+    HipTest::initArrays (&A_d, &B_d, &C_d, &A_h, &B_h, &C_h, N, true);
+
+    unsigned blocks = HipTest::setNumBlocks(blocksPerCU, threadsPerBlock, N);
+
+    HIPCHECK (hipMemcpyAsync(A_d, A_h, Nbytes, hipMemcpyHostToDevice, NULL));
+    HIPCHECK (hipMemcpyAsync(B_d, B_h, Nbytes, hipMemcpyHostToDevice, NULL));
+    hipLaunchKernel(HipTest::vectorADD, dim3(blocks), dim3(threadsPerBlock), 0, 0, A_d, B_d, C_d, N);
+
+    HIPCHECK (hipMemcpyAsync(C_h, C_d, Nbytes, hipMemcpyDeviceToHost, stream));
+    HIPCHECK (hipStreamSynchronize(stream));
+
+    HipTest::checkVectorADD(A_h, B_h, C_h, N);
+
+    HipTest::freeArrays (A_d, B_d, C_d, A_h, B_h, C_h, true);
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    hipStream_t stream;
+    HIPCHECK (hipStreamCreate(&stream));
+
+    for (int i=0; i<iterations; i++) {
+        if (p_tests & 0x1) {
+            printf ("test: stream to NULL stream\n");
+            testStreamToNull(stream);
+        }
+        if (p_tests & 0x2) {
+            printf ("test: NULL stream to stream\n");
+            testNullToStream(stream);
+        }
+    }
+
+    HIPCHECK (hipStreamDestroy(stream));
+
+    passed();
+}
@@ -0,0 +1,95 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Benchmark for event timing of async copies.
+// Times hipMemcpyAsync between pinned host memory and the device with events recorded around the copy, and
+// compares against the host wall time of record + copy + synchronize.  The stop event takes the copy's end time
+// on the DMA engine, so the event time can not exceed the host time and gives the transfer bandwidth.
+
+#include <chrono>
+#include "hip_runtime.h"
+#include "test_common.h"
+
+
+void timeCopy(hipStream_t stream, bool hostToDevice, size_t sizeBytes, int count)
+{
+    char *A_h, *A_d;
+    HIPCHECK (hipHostMalloc((void**)&A_h, sizeBytes, hipHostMallocDefault));
+    HIPCHECK (hipMalloc(&A_d, sizeBytes));
+    memset(A_h, 0x1, sizeBytes);
+
+    hipEvent_t start, stop;
+    HIPCHECK (hipEventCreate(&start));
+    HIPCHECK (hipEventCreate(&stop));
+
+    double eventMs = 0;
+    double hostMs = 0;
+    for (int i=0; i<count; i++) {
+        auto hostStart = std::chrono::high_resolution_clock::now();
+        HIPCHECK (hipEventRecord(start, stream));
+        if (hostToDevice) {
+            HIPCHECK (hipMemcpyAsync(A_d, A_h, sizeBytes, hipMemcpyHostToDevice, stream));
+        } else {
+            HIPCHECK (hipMemcpyAsync(A_h, A_d, sizeBytes, hipMemcpyDeviceToHost, stream));
+        }
+        HIPCHECK (hipEventRecord(stop, stream));
+        HIPCHECK (hipEventSynchronize(stop));
+        auto hostStop = std::chrono::high_resolution_clock::now();
+
+        float ms;
+        HIPCHECK (hipEventElapsedTime(&ms, start, stop));
+        HIPASSERT (ms >= 0.0f);
+        eventMs += ms;
+        hostMs += std::chrono::duration<double, std::milli>(hostStop - hostStart).count();
+    }
+
+    printf ("  %s %10zu bytes: event %9.3f ms (%7.2f GB/s)   host %9.3f ms (%7.2f GB/s)\n",
+            hostToDevice ? "H2D" : "D2H", sizeBytes,
+            eventMs/count, (double)sizeBytes*count / (eventMs/1000.0) / 1e9,
+            hostMs/count,  (double)sizeBytes*count / (hostMs/1000.0) / 1e9);
+
+    // GPU time inside the host window, allow a little slop for timestamp conversion:
+    HIPASSERT (eventMs <= hostMs * 1.05 + 0.01*count);
+
+    HIPCHECK (hipEventDestroy(start));
+    HIPCHECK (hipEventDestroy(stop));
+    HIPCHECK (hipFree(A_d));
+    HIPCHECK (hipHostFree(A_h));
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    hipStream_t stream;
+    HIPCHECK (hipStreamCreate(&stream));
+
+    for (size_t sizeBytes=4096; sizeBytes<=64*1024*1024; sizeBytes*=4) {
+        timeCopy(stream, true, sizeBytes, 10 * iterations);
+        timeCopy(stream, false, sizeBytes, 10 * iterations);
+    }
+
+    HIPCHECK (hipStreamDestroy(stream));
+
+    passed();
+}
@@ -0,0 +1,115 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Compare per-request temporary allocations with hipMalloc/hipFree against the stream-ordered pool
+// (hipMallocAsync/hipFreeAsync).  Each iteration allocates a temporary, fills it on the stream,
+// copies a result back and frees the temporary - the pattern of a service handling one request.
+
+#include <chrono>
+#include "hip_runtime.h"
+#include "test_common.h"
+
+static const size_t sizes[] = {4*1024, 100*1024, 1024*1024, 3*1024*1024 + 17};
+static const int numSizes = sizeof(sizes)/sizeof(sizes[0]);
+
+
+void runRequest(bool usePool, hipStream_t stream, char *result_h, int i)
+{
+    size_t sizeBytes = sizes[i % numSizes];
+    char *temp_d;
+
+    if (usePool) {
+        HIPCHECK (hipMallocAsync((void**)&temp_d, sizeBytes, stream));
+    } else {
+        HIPCHECK (hipMalloc(&temp_d, sizeBytes));
+    }
+
+    HIPCHECK (hipMemsetAsync(temp_d, i & 0xff, sizeBytes, stream));
+    HIPCHECK (hipMemcpyAsync(result_h, temp_d + sizeBytes - 1, 1, hipMemcpyDeviceToHost, stream));
+
+    if (usePool) {
+        HIPCHECK (hipFreeAsync(temp_d, stream));
+    } else {
+        HIPCHECK (hipFree(temp_d));
+    }
+}
+
+
+double runBenchmark(bool usePool, hipStream_t *streams, int numStreams, int requests)
+{
+    char *result_h;
+    HIPCHECK (hipHostMalloc((void**)&result_h, numStreams, hipHostMallocDefault));
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<requests; i++) {
+        int s = i % numStreams;
+        runRequest(usePool, streams[s], &result_h[s], i);
+    }
+    HIPCHECK (hipDeviceSynchronize());
+    auto stop = std::chrono::high_resolution_clock::now();
+
+    // The last request on each stream determines the result:
+    for (int s=0; s<numStreams; s++) {
+        int lastI = requests - numStreams + s;
+        HIPASSERT (result_h[s] == (char)(lastI & 0xff));
+    }
+
+    HIPCHECK (hipHostFree(result_h));
+
+    return std::chrono::duration<double, std::micro>(stop - start).count() / requests;
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    const int numStreams = 2;
+    const int requests = 1000 * iterations;
+
+    hipStream_t streams[numStreams];
+    for (int s=0; s<numStreams; s++) {
+        HIPCHECK (hipStreamCreate(&streams[s]));
+    }
+
+    double mallocUs = runBenchmark(false, streams, numStreams, requests);
+    double poolUs   = runBenchmark(true,  streams, numStreams, requests);
+
+    size_t reserved, used, reservedHighWater, usedHighWater;
+    HIPCHECK (hipDeviceMemPoolGetUsage(&reserved, &used, &reservedHighWater, &usedHighWater));
+
+    printf ("hipMalloc/hipFree           : %8.2f us/request\n", mallocUs);
+    printf ("hipMallocAsync/hipFreeAsync : %8.2f us/request\n", poolUs);
+    printf ("pool: reserved=%zu used=%zu reservedHighWater=%zu usedHighWater=%zu\n",
+            reserved, used, reservedHighWater, usedHighWater);
+    HIPASSERT (used == 0);
+
+    HIPCHECK (hipDeviceMemPoolTrimTo(0));
+    HIPCHECK (hipDeviceMemPoolGetUsage(&reserved, NULL, NULL, NULL));
+    HIPASSERT (reserved == 0);
+
+    for (int s=0; s<numStreams; s++) {
+        HIPCHECK (hipStreamDestroy(streams[s]));
+    }
+
+    passed();
+}
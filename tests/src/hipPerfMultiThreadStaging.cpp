@@ -0,0 +1,114 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANNTY OF ANY KIND, EXPRESS OR
+IMPLIED, INNCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANNY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER INN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR INN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Scaling of pageable (unpinned) copies with thread count.  Based on hipMultiThreadStreams2: each thread
+// runs H2D copy -> kernel -> D2H copy on its own stream, from malloc'd host memory, so each copy goes through
+// the staging buffers.  With per-stream staging resources the aggregate bandwidth should grow with the
+// thread count instead of staying flat.
+
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include "test_common.h"
+
+template<typename T>
+__global__ void Inc(hipLaunchParm lp, T *Array){
+int tx = hipThreadIdx_x + hipBlockIdx_x * hipBlockDim_x;
+Array[tx] = Array[tx] + T(1);
+}
+
+static const size_t numElements = 1024*1024;  // 4MB per copy
+static const int blockSize = 256;
+
+
+void runThread(hipStream_t stream, int loops)
+{
+    size_t size = numElements * sizeof(float);
+
+    float *A_h = (float*)malloc(size);
+    float *B_h = (float*)malloc(size);
+    float *C_d;
+    HIPCHECK(hipMalloc(&C_d, size));
+
+    for (size_t i=0; i<numElements; i++) {
+        A_h[i] = (float)i;
+    }
+
+    for (int l=0; l<loops; l++) {
+        HIPCHECK(hipMemcpyAsync(C_d, A_h, size, hipMemcpyHostToDevice, stream));
+        hipLaunchKernel(HIP_KERNEL_NAME(Inc), dim3(numElements/blockSize), dim3(blockSize), 0, stream, C_d);
+        HIPCHECK(hipMemcpyAsync(B_h, C_d, size, hipMemcpyDeviceToHost, stream));
+        HIPCHECK(hipStreamSynchronize(stream));
+    }
+
+    for (size_t i=0; i<numElements; i+=numElements/16) {
+        HIPASSERT(B_h[i] == A_h[i] + 1.0f);
+    }
+
+    HIPCHECK(hipFree(C_d));
+    free(A_h);
+    free(B_h);
+}
+
+
+// Returns aggregate copy bandwidth in GB/s.
+double runThreads(int numThreads, int loops)
+{
+    std::vector<hipStream_t> streams(numThreads);
+    for (int t=0; t<numThreads; t++) {
+        HIPCHECK(hipStreamCreate(&streams[t]));
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> threads;
+    for (int t=0; t<numThreads; t++) {
+        threads.push_back(std::thread(runThread, streams[t], loops));
+    }
+    for (int t=0; t<numThreads; t++) {
+        threads[t].join();
+    }
+    auto stop = std::chrono::high_resolution_clock::now();
+
+    for (int t=0; t<numThreads; t++) {
+        HIPCHECK(hipStreamDestroy(streams[t]));
+    }
+
+    double us = std::chrono::duration<double, std::micro>(stop - start).count();
+    double bytes = 2.0 * numElements * sizeof(float) * loops * numThreads;
+    return bytes / (us * 1000.0);
+}
+
+
+int main(int argc, char **argv){
+	HipTest::parseStandardArguments(argc, argv, true);
+
+	const int loops = 10 * iterations;
+
+	double baseGBs = 0.0;
+	for (int numThreads=1; numThreads<=8; numThreads*=2) {
+		double GBs = runThreads(numThreads, loops);
+		if (numThreads == 1) {
+			baseGBs = GBs;
+		}
+		printf ("threads=%d  pageable H2D+D2H: %8.2f GB/s  (%.2fx)\n", numThreads, GBs, GBs/baseGBs);
+	}
+
+	passed();
+}
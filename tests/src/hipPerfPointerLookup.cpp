@@ -0,0 +1,140 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Measure hipPointerGetAttributes lookups per second with many live allocations - the same pointer
+// classification every hipMemcpy does on its src and dst.  Lookups walk the allocations in a scattered order
+// so each one needs a search, then repeat one pointer, which is the common case for copies between the
+// same buffers.  Also times free + alloc pairs with the allocations live, since each one updates the index.
+
+#include <chrono>
+#include <vector>
+#include "hip_runtime.h"
+#include "test_common.h"
+
+static const int numAllocs = 10000;
+static const size_t allocSize = 4096;
+
+
+struct Alloc {
+    char *_ptr;
+    bool  _isHost;
+};
+
+
+double lookupsPerSec(const std::vector<Alloc> &allocs, int lookups, bool scatter)
+{
+    hipPointerAttribute_t attr;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<lookups; i++) {
+        // 7919 is prime, so the stride visits every allocation:
+        const Alloc &a = allocs[scatter ? (size_t(i) * 7919) % allocs.size() : 0];
+        char *p = a._ptr + (i % allocSize);
+
+        HIPCHECK (hipPointerGetAttributes(&attr, p));
+        HIPASSERT (attr.memoryType == (a._isHost ? hipMemoryTypeHost : hipMemoryTypeDevice));
+        HIPASSERT (a._isHost ? (attr.hostPointer == p) : (attr.devicePointer == p));
+    }
+    auto stop = std::chrono::high_resolution_clock::now();
+
+    return lookups / std::chrono::duration<double>(stop - start).count();
+}
+
+
+// Returns average us for one free + alloc pair.  Replaces allocations in place, so the live count stays the same.
+double freeAllocUs(std::vector<Alloc> &allocs, int pairs)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<pairs; i++) {
+        Alloc &a = allocs[(size_t(i) * 7919) % allocs.size()];
+        if (a._isHost) {
+            HIPCHECK (hipHostFree(a._ptr));
+            HIPCHECK (hipHostMalloc((void**)&a._ptr, allocSize, hipHostMallocDefault));
+        } else {
+            HIPCHECK (hipFree(a._ptr));
+            HIPCHECK (hipMalloc(&a._ptr, allocSize));
+        }
+    }
+    auto stop = std::chrono::high_resolution_clock::now();
+
+    return std::chrono::duration<double, std::micro>(stop - start).count() / pairs;
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    const int lookups = 100000 * iterations;
+
+    // Mix of device and pinned host allocations, every fourth one is host:
+    std::vector<Alloc> allocs(numAllocs);
+    for (int i=0; i<numAllocs; i++) {
+        allocs[i]._isHost = (i % 4 == 3);
+        if (allocs[i]._isHost) {
+            HIPCHECK (hipHostMalloc((void**)&allocs[i]._ptr, allocSize, hipHostMallocDefault));
+        } else {
+            HIPCHECK (hipMalloc(&allocs[i]._ptr, allocSize));
+        }
+    }
+
+    double scattered = lookupsPerSec(allocs, lookups, true);
+    double repeated  = lookupsPerSec(allocs, lookups, false);
+
+    printf ("%d live allocations:\n", numAllocs);
+    printf ("  scattered pointers : %12.0f lookups/s\n", scattered);
+    printf ("  repeated pointer   : %12.0f lookups/s\n", repeated);
+
+    double pairUs = freeAllocUs(allocs, 1000 * iterations);
+    printf ("  free + alloc       : %12.2f us\n", pairUs);
+
+    // Replaced allocations must still be found:
+    scattered = lookupsPerSec(allocs, lookups, true);
+    printf ("  scattered pointers : %12.0f lookups/s (after free + alloc)\n", scattered);
+
+    // Free half - removes entries from the index - and check the survivors are still found:
+    std::vector<Alloc> survivors;
+    for (int i=0; i<numAllocs; i++) {
+        if (i % 2) {
+            survivors.push_back(allocs[i]);
+        } else if (allocs[i]._isHost) {
+            HIPCHECK (hipHostFree(allocs[i]._ptr));
+        } else {
+            HIPCHECK (hipFree(allocs[i]._ptr));
+        }
+    }
+    HIPCHECK (hipDeviceSynchronize());
+
+    scattered = lookupsPerSec(survivors, lookups, true);
+    printf ("%zu live allocations after free:\n", survivors.size());
+    printf ("  scattered pointers : %12.0f lookups/s\n", scattered);
+
+    for (size_t i=0; i<survivors.size(); i++) {
+        if (survivors[i]._isHost) {
+            HIPCHECK (hipHostFree(survivors[i]._ptr));
+        } else {
+            HIPCHECK (hipFree(survivors[i]._ptr));
+        }
+    }
+
+    passed();
+}
@@ -0,0 +1,117 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Benchmark for stream creation with the device queue pool (HIP_STREAM_QUEUES).
+// Measures hipStreamCreate/hipStreamDestroy throughput, then creates many streams at once and measures the
+// dispatch rate of small kernels spread round-robin across all of them.
+
+#include <chrono>
+#include <vector>
+#include "hip_runtime.h"
+#include "test_common.h"
+
+
+__global__ void
+addOne(hipLaunchParm lp, int *A)
+{
+    if ((hipBlockIdx_x == 0) && (hipThreadIdx_x == 0)) {
+        A[0] += 1;
+    }
+}
+
+
+void createDestroy(int count)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<count; i++) {
+        hipStream_t stream;
+        HIPCHECK (hipStreamCreate(&stream));
+        HIPCHECK (hipStreamDestroy(stream));
+    }
+    auto stop = std::chrono::high_resolution_clock::now();
+
+    double us = std::chrono::duration<double, std::micro>(stop - start).count();
+    printf ("  create+destroy x%d  %8.2f us/stream  %10.0f streams/sec\n", count, us/count, count / (us / 1000000.0));
+}
+
+
+void manyStreams(int streamCnt, int rounds)
+{
+    std::vector<int*> counters(streamCnt);
+    std::vector<hipStream_t> streams(streamCnt);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<streamCnt; i++) {
+        HIPCHECK (hipStreamCreate(&streams[i]));
+    }
+    auto created = std::chrono::high_resolution_clock::now();
+
+    for (int i=0; i<streamCnt; i++) {
+        HIPCHECK (hipMalloc(&counters[i], sizeof(int)));
+        HIPCHECK (hipMemset(counters[i], 0, sizeof(int)));
+    }
+
+    auto dispatchStart = std::chrono::high_resolution_clock::now();
+    for (int r=0; r<rounds; r++) {
+        for (int i=0; i<streamCnt; i++) {
+            hipLaunchKernel(addOne, dim3(1), dim3(64), 0, streams[i], counters[i]);
+        }
+    }
+    HIPCHECK (hipDeviceSynchronize());
+    auto dispatchStop = std::chrono::high_resolution_clock::now();
+
+    for (int i=0; i<streamCnt; i++) {
+        int count = 0;
+        HIPCHECK (hipMemcpy(&count, counters[i], sizeof(int), hipMemcpyDeviceToHost));
+        HIPASSERT (count == rounds);
+        HIPCHECK (hipFree(counters[i]));
+    }
+
+    auto destroyStart = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<streamCnt; i++) {
+        HIPCHECK (hipStreamDestroy(streams[i]));
+    }
+    auto destroyStop = std::chrono::high_resolution_clock::now();
+
+    double createUs   = std::chrono::duration<double, std::micro>(created - start).count();
+    double dispatchUs = std::chrono::duration<double, std::micro>(dispatchStop - dispatchStart).count();
+    double destroyUs  = std::chrono::duration<double, std::micro>(destroyStop - destroyStart).count();
+    printf ("  %d streams: create %8.2f us/stream, destroy %8.2f us/stream, dispatch+sync %8.2f us/kernel (%d kernels)\n",
+            streamCnt, createUs/streamCnt, destroyUs/streamCnt, dispatchUs/(streamCnt*rounds), streamCnt*rounds);
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    printf ("HIP_STREAM_QUEUES=%s\n", getenv("HIP_STREAM_QUEUES") ? getenv("HIP_STREAM_QUEUES") : "default");
+
+    createDestroy(1000 * iterations);
+
+    const int streamCnts[] = {1, 16, 1000};
+    for (int s=0; s<sizeof(streamCnts)/sizeof(streamCnts[0]); s++) {
+        manyStreams(streamCnts[s], 10 * iterations);
+    }
+
+    passed();
+}
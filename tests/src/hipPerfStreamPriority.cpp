@@ -0,0 +1,157 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Benchmark for stream priorities.
+// Background threads keep the device busy with large copies from unpinned host memory in low-priority streams,
+// while the main thread measures the latency of a small copy + kernel + synchronize in a probe stream.
+// Reports the latency distribution for a normal-priority and a high-priority probe stream.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "hip_runtime.h"
+#include "test_common.h"
+
+
+__global__ void
+addOne(hipLaunchParm lp, int *A)
+{
+    if ((hipBlockIdx_x == 0) && (hipThreadIdx_x == 0)) {
+        A[0] += 1;
+    }
+}
+
+
+std::atomic<bool> g_stop;
+
+
+void backgroundCopies(hipStream_t stream, size_t sizeBytes)
+{
+    char *A_h = (char*)malloc(sizeBytes);
+    char *A_d;
+    HIPCHECK (hipMalloc(&A_d, sizeBytes));
+    memset(A_h, 0x1, sizeBytes);
+
+    while (!g_stop) {
+        for (int i=0; i<4; i++) {
+            HIPCHECK (hipMemcpyAsync(A_d, A_h, sizeBytes, hipMemcpyHostToDevice, stream));
+        }
+        HIPCHECK (hipStreamSynchronize(stream));
+    }
+
+    HIPCHECK (hipFree(A_d));
+    free(A_h);
+}
+
+
+void probeLatency(int priority, int backgroundStreams, size_t backgroundBytes, int probes)
+{
+    int least, greatest;
+    HIPCHECK (hipDeviceGetStreamPriorityRange(&least, &greatest));
+
+    std::vector<hipStream_t> bgStreams(backgroundStreams);
+    std::vector<std::thread> bgThreads;
+    g_stop = false;
+    for (int i=0; i<backgroundStreams; i++) {
+        HIPCHECK (hipStreamCreateWithPriority(&bgStreams[i], hipStreamNonBlocking, least));
+        bgThreads.push_back(std::thread(backgroundCopies, bgStreams[i], backgroundBytes));
+    }
+
+    hipStream_t probe;
+    HIPCHECK (hipStreamCreateWithPriority(&probe, hipStreamNonBlocking, priority));
+    int p;
+    HIPCHECK (hipStreamGetPriority(probe, &p));
+    HIPASSERT (p == priority);
+
+    const size_t probeBytes = 4096;
+    char *P_h = (char*)malloc(probeBytes);
+    char *P_d;
+    int *C_d;
+    HIPCHECK (hipMalloc(&P_d, probeBytes));
+    HIPCHECK (hipMalloc(&C_d, sizeof(int)));
+    HIPCHECK (hipMemset(C_d, 0, sizeof(int)));
+
+    // Let the background load ramp up:
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::vector<double> latencyUs(probes);
+    for (int i=0; i<probes; i++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        HIPCHECK (hipMemcpyAsync(P_d, P_h, probeBytes, hipMemcpyHostToDevice, probe));
+        hipLaunchKernel(addOne, dim3(1), dim3(64), 0, probe, C_d);
+        HIPCHECK (hipStreamSynchronize(probe));
+        auto stop = std::chrono::high_resolution_clock::now();
+        latencyUs[i] = std::chrono::duration<double, std::micro>(stop - start).count();
+    }
+
+    g_stop = true;
+    for (auto t=bgThreads.begin(); t!=bgThreads.end(); t++) {
+        t->join();
+    }
+
+    int count = 0;
+    HIPCHECK (hipMemcpy(&count, C_d, sizeof(int), hipMemcpyDeviceToHost));
+    HIPASSERT (count == probes);
+
+    std::sort(latencyUs.begin(), latencyUs.end());
+    printf ("  probe priority %2d vs %d background streams: p50 %9.1f us  p99 %9.1f us  max %9.1f us\n",
+            priority, backgroundStreams, latencyUs[probes/2], latencyUs[(probes*99)/100], latencyUs[probes-1]);
+
+    HIPCHECK (hipFree(P_d));
+    HIPCHECK (hipFree(C_d));
+    free(P_h);
+    HIPCHECK (hipStreamDestroy(probe));
+    for (int i=0; i<backgroundStreams; i++) {
+        HIPCHECK (hipStreamDestroy(bgStreams[i]));
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    int least, greatest;
+    HIPCHECK (hipDeviceGetStreamPriorityRange(&least, &greatest));
+    printf ("stream priority range: least=%d greatest=%d\n", least, greatest);
+    HIPASSERT (greatest <= hipStreamPriorityNormal);
+    HIPASSERT (least >= hipStreamPriorityNormal);
+
+    // Out-of-range priorities are clamped:
+    hipStream_t s;
+    int p;
+    HIPCHECK (hipStreamCreateWithPriority(&s, hipStreamDefault, greatest - 10));
+    HIPCHECK (hipStreamGetPriority(s, &p));
+    HIPASSERT (p == greatest);
+    HIPCHECK (hipStreamDestroy(s));
+
+    const int probes = 200 * iterations;
+    const size_t backgroundBytes = 64*1024*1024;
+    for (int bg=1; bg<=4; bg*=2) {
+        probeLatency(hipStreamPriorityNormal, bg, backgroundBytes, probes);
+        probeLatency(greatest, bg, backgroundBytes, probes);
+    }
+
+    passed();
+}
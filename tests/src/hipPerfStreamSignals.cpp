@@ -0,0 +1,85 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Microbenchmark for the stream signal pool.
+// Each async copy allocates a completion signal from the stream, so issuing many tiny copies
+// measures signal allocation + reclaim throughput.  The window controls how many copies are
+// in-flight before the host synchronizes with the stream.
+
+#include <chrono>
+#include "hip_runtime.h"
+#include "test_common.h"
+
+
+void runWindow(hipStream_t stream, int *dst_d, const int *src_d, int window, int copies)
+{
+    // Warm up - fill the stream signal cache:
+    for (int i=0; i<window; i++) {
+        HIPCHECK (hipMemcpyAsync(dst_d, src_d, sizeof(int), hipMemcpyDeviceToDevice, stream));
+    }
+    HIPCHECK (hipStreamSynchronize(stream));
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<copies; i++) {
+        HIPCHECK (hipMemcpyAsync(dst_d, src_d, sizeof(int), hipMemcpyDeviceToDevice, stream));
+        if ((i % window) == (window - 1)) {
+            HIPCHECK (hipStreamSynchronize(stream));
+        }
+    }
+    HIPCHECK (hipStreamSynchronize(stream));
+    auto stop = std::chrono::high_resolution_clock::now();
+
+    double us = std::chrono::duration<double, std::micro>(stop - start).count();
+    printf ("  in-flight=%3d copies=%d  %8.2f us/copy  %10.0f signal allocs/sec\n",
+            window, copies, us/copies, copies / (us / 1000000.0));
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    const int copies = 10000 * iterations;
+    const int windows[] = {1, 8, 64};
+
+    int *src_d, *dst_d;
+    int src_h = 0x1234, dst_h = 0;
+    HIPCHECK (hipMalloc(&src_d, sizeof(int)));
+    HIPCHECK (hipMalloc(&dst_d, sizeof(int)));
+    HIPCHECK (hipMemcpy(src_d, &src_h, sizeof(int), hipMemcpyHostToDevice));
+
+    hipStream_t stream;
+    HIPCHECK (hipStreamCreate(&stream));
+
+    for (int w=0; w<sizeof(windows)/sizeof(windows[0]); w++) {
+        runWindow(stream, dst_d, src_d, windows[w], copies);
+    }
+
+    HIPCHECK (hipMemcpy(&dst_h, dst_d, sizeof(int), hipMemcpyDeviceToHost));
+    HIPASSERT (dst_h == src_h);
+
+    HIPCHECK (hipStreamDestroy(stream));
+    HIPCHECK (hipFree(src_d));
+    HIPCHECK (hipFree(dst_d));
+
+    passed();
+}
@@ -0,0 +1,140 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Benchmark for the host wait modes selected with hipSetDeviceFlags.
+// For each mode, a kernel that runs for a fixed number of GPU cycles is launched and waited for, and the CPU time
+// the waiting thread consumed is compared to the wall time of the wait.  Wake-up latency is the extra wall time
+// over the spin mode, plus the round trip of a zero-cycle kernel.
+
+#include <time.h>
+#include <chrono>
+#include "hip_runtime.h"
+#include "test_common.h"
+
+
+__global__ void
+spinKernel(hipLaunchParm lp, long long cycles)
+{
+    long long start = clock64();
+    while ((clock64() - start) < cycles) {
+    }
+}
+
+
+struct WaitTimes {
+    double _wallUs;     // per wait
+    double _cpuUs;      // per wait, CPU time of the waiting thread
+};
+
+
+static double threadCpuUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+
+// Launch+wait for count kernels, with the wait done by hipStreamSynchronize or by an event.
+WaitTimes timeWaits(hipStream_t stream, long long cycles, int count, hipEvent_t *event)
+{
+    double cpuUs = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<count; i++) {
+        hipLaunchKernel(spinKernel, dim3(1), dim3(1), 0, stream, cycles);
+
+        double cpuStart = threadCpuUs();
+        if (event) {
+            HIPCHECK (hipEventRecord(*event, stream));
+            HIPCHECK (hipEventSynchronize(*event));
+        } else {
+            HIPCHECK (hipStreamSynchronize(stream));
+        }
+        cpuUs += threadCpuUs() - cpuStart;
+    }
+    auto stop = std::chrono::high_resolution_clock::now();
+
+    WaitTimes t;
+    t._wallUs = std::chrono::duration<double, std::micro>(stop - start).count() / count;
+    t._cpuUs  = cpuUs / count;
+    return t;
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    struct Mode {
+        const char *_name;
+        unsigned    _flags;
+    } modes[] = {
+        {"spin",    hipDeviceScheduleSpin},
+        {"yield",   hipDeviceScheduleYield},
+        {"blocking",hipDeviceScheduleBlockingSync},
+        {"auto",    hipDeviceScheduleAuto},
+    };
+
+    const long long cycles[] = {10000, 1000000, 10000000};  // ~us to ~ms at typical GPU clocks.
+    const int count = 20 * iterations;
+
+    hipStream_t stream;
+    HIPCHECK (hipStreamCreate(&stream));
+
+    // Warm up:
+    timeWaits(stream, 0, count, NULL);
+
+    for (int c=0; c<sizeof(cycles)/sizeof(cycles[0]); c++) {
+        printf ("kernel cycles=%lld\n", cycles[c]);
+        double spinWallUs = 0;
+        for (int m=0; m<sizeof(modes)/sizeof(modes[0]); m++) {
+            HIPCHECK (hipSetDeviceFlags(modes[m]._flags));
+            WaitTimes t = timeWaits(stream, cycles[c], count, NULL);
+            if (m == 0) {
+                spinWallUs = t._wallUs;
+            }
+            printf ("  %-10s wall=%10.2f us  cpu=%10.2f us (%5.1f%%)  latency vs spin=%+8.2f us\n",
+                    modes[m]._name, t._wallUs, t._cpuUs, 100.0 * t._cpuUs / t._wallUs, t._wallUs - spinWallUs);
+        }
+
+        // Per-event blocking, with the device left on spin:
+        HIPCHECK (hipSetDeviceFlags(hipDeviceScheduleSpin));
+        hipEvent_t event;
+        HIPCHECK (hipEventCreateWithFlags(&event, hipEventBlockingSync));
+        WaitTimes t = timeWaits(stream, cycles[c], count, &event);
+        printf ("  %-10s wall=%10.2f us  cpu=%10.2f us (%5.1f%%)  latency vs spin=%+8.2f us\n",
+                "event-blk", t._wallUs, t._cpuUs, 100.0 * t._cpuUs / t._wallUs, t._wallUs - spinWallUs);
+        HIPCHECK (hipEventDestroy(event));
+    }
+
+    printf ("zero-cycle kernel round trip:\n");
+    for (int m=0; m<sizeof(modes)/sizeof(modes[0]); m++) {
+        HIPCHECK (hipSetDeviceFlags(modes[m]._flags));
+        WaitTimes t = timeWaits(stream, 0, count, NULL);
+        printf ("  %-10s wall=%10.2f us  cpu=%10.2f us\n", modes[m]._name, t._wallUs, t._cpuUs);
+    }
+
+    HIPCHECK (hipSetDeviceFlags(hipDeviceScheduleAuto));
+    HIPCHECK (hipStreamDestroy(stream));
+
+    passed();
+}
@@ -0,0 +1,132 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Test hipStreamAddCallback.
+// A callback added after a device-to-host copy must see the copied data.  A blocking callback writes the host
+// buffer that a later host-to-device copy in the same stream reads, so the copy must wait for the callback.
+
+#include "hip_runtime.h"
+#include "test_common.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+
+struct CallbackData {
+    int                *_host;
+    int                 _expected;
+    int                 _next;       // written to _host by blocking callbacks.
+    std::atomic<int>    _calls;
+    std::atomic<int>    _errors;
+};
+
+
+void checkCallback(hipStream_t stream, hipError_t status, void *userData)
+{
+    CallbackData *data = static_cast<CallbackData*> (userData);
+
+    if ((status != hipSuccess) || (data->_host[0] != data->_expected) || (data->_host[N-1] != data->_expected)) {
+        data->_errors++;
+    }
+    data->_calls++;
+}
+
+
+void writeCallback(hipStream_t stream, hipError_t status, void *userData)
+{
+    CallbackData *data = static_cast<CallbackData*> (userData);
+
+    // Give the stream a chance to run ahead if it does not wait for the callback:
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    for (size_t i=0; i<N; i++) {
+        data->_host[i] = data->_next;
+    }
+    data->_calls++;
+}
+
+
+void testCallbacks(hipStream_t stream, int iterations)
+{
+    size_t Nbytes = N*sizeof(int);
+
+    int *A_d, *A_h, *B_h;
+    HIPCHECK (hipMalloc(&A_d, Nbytes));
+    HIPCHECK (hipHostMalloc((void**)&A_h, Nbytes));
+    HIPCHECK (hipHostMalloc((void**)&B_h, Nbytes));
+
+    CallbackData data;
+    data._calls = 0;
+    data._errors = 0;
+
+    // Non-blocking callbacks after a copy see the copied data:
+    data._host = B_h;
+    data._expected = 0x01010101;
+    HIPCHECK (hipMemsetAsync(A_d, 0x01, Nbytes, stream));
+    HIPCHECK (hipMemcpyAsync(B_h, A_d, Nbytes, hipMemcpyDeviceToHost, stream));
+    for (int i=0; i<iterations; i++) {
+        HIPCHECK (hipStreamAddCallback(stream, checkCallback, &data, hipStreamCallbackDefault));
+    }
+    HIPCHECK (hipStreamSynchronize(stream));
+    while (data._calls < iterations) {
+        std::this_thread::yield();
+    }
+    HIPASSERT(data._errors == 0);
+
+    // Blocking callbacks fill A_h, the following copy must pick up the callback's values:
+    data._host = A_h;
+    data._calls = 0;
+    for (int i=0; i<iterations; i++) {
+        data._next = i;   // the previous blocking callback has returned once hipStreamSynchronize returns.
+        HIPCHECK (hipStreamAddCallback(stream, writeCallback, &data, hipStreamCallbackBlocking));
+        HIPCHECK (hipMemcpyAsync(A_d, A_h, Nbytes, hipMemcpyHostToDevice, stream));
+        HIPCHECK (hipMemcpyAsync(B_h, A_d, Nbytes, hipMemcpyDeviceToHost, stream));
+        HIPCHECK (hipStreamSynchronize(stream));
+        HIPASSERT(data._calls == i+1);
+        for (size_t j=0; j<N; j++) {
+            HIPASSERT(B_h[j] == i);
+        }
+    }
+
+    HIPCHECK (hipFree(A_d));
+    HIPCHECK (hipHostFree(A_h));
+    HIPCHECK (hipHostFree(B_h));
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    HIPASSERT(hipStreamAddCallback(0, NULL, NULL, 0) == hipErrorInvalidValue);
+
+    hipStream_t stream;
+    HIPCHECK (hipStreamCreate(&stream));
+
+    testCallbacks(stream, iterations);
+    testCallbacks(0, iterations);
+
+    HIPCHECK (hipStreamDestroy(stream));
+
+    passed();
+}
@@ -0,0 +1,199 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Test streams created with hipStreamTrackHazards.
+// Independent async copies in these streams are not ordered with each other, so the test checks that copies
+// and kernels touching the same memory (RAW, WAR, WAW) still see each other's results, with and without
+// hipStreamAnnotateKernelRange.  It also times a burst of small independent copies against a default stream.
+
+#include <algorithm>
+#include <chrono>
+#include "hip_runtime.h"
+#include "test_common.h"
+
+#define CHUNKS 64
+
+
+// Many small H2D copies into separate chunks, each followed by a D2H of the same chunk (RAW).
+void testChunkedRoundTrip(hipStream_t stream)
+{
+    size_t Nbytes = N*sizeof(float);
+    size_t chunkElems = (N + CHUNKS - 1) / CHUNKS;
+
+    float *A_d, *A_h, *B_h;
+    HipTest::initArrays<float> (&A_d, NULL, NULL, &A_h, &B_h, NULL, N, true);
+    memset(B_h, 0, Nbytes);
+
+    for (size_t offset=0; offset<N; offset+=chunkElems) {
+        size_t bytes = std::min(chunkElems, N - offset) * sizeof(float);
+        HIPCHECK (hipMemcpyAsync(A_d + offset, A_h + offset, bytes, hipMemcpyHostToDevice, stream));
+        HIPCHECK (hipMemcpyAsync(B_h + offset, A_d + offset, bytes, hipMemcpyDeviceToHost, stream));
+    }
+    HIPCHECK (hipStreamSynchronize(stream));
+
+    for (size_t i=0; i<N; i++) {
+        HIPASSERT(B_h[i] == A_h[i]);
+    }
+
+    HipTest::freeArrays<float> (A_d, NULL, NULL, A_h, B_h, NULL, true);
+}
+
+
+// Read a device buffer back, then overwrite it (WAR) and read it again (RAW after WAW).
+void testOverwrite(hipStream_t stream)
+{
+    size_t Nbytes = N*sizeof(float);
+
+    float *A_d, *A_h, *B_h, *C_h;
+    HipTest::initArrays<float> (&A_d, NULL, NULL, &A_h, &B_h, &C_h, N, true);
+    float *D_h;
+    HIPCHECK (hipHostMalloc((void**)&D_h, Nbytes));
+    for (size_t i=0; i<N; i++) {
+        B_h[i] = -1.0f * i;
+    }
+
+    HIPCHECK (hipMemcpyAsync(A_d, A_h, Nbytes, hipMemcpyHostToDevice, stream));
+    HIPCHECK (hipMemcpyAsync(C_h, A_d, Nbytes, hipMemcpyDeviceToHost, stream));
+    HIPCHECK (hipMemcpyAsync(A_d, B_h, Nbytes, hipMemcpyHostToDevice, stream));
+    HIPCHECK (hipMemcpyAsync(D_h, A_d, Nbytes, hipMemcpyDeviceToHost, stream));
+
+    // Event recorded after tracked copies must cover all of them:
+    hipEvent_t done;
+    HIPCHECK (hipEventCreate(&done));
+    HIPCHECK (hipEventRecord(done, stream));
+    HIPCHECK (hipEventSynchronize(done));
+    HIPCHECK (hipEventDestroy(done));
+
+    for (size_t i=0; i<N; i++) {
+        HIPASSERT(C_h[i] == A_h[i]);
+        HIPASSERT(D_h[i] == B_h[i]);
+    }
+
+    HIPCHECK (hipHostFree(D_h));
+    HipTest::freeArrays<float> (A_d, NULL, NULL, A_h, B_h, C_h, true);
+}
+
+
+// Copies in, vectorADD, copy out.  With annotate=true the kernel declares its ranges, and an unrelated
+// copy is queued around it which the kernel does not need to wait for.
+void testKernel(hipStream_t stream, bool annotate)
+{
+    size_t Nbytes = N*sizeof(float);
+
+    float *A_d, *B_d, *C_d;
+    float *A_h, *B_h, *C_h;
+    HipTest::initArrays (&A_d, &B_d, &C_d, &A_h, &B_h, &C_h, N, true);
+
+    float *X_d, *X_h;
+    HIPCHECK (hipMalloc(&X_d, Nbytes));
+    HIPCHECK (hipHostMalloc((void**)&X_h, Nbytes));
+
+    unsigned blocks = HipTest::setNumBlocks(blocksPerCU, threadsPerBlock, N);
+
+    HIPCHECK (hipMemcpyAsync(A_d, A_h, Nbytes, hipMemcpyHostToDevice, stream));
+    HIPCHECK (hipMemcpyAsync(B_d, B_h, Nbytes, hipMemcpyHostToDevice, stream));
+    HIPCHECK (hipMemcpyAsync(X_d, A_h, Nbytes, hipMemcpyHostToDevice, stream));
+    if (annotate) {
+        HIPCHECK (hipStreamAnnotateKernelRange(stream, A_d, Nbytes, hipKernelRangeRead));
+        HIPCHECK (hipStreamAnnotateKernelRange(stream, B_d, Nbytes, hipKernelRangeRead));
+        HIPCHECK (hipStreamAnnotateKernelRange(stream, C_d, Nbytes, hipKernelRangeWrite));
+    }
+    hipLaunchKernel(HipTest::vectorADD, dim3(blocks), dim3(threadsPerBlock), 0, stream, A_d, B_d, C_d, N);
+    HIPCHECK (hipMemcpyAsync(X_h, X_d, Nbytes, hipMemcpyDeviceToHost, stream));
+    HIPCHECK (hipMemcpyAsync(C_h, C_d, Nbytes, hipMemcpyDeviceToHost, stream));
+    HIPCHECK (hipStreamSynchronize(stream));
+
+    HipTest::checkVectorADD(A_h, B_h, C_h, N);
+    for (size_t i=0; i<N; i++) {
+        HIPASSERT(X_h[i] == A_h[i]);
+    }
+
+    HIPCHECK (hipFree(X_d));
+    HIPCHECK (hipHostFree(X_h));
+    HipTest::freeArrays (A_d, B_d, C_d, A_h, B_h, C_h, true);
+}
+
+
+// Burst of small independent H2D copies, each to its own chunk.
+double timeIndependentCopies(hipStream_t stream)
+{
+    const size_t chunkBytes = 4096;
+    const int copies = 1024;
+
+    char *dst_d, *src_h;
+    HIPCHECK (hipMalloc(&dst_d, chunkBytes*copies));
+    HIPCHECK (hipHostMalloc((void**)&src_h, chunkBytes*copies));
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i=0; i<copies; i++) {
+        HIPCHECK (hipMemcpyAsync(dst_d + i*chunkBytes, src_h + i*chunkBytes, chunkBytes, hipMemcpyHostToDevice, stream));
+    }
+    HIPCHECK (hipStreamSynchronize(stream));
+    auto stop = std::chrono::high_resolution_clock::now();
+
+    HIPCHECK (hipFree(dst_d));
+    HIPCHECK (hipHostFree(src_h));
+
+    return std::chrono::duration<double, std::micro>(stop - start).count() / copies;
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    hipStream_t stream, defaultStream;
+    HIPCHECK (hipStreamCreateWithFlags(&stream, hipStreamTrackHazards));
+    HIPCHECK (hipStreamCreate(&defaultStream));
+
+    unsigned flags;
+    HIPCHECK (hipStreamGetFlags(stream, &flags));
+    HIPASSERT(flags & hipStreamTrackHazards);
+
+    for (int i=0; i<iterations; i++) {
+        if (p_tests & 0x1) {
+            printf ("test: chunked round trip\n");
+            testChunkedRoundTrip(stream);
+        }
+        if (p_tests & 0x2) {
+            printf ("test: overwrite\n");
+            testOverwrite(stream);
+        }
+        if (p_tests & 0x4) {
+            printf ("test: kernel\n");
+            testKernel(stream, false);
+            printf ("test: annotated kernel\n");
+            testKernel(stream, true);
+        }
+    }
+
+    if (p_tests & 0x8) {
+        printf ("independent 4KB copies: default stream %6.2f us/copy, hipStreamTrackHazards %6.2f us/copy\n",
+                timeIndependentCopies(defaultStream), timeIndependentCopies(stream));
+    }
+
+    HIPCHECK (hipStreamDestroy(stream));
+    HIPCHECK (hipStreamDestroy(defaultStream));
+
+    passed();
+}
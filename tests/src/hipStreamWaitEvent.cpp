@@ -0,0 +1,116 @@
+/*
+Copyright (c) 2015-2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Test hipStreamWaitEvent dependencies between streams.
+// The producer stream runs a kernel (or just an async copy) and records an event, the consumer
+// stream waits on the event and then reads the results.  The host never synchronizes with the producer.
+
+#include "hip_runtime.h"
+#include "test_common.h"
+
+
+// Producer writes with kernel, consumer copies result back.
+void testKernelEvent(hipStream_t producer, hipStream_t consumer)
+{
+    size_t Nbytes = N*sizeof(float);
+
+    float *A_d, *B_d, *C_d;
+    float *A_h, *B_h, *C_h;
+    HipTest::initArrays (&A_d, &B_d, &C_d, &A_h, &B_h, &C_h, N, true);
+
+    unsigned blocks = HipTest::setNumBlocks(blocksPerCU, threadsPerBlock, N);
+
+    hipEvent_t produced;
+    HIPCHECK (hipEventCreate(&produced));
+
+    HIPCHECK (hipMemcpyAsync(A_d, A_h, Nbytes, hipMemcpyHostToDevice, producer));
+    HIPCHECK (hipMemcpyAsync(B_d, B_h, Nbytes, hipMemcpyHostToDevice, producer));
+    hipLaunchKernel(HipTest::vectorADD, dim3(blocks), dim3(threadsPerBlock), 0, producer, A_d, B_d, C_d, N);
+    HIPCHECK (hipEventRecord(produced, producer));
+
+    HIPCHECK (hipStreamWaitEvent(consumer, produced, 0));
+    HIPCHECK (hipMemcpyAsync(C_h, C_d, Nbytes, hipMemcpyDeviceToHost, consumer));
+    HIPCHECK (hipStreamSynchronize(consumer));
+
+    HipTest::checkVectorADD(A_h, B_h, C_h, N);
+
+    HIPCHECK (hipStreamSynchronize(producer));
+    HIPCHECK (hipEventDestroy(produced));
+    HipTest::freeArrays (A_d, B_d, C_d, A_h, B_h, C_h, true);
+}
+
+
+// Producer only issues async copies, so the event state is carried by the copy signal.
+void testCopyEvent(hipStream_t producer, hipStream_t consumer)
+{
+    size_t Nbytes = N*sizeof(float);
+
+    float *A_d, *B_d, *C_d;
+    float *A_h, *B_h, *C_h;
+    HipTest::initArrays (&A_d, &B_d, &C_d, &A_h, &B_h, &C_h, N, true);
+
+    unsigned blocks = HipTest::setNumBlocks(blocksPerCU, threadsPerBlock, N);
+
+    hipEvent_t produced;
+    HIPCHECK (hipEventCreate(&produced));
+
+    HIPCHECK (hipMemcpyAsync(A_d, A_h, Nbytes, hipMemcpyHostToDevice, producer));
+    HIPCHECK (hipMemcpyAsync(B_d, B_h, Nbytes, hipMemcpyHostToDevice, producer));
+    HIPCHECK (hipEventRecord(produced, producer));
+
+    HIPCHECK (hipStreamWaitEvent(consumer, produced, 0));
+    hipLaunchKernel(HipTest::vectorADD, dim3(blocks), dim3(threadsPerBlock), 0, consumer, A_d, B_d, C_d, N);
+    HIPCHECK (hipMemcpyAsync(C_h, C_d, Nbytes, hipMemcpyDeviceToHost, consumer));
+    HIPCHECK (hipStreamSynchronize(consumer));
+
+    HipTest::checkVectorADD(A_h, B_h, C_h, N);
+
+    HIPCHECK (hipStreamSynchronize(producer));
+    HIPCHECK (hipEventDestroy(produced));
+    HipTest::freeArrays (A_d, B_d, C_d, A_h, B_h, C_h, true);
+}
+
+
+int main(int argc, char *argv[])
+{
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    hipStream_t producer, consumer;
+    HIPCHECK (hipStreamCreate(&producer));
+    HIPCHECK (hipStreamCreate(&consumer));
+
+    for (int i=0; i<iterations; i++) {
+        if (p_tests & 0x1) {
+            printf ("test: kernel event\n");
+            testKernelEvent(producer, consumer);
+        }
+        if (p_tests & 0x2) {
+            printf ("test: copy event\n");
+            testCopyEvent(producer, consumer);
+        }
+    }
+
+    HIPCHECK (hipStreamDestroy(producer));
+    HIPCHECK (hipStreamDestroy(consumer));
+
+    passed();
+}